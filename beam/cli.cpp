@@ -191,6 +191,15 @@ int main_impl(int argc, char* argv[])
 					node.m_Cfg.m_MiningThreads = vm[cli::MINING_THREADS].as<uint32_t>();
 #endif
 					node.m_Cfg.m_VerificationThreads = vm[cli::VERIFICATION_THREADS].as<int>();
+					node.m_Cfg.m_IoThreads = vm[cli::IO_THREADS].as<uint32_t>();
+
+					node.m_Cfg.m_DbTuning.m_Wal = vm[cli::DB_WAL].as<bool>();
+					node.m_Cfg.m_DbTuning.m_CheckpointThread = vm[cli::DB_CHECKPOINT_THREAD].as<bool>();
+					node.m_Cfg.m_DbTuning.m_Synchronous = vm[cli::DB_SYNCHRONOUS].as<int>();
+					node.m_Cfg.m_DbTuning.m_CacheSize = -static_cast<int>(vm[cli::DB_CACHE_MB].as<uint32_t>() * 1024); // negative: in KiB
+					node.m_Cfg.m_DbTuning.m_MmapSize = uint64_t(vm[cli::DB_MMAP_MB].as<uint32_t>()) << 20;
+					node.m_Cfg.m_DbTuning.m_PageSize = vm[cli::DB_PAGE_SIZE].as<uint32_t>();
+					node.m_Cfg.m_DbCommitBytes = uint64_t(vm[cli::DB_COMMIT_MB].as<uint32_t>()) << 20;
 
 					node.m_Cfg.m_LogUtxos = vm[cli::LOG_UTXOS].as<bool>();
 
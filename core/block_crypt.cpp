@@ -15,6 +15,7 @@
 #include <ctime>
 #include <chrono>
 #include "block_crypt.h"
+#include "../utility/parallel.h"
 
 namespace beam
 {
@@ -245,6 +246,32 @@ namespace beam
 		ClonePtr(m_pPublic, v.m_pPublic);
 	}
 
+	uint8_t Output::get_Flags() const
+	{
+		return
+			(m_Commitment.m_Y ? Flags::CommitmentY : 0) |
+			(m_Coinbase ? Flags::Coinbase : 0) |
+			(m_pConfidential ? Flags::Confidential : 0) |
+			(m_pPublic ? Flags::Public : 0) |
+			(m_Incubation ? Flags::Incubation : 0) |
+			((m_AssetID == Zero) ? 0 : Flags::Asset);
+	}
+
+	void Output::set_Flags(uint8_t nFlags)
+	{
+		m_Commitment.m_Y = (Flags::CommitmentY & nFlags);
+		m_Coinbase = 0 != (Flags::Coinbase & nFlags);
+
+		if (Flags::Confidential & nFlags)
+			m_pConfidential = std::make_unique<ECC::RangeProof::Confidential>();
+
+		if (Flags::Public & nFlags)
+			m_pPublic = std::make_unique<ECC::RangeProof::Public>();
+
+		if (!(Flags::Asset & nFlags))
+			m_AssetID = Zero;
+	}
+
 	int Output::cmp(const Output& v) const
 	{
 		{
@@ -1054,6 +1081,15 @@ namespace beam
 		return m_PoW.IsValid(hv.m_pData, hv.nBytes);
 	}
 
+	bool Block::SystemState::Full::IsValidPoW(const Full* pS, size_t nCount)
+	{
+		if (Rules::get().FakePoW)
+			return true;
+
+		// Equihash verification dominates, the states are independent
+		return RunParallel(nCount, [pS](size_t i) { return pS[i].IsValidPoW(); }, 4);
+	}
+
     bool Block::SystemState::Full::GeneratePoW(const PoW::Cancel& fnCancel)
 	{
 		Merkle::Hash hv;
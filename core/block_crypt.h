@@ -236,6 +236,20 @@ namespace beam
 		bool IsValid(ECC::Point::Native& comm) const;
 		Height get_MinMaturity(Height h) const; // regardless to the explicitly-overridden
 
+		// serialization flags, the same in all the formats
+		struct Flags
+		{
+			static const uint8_t CommitmentY	= 1;
+			static const uint8_t Coinbase		= 2;
+			static const uint8_t Confidential	= 4;
+			static const uint8_t Public			= 8;
+			static const uint8_t Incubation		= 0x10;
+			static const uint8_t Asset			= 0x20;
+		};
+
+		uint8_t get_Flags() const;
+		void set_Flags(uint8_t); // allocates the flagged range proof, the caller reads the rest
+
 		void operator = (const Output&);
 		int cmp(const Output&) const;
 		COMPARISON_VIA_CMP
@@ -334,6 +348,10 @@ namespace beam
 			bool Combine(IReader** ppR, int nR, const volatile bool& bStop); // combine consequent blocks, merge-sort and delete consumed outputs
 			// returns false if aborted
 			bool Combine(IReader&& r0, IReader&& r1, const volatile bool& bStop);
+
+			// parts of the Combine, readers should be reset. Utxos and kernels are independent, can be run concurrently if the writer allows
+			bool CombineUtxos(IReader** ppR, int nR, const volatile bool& bStop);
+			bool CombineKernels(IReader** ppR, int nR, const volatile bool& bStop);
 		};
 
 
@@ -489,6 +507,8 @@ namespace beam
 				bool IsSane() const;
 				bool IsValidPoW() const;
 				bool IsValid() const { return IsSane() && IsValidPoW(); }
+
+				static bool IsValidPoW(const Full*, size_t nCount); // many states, verified in parallel
                 bool GeneratePoW(const PoW::Cancel& = [](bool) { return false; });
 
 				// the most robust proof verification - verifies the whole proof structure
@@ -564,6 +584,7 @@ namespace beam
 				virtual void put_Start(const BodyBase&, const SystemState::Sequence::Prefix&) = 0;
 				virtual void put_NextHdr(const SystemState::Sequence::Element&) = 0;
 
+				bool CombineHdr(IMacroReader** ppR, int nR, const volatile bool& bStop);
 				bool CombineHdr(IMacroReader&& r0, IMacroReader&& r1, const volatile bool& bStop);
 			};
 
@@ -571,6 +592,8 @@ namespace beam
 
 			// suitable for big (compressed) blocks
 			class RW;
+			// several consequent RW segments, read as a single macroblock
+			class MultiRW;
 		};
 
 		struct Body
@@ -726,18 +749,35 @@ namespace beam
 		void WriteInternal(const T&, int);
 		void WriteMaturity(const TxElement&, int);
 
+		// The outputs (uo) are stored in blocks. Each block is split into columns (maturities, flags, commitments, proofs), compressed independently
+		struct OutputBlock;
+		std::unique_ptr<OutputBlock> m_pOutBlock;
+		OutputBlock& get_OutBlock();
+		bool LoadOutputs();
+		void FlushOutputs();
+
 		bool OpenInternal(int iData);
 		void PostOpen(int iData);
 		void Open(bool bRead);
 
+		static void get_FormatTag(Merkle::Hash&, uint8_t nFormat);
+
 	public:
 
-		RW() :m_bAutoDelete(false) {}
+		struct Format
+		{
+			static const uint8_t Legacy = 0; // outputs are stored one by one
+			static const uint8_t OutputBlocks = 1;
+			static const uint8_t Latest = OutputBlocks;
+		};
+
+		RW();
 		~RW();
 
 		// do not modify between Open() and Close()
 		bool m_bRead;
 		bool m_bAutoDelete;
+		uint8_t m_Format; // detected on read. On write - set before WCreate(), the latest by default
 		std::string m_sPath;
 		Merkle::Hash m_hvContentTag; // needed to make sure all the files indeed belong to the same data set
 
@@ -752,6 +792,9 @@ namespace beam
 
 		void NextKernelFF(Height hMin);
 
+		// Single pass over all the sources (CombineHdr + Combine). Utxos and kernels are written to different streams, hence are merged concurrently
+		bool CombineMT(IMacroReader** ppR, int nR, const volatile bool& bStop);
+
 		// IReader
 		virtual void Clone(Ptr&) override;
 		virtual void Reset() override;
@@ -770,6 +813,42 @@ namespace beam
 		virtual void put_NextHdr(const SystemState::Sequence::Element&) override;
 	};
 
+	class Block::BodyBase::MultiRW
+		:public Block::BodyBase::IMacroReader
+	{
+		// Segments are ordered from the oldest to the newest. The cut-through between them is applied on the fly, exactly as IWriter::Combine would do.
+		// Inputs and outputs are walked by independent sets of readers (each walk advances both kinds), so that both agree which ones are consumed.
+		std::vector<std::unique_ptr<RW> > m_vIn; // also used for kernels and headers
+		std::vector<std::unique_ptr<RW> > m_vOut;
+		size_t m_iHdr;
+
+		Input m_pGuardUtxoIn[2];
+		Output m_pGuardUtxoOut[2];
+
+		static int FindNext(std::vector<std::unique_ptr<RW> >&, bool bInp);
+		void FindKernel();
+
+	public:
+
+		MultiRW() :m_iHdr(0) {}
+
+		RW& AddSegment(); // should be opened by the caller
+		size_t get_Segments() const { return m_vIn.size(); }
+		void Close();
+
+		void NextKernelFF(Height hMin);
+
+		// IReader
+		virtual void Clone(Ptr&) override;
+		virtual void Reset() override;
+		virtual void NextUtxoIn() override;
+		virtual void NextUtxoOut() override;
+		virtual void NextKernel() override;
+		// IMacroReader
+		virtual void get_Start(BodyBase&, SystemState::Sequence::Prefix&) override;
+		virtual bool get_NextHdr(SystemState::Sequence::Element&) override;
+	};
+
 	struct Block::ChainWorkProof
 	{
 		// Compressed consecutive states (likely to appear at the end)
@@ -801,7 +880,7 @@ namespace beam
 		void Create(ISource&, const SystemState::Full& sRoot);
 		bool IsValid(SystemState::Full* pTip = NULL) const;
 		bool Crop(); // according to current bound
-		bool Crop(const ChainWorkProof& src);
+		bool Crop(const ChainWorkProof& src, bool bTrusted = false); // for the trusted (self-built) src the PoW of its states is not re-verified
 		bool IsEmpty() const { return m_Heading.m_vElements.empty(); }
 
 		template <typename Archive>
@@ -818,7 +897,7 @@ namespace beam
 
 	private:
 		struct Sampler;
-		bool IsValidInternal(size_t& iState, size_t& iHash, const Difficulty::Raw& lowerBound, SystemState::Full* pTip) const;
+		bool IsValidInternal(size_t& iState, size_t& iHash, const Difficulty::Raw& lowerBound, SystemState::Full* pTip, bool bTrusted) const;
 		void ZeroInit();
 	};
 
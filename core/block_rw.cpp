@@ -19,6 +19,8 @@
 #include "core/serialization_adapters.h"
 #include "aes.h"
 #include "pkcs5_pbkdf2.h"
+#include "utility/lz_block.h"
+#include <thread>
 
 namespace beam
 {
@@ -30,6 +32,183 @@ namespace beam
 #undef THE_MACRO
 	};
 
+	struct Block::BodyBase::RW::OutputBlock
+	{
+		static const uint32_t s_Max = 256; // outputs per block
+		static const uint32_t s_MaxColumnPerOutput = 0x1000; // sanity limit for the unpacked column size
+
+		struct Column
+		{
+			enum Enum {
+				Height, // maturity delta and incubation
+				Flags,
+				Commitment,
+				Proof, // and the rest
+				count
+			};
+		};
+
+		uint32_t m_Count = 0; // pending to write, or remaining to read
+
+		Serializer m_pSer[Column::count];
+		ByteBuffer m_pBuf[Column::count];
+		Deserializer m_pDer[Column::count];
+
+		void Write(const Output&, Height dh);
+		void Read(Output&, Height& dh);
+	};
+
+	void Block::BodyBase::RW::OutputBlock::Write(const Output& v, Height dh)
+	{
+		uint8_t nFlags = v.get_Flags();
+
+		m_pSer[Column::Height] & dh;
+		m_pSer[Column::Flags] & nFlags;
+		m_pSer[Column::Commitment] & v.m_Commitment.m_X;
+
+		if (v.m_pConfidential)
+			m_pSer[Column::Proof] & *v.m_pConfidential;
+
+		if (v.m_pPublic)
+			m_pSer[Column::Proof] & *v.m_pPublic;
+
+		if (v.m_Incubation)
+			m_pSer[Column::Height] & v.m_Incubation;
+
+		if (Output::Flags::Asset & nFlags)
+			m_pSer[Column::Proof] & v.m_AssetID;
+
+		m_Count++;
+	}
+
+	void Block::BodyBase::RW::OutputBlock::Read(Output& v, Height& dh)
+	{
+		uint8_t nFlags;
+		m_pDer[Column::Height] & dh;
+		m_pDer[Column::Flags] & nFlags;
+		m_pDer[Column::Commitment] & v.m_Commitment.m_X;
+
+		v.set_Flags(nFlags);
+
+		if (Output::Flags::Confidential & nFlags)
+			m_pDer[Column::Proof] & *v.m_pConfidential;
+
+		if (Output::Flags::Public & nFlags)
+			m_pDer[Column::Proof] & *v.m_pPublic;
+
+		if (Output::Flags::Incubation & nFlags)
+			m_pDer[Column::Height] & v.m_Incubation;
+
+		if (Output::Flags::Asset & nFlags)
+			m_pDer[Column::Proof] & v.m_AssetID;
+	}
+
+	Block::BodyBase::RW::OutputBlock& Block::BodyBase::RW::get_OutBlock()
+	{
+		if (!m_pOutBlock)
+			m_pOutBlock.reset(new OutputBlock);
+		return *m_pOutBlock;
+	}
+
+	void Block::BodyBase::RW::FlushOutputs()
+	{
+		if (!m_pOutBlock || m_bRead || !m_pOutBlock->m_Count)
+			return;
+
+		OutputBlock& x = *m_pOutBlock;
+
+		std::FStream& s = m_pS[Type::uo];
+		if (!s.IsOpen() && !OpenInternal(Type::uo))
+			std::ThrowLastError();
+
+		yas::binary_oarchive<std::FStream, SERIALIZE_OPTIONS> arc(s);
+		arc & x.m_Count;
+
+		ByteBuffer bufPacked;
+
+		for (int i = 0; i < OutputBlock::Column::count; i++)
+		{
+			ByteBuffer& buf = x.m_pBuf[i];
+			x.m_pSer[i].swap_buf(buf);
+			x.m_pSer[i].reset();
+
+			uint32_t nRaw = static_cast<uint32_t>(buf.size());
+			uint32_t nPacked = 0;
+
+			if (nRaw)
+			{
+				bufPacked.resize(LzBlock::get_MaxPacked(nRaw));
+				nPacked = static_cast<uint32_t>(LzBlock::Pack(&bufPacked.front(), &buf.front(), nRaw));
+			}
+
+			bool bPacked = (nPacked < nRaw); // otherwise stored as-is
+			if (!bPacked)
+				nPacked = nRaw;
+
+			arc & nRaw;
+			arc & nPacked;
+
+			if (nPacked)
+				s.write(bPacked ? &bufPacked.front() : &buf.front(), nPacked);
+		}
+
+		x.m_Count = 0;
+	}
+
+	bool Block::BodyBase::RW::LoadOutputs()
+	{
+		OutputBlock& x = get_OutBlock();
+		assert(!x.m_Count);
+
+		for (int i = 0; i < OutputBlock::Column::count; i++)
+			if (x.m_pDer[i].bytes_left())
+				throw std::runtime_error("bad uo");
+
+		std::FStream& s = m_pS[Type::uo];
+		if (!s.get_Remaining())
+			return false;
+
+		yas::binary_iarchive<std::FStream, SERIALIZE_OPTIONS> arc(s);
+		arc & x.m_Count;
+
+		if (!x.m_Count || (x.m_Count > OutputBlock::s_Max))
+			throw std::runtime_error("bad uo");
+
+		ByteBuffer bufPacked;
+
+		for (int i = 0; i < OutputBlock::Column::count; i++)
+		{
+			uint32_t nRaw, nPacked;
+			arc & nRaw;
+			arc & nPacked;
+
+			if ((nPacked > nRaw) || (nRaw > x.m_Count * OutputBlock::s_MaxColumnPerOutput))
+				throw std::runtime_error("bad uo");
+
+			ByteBuffer& buf = x.m_pBuf[i];
+			buf.resize(nRaw);
+
+			if (nPacked == nRaw)
+			{
+				if (nRaw)
+					s.read(&buf.front(), nRaw);
+			}
+			else
+			{
+				bufPacked.resize(nPacked);
+				if (nPacked)
+					s.read(&bufPacked.front(), nPacked);
+
+				if (!LzBlock::Unpack(&buf.front(), nRaw, bufPacked.empty() ? NULL : &bufPacked.front(), nPacked))
+					throw std::runtime_error("bad uo");
+			}
+
+			x.m_pDer[i].reset(buf);
+		}
+
+		return true;
+	}
+
 	void Block::BodyBase::RW::GetPath(std::string& s, int iData) const
 	{
 		assert(iData < Type::count);
@@ -50,8 +229,11 @@ namespace beam
 	{
 		using namespace std;
 
+		FlushOutputs(); // pending from the previous write, if any
+
 		m_bRead = bRead;
 		ZeroObject(m_pMaturity);
+		m_pOutBlock.reset();
 
 		if (bRead)
 		{
@@ -75,6 +257,15 @@ namespace beam
 		return true;
 	}
 
+	void Block::BodyBase::RW::get_FormatTag(Merkle::Hash& hv, uint8_t nFormat)
+	{
+		// The legacy format is tagged by the rules checksum. The newer ones - by its hash with the format, so that the older code rejects them as incompatible
+		if (Format::Legacy == nFormat)
+			hv = Rules::get().Checksum;
+		else
+			ECC::Hash::Processor() << "mb.format" << Rules::get().Checksum << nFormat >> hv;
+	}
+
 	void Block::BodyBase::RW::PostOpen(int iData)
 	{
 		if (m_bRead)
@@ -85,8 +276,16 @@ namespace beam
 
 			if (Type::hd == iData)
 			{
-				if (hv != Rules::get().Checksum)
-					throw std::runtime_error("Block rules mismatch");
+				for (m_Format = Format::Latest; ; m_Format--)
+				{
+					Merkle::Hash hvFmt;
+					get_FormatTag(hvFmt, m_Format);
+					if (hv == hvFmt)
+						break;
+
+					if (Format::Legacy == m_Format)
+						throw std::runtime_error("Block rules mismatch");
+				}
 
 				arc & m_hvContentTag;
 			}
@@ -101,7 +300,14 @@ namespace beam
 			yas::binary_oarchive<std::FStream, SERIALIZE_OPTIONS> arc(m_pS[iData]);
 
 			if (Type::hd == iData)
-				arc & Rules::get().Checksum;
+			{
+				if (m_Format > Format::Latest)
+					throw std::runtime_error("MB format unsupported");
+
+				Merkle::Hash hv;
+				get_FormatTag(hv, m_Format);
+				arc & hv;
+			}
 
 			arc & m_hvContentTag;
 		}
@@ -119,21 +325,41 @@ namespace beam
 
 	void Block::BodyBase::RW::Close()
 	{
+		FlushOutputs();
+
 		for (int i = 0; i < Type::count; i++)
 			m_pS[i].Close();
 	}
 
+	Block::BodyBase::RW::RW()
+		:m_bAutoDelete(false)
+		,m_Format(Format::Latest)
+	{
+	}
+
 	Block::BodyBase::RW::~RW()
 	{
 		if (m_bAutoDelete)
 		{
+			m_pOutBlock.reset(); // no need to write
 			Close();
 			Delete();
 		}
+		else
+		{
+			try {
+				FlushOutputs(); // if not closed explicitly
+			}
+			catch (const std::exception&) {
+				// the stream remains incomplete, would fail to read
+			}
+		}
 	}
 
 	void Block::BodyBase::RW::Reset()
 	{
+		FlushOutputs(); // only the read-ahead is dropped
+
 		for (int i = 0; i < Type::count; i++)
 			if (m_pS[i].IsOpen())
 			{
@@ -142,6 +368,7 @@ namespace beam
 			}
 
 		ZeroObject(m_pMaturity);
+		m_pOutBlock.reset();
 		m_KrnSizeTotal() = m_pS[Type::ko].Tell() + m_pS[Type::ko].get_Remaining();
 
 		LoadMaturity(Type::ko); // maturity of the 1st kernel
@@ -155,6 +382,8 @@ namespace beam
 
 	void Block::BodyBase::RW::Flush()
 	{
+		FlushOutputs();
+
 		for (int i = 0; i < Type::count; i++)
 			if (m_pS[i].IsOpen())
 				m_pS[i].Flush();
@@ -166,6 +395,7 @@ namespace beam
 		pOut.reset(pRet);
 
 		pRet->m_sPath = m_sPath;
+		pRet->m_Format = m_Format; // for write
 		pRet->Open(m_bRead);
 	}
 
@@ -177,8 +407,32 @@ namespace beam
 
 	void Block::BodyBase::RW::NextUtxoOut()
 	{
-		LoadMaturity(Type::uo);
-		LoadInternal(m_pUtxoOut, Type::uo, m_pGuardUtxoOut);
+		if (Format::Legacy == m_Format)
+		{
+			LoadMaturity(Type::uo);
+			LoadInternal(m_pUtxoOut, Type::uo, m_pGuardUtxoOut);
+			return;
+		}
+
+		OutputBlock& x = get_OutBlock();
+		if (!x.m_Count && !LoadOutputs())
+		{
+			m_pUtxoOut = NULL;
+			return;
+		}
+
+		x.m_Count--;
+
+		m_pGuardUtxoOut[0].swap(m_pGuardUtxoOut[1]);
+		m_pGuardUtxoOut[0].reset(new Output);
+
+		Height dh;
+		x.Read(*m_pGuardUtxoOut[0], dh);
+
+		m_pMaturity[Type::uo] += dh;
+		m_pGuardUtxoOut[0]->m_Maturity = m_pMaturity[Type::uo];
+
+		m_pUtxoOut = m_pGuardUtxoOut[0].get();
 	}
 
 	void Block::BodyBase::RW::NextKernel()
@@ -254,8 +508,19 @@ namespace beam
 
 	void Block::BodyBase::RW::Write(const Output& v)
 	{
-		WriteMaturity(v, Type::uo);
-		WriteInternal(v, Type::uo);
+		if (Format::Legacy == m_Format)
+		{
+			WriteMaturity(v, Type::uo);
+			WriteInternal(v, Type::uo);
+			return;
+		}
+
+		OutputBlock& x = get_OutBlock();
+		x.Write(v, v.m_Maturity - m_pMaturity[Type::uo]);
+		m_pMaturity[Type::uo] = v.m_Maturity;
+
+		if (OutputBlock::s_Max == x.m_Count)
+			FlushOutputs();
 	}
 
 	void Block::BodyBase::RW::Write(const TxKernel& v)
@@ -361,6 +626,207 @@ namespace beam
 		arc & v;
 	}
 
+	/////////////
+	// MultiRW
+	Block::BodyBase::RW& Block::BodyBase::MultiRW::AddSegment()
+	{
+		m_vIn.emplace_back(new RW);
+		return *m_vIn.back();
+	}
+
+	void Block::BodyBase::MultiRW::Close()
+	{
+		m_vIn.clear();
+		m_vOut.clear();
+	}
+
+	void Block::BodyBase::MultiRW::Clone(Ptr& pOut)
+	{
+		MultiRW* pRet = new MultiRW;
+		pOut.reset(pRet);
+
+		for (size_t i = 0; i < m_vIn.size(); i++)
+		{
+			RW& rw = pRet->AddSegment();
+			rw.m_sPath = m_vIn[i]->m_sPath;
+			rw.ROpen();
+		}
+	}
+
+	void Block::BodyBase::MultiRW::Reset()
+	{
+		for (size_t i = m_vOut.size(); i < m_vIn.size(); i++)
+		{
+			m_vOut.emplace_back(new RW);
+			m_vOut.back()->m_sPath = m_vIn[i]->m_sPath;
+			m_vOut.back()->ROpen();
+		}
+
+		for (size_t i = 0; i < m_vIn.size(); i++)
+		{
+			m_vIn[i]->Reset();
+			m_vOut[i]->Reset();
+		}
+
+		m_iHdr = 0;
+		m_pUtxoIn = NULL;
+		m_pUtxoOut = NULL;
+
+		// preload
+		MultiRW::NextUtxoIn();
+		MultiRW::NextUtxoOut();
+		FindKernel();
+	}
+
+	int Block::BodyBase::MultiRW::FindNext(std::vector<std::unique_ptr<RW> >& v, bool bInp)
+	{
+		// same as in IWriter::Combine, elements of the other kind are skipped
+		while (true)
+		{
+			const Input* pInp = NULL;
+			const Output* pOut = NULL;
+			int iInp = 0, iOut = 0;
+
+			for (size_t i = 0; i < v.size(); i++)
+			{
+				const Input* pi = v[i]->m_pUtxoIn;
+				if (pi && (!pInp || (*pInp > *pi)))
+				{
+					pInp = pi;
+					iInp = static_cast<int>(i);
+				}
+
+				const Output* po = v[i]->m_pUtxoOut;
+				if (po && (!pOut || (*pOut > *po)))
+				{
+					pOut = po;
+					iOut = static_cast<int>(i);
+				}
+			}
+
+			if (pInp && pOut)
+			{
+				int n = CmpInOut(*pInp, *pOut);
+				if (!n)
+				{
+					v[iInp]->NextUtxoIn();
+					v[iOut]->NextUtxoOut();
+					continue;
+				}
+
+				if (n > 0)
+					pInp = NULL;
+			}
+
+			if (pInp)
+			{
+				if (bInp)
+					return iInp;
+				v[iInp]->NextUtxoIn();
+			}
+			else
+			{
+				if (!pOut)
+					return -1;
+				if (!bInp)
+					return iOut;
+				v[iOut]->NextUtxoOut();
+			}
+		}
+	}
+
+	void Block::BodyBase::MultiRW::NextUtxoIn()
+	{
+		int i = FindNext(m_vIn, true);
+		if (i < 0)
+			m_pUtxoIn = NULL;
+		else
+		{
+			// the source may be advanced several times before the next call, hence the copy
+			Input& v = m_pGuardUtxoIn[(m_pGuardUtxoIn == m_pUtxoIn) ? 1 : 0];
+			v = *m_vIn[i]->m_pUtxoIn;
+			m_pUtxoIn = &v;
+
+			m_vIn[i]->NextUtxoIn();
+		}
+	}
+
+	void Block::BodyBase::MultiRW::NextUtxoOut()
+	{
+		int i = FindNext(m_vOut, false);
+		if (i < 0)
+			m_pUtxoOut = NULL;
+		else
+		{
+			Output& v = m_pGuardUtxoOut[(m_pGuardUtxoOut == m_pUtxoOut) ? 1 : 0];
+			v = *m_vOut[i]->m_pUtxoOut;
+			m_pUtxoOut = &v;
+
+			m_vOut[i]->NextUtxoOut();
+		}
+	}
+
+	void Block::BodyBase::MultiRW::FindKernel()
+	{
+		m_pKernel = NULL;
+
+		for (size_t i = 0; i < m_vIn.size(); i++)
+		{
+			const TxKernel* p = m_vIn[i]->m_pKernel;
+			if (p && (!m_pKernel || (*m_pKernel > *p)))
+				m_pKernel = p;
+		}
+	}
+
+	void Block::BodyBase::MultiRW::NextKernel()
+	{
+		// kernels are never consumed, each step advances a single segment. Its pointers remain valid as needed
+		for (size_t i = 0; i < m_vIn.size(); i++)
+			if (m_vIn[i]->m_pKernel == m_pKernel)
+			{
+				m_vIn[i]->NextKernel();
+				break;
+			}
+
+		FindKernel();
+	}
+
+	void Block::BodyBase::MultiRW::NextKernelFF(Height hMin)
+	{
+		for (size_t i = 0; i < m_vIn.size(); i++)
+			m_vIn[i]->NextKernelFF(hMin);
+
+		FindKernel();
+	}
+
+	void Block::BodyBase::MultiRW::get_Start(BodyBase& body, SystemState::Sequence::Prefix& prefix)
+	{
+		if (m_vIn.empty())
+			std::ThrowLastError();
+
+		m_vIn[0]->get_Start(body, prefix);
+
+		for (size_t i = 1; i < m_vIn.size(); i++)
+		{
+			BodyBase body1;
+			SystemState::Sequence::Prefix prefix1;
+			m_vIn[i]->get_Start(body1, prefix1);
+
+			body.Merge(body1);
+		}
+
+		m_iHdr = 0;
+	}
+
+	bool Block::BodyBase::MultiRW::get_NextHdr(SystemState::Sequence::Element& elem)
+	{
+		for (; m_iHdr < m_vIn.size(); m_iHdr++)
+			if (m_vIn[m_iHdr]->get_NextHdr(elem))
+				return true;
+
+		return false;
+	}
+
 	size_t TxBase::IReader::get_SizeNetto()
 	{
 		SerializerSizeCounter ssc;
@@ -399,7 +865,13 @@ namespace beam
 		for (int i = 0; i < nR; i++)
 			ppR[i]->Reset();
 
-		// Utxo
+		return
+			CombineUtxos(ppR, nR, bStop) &&
+			CombineKernels(ppR, nR, bStop);
+	}
+
+	bool TxBase::IWriter::CombineUtxos(IReader** ppR, int nR, const volatile bool& bStop)
+	{
 		while (true)
 		{
 			if (bStop)
@@ -460,8 +932,11 @@ namespace beam
 			}
 		}
 
+		return true;
+	}
 
-		// Kernels
+	bool TxBase::IWriter::CombineKernels(IReader** ppR, int nR, const volatile bool& bStop)
+	{
 		while (true)
 		{
 			if (bStop)
@@ -491,34 +966,91 @@ namespace beam
 	}
 
 	bool Block::BodyBase::IMacroWriter::CombineHdr(IMacroReader&& r0, IMacroReader&& r1, const volatile bool& bStop)
+	{
+		IMacroReader* ppR[] = { &r0, &r1 };
+		return CombineHdr(ppR, _countof(ppR), bStop);
+	}
+
+	bool Block::BodyBase::IMacroWriter::CombineHdr(IMacroReader** ppR, int nR, const volatile bool& bStop)
 	{
 		Block::BodyBase body0, body1;
 		Block::SystemState::Sequence::Prefix prefix0, prefix1;
 		Block::SystemState::Sequence::Element elem;
 
-		r0.Reset();
-		r0.get_Start(body0, prefix0);
-		r1.Reset();
-		r1.get_Start(body1, prefix1);
+		for (int i = 0; i < nR; i++)
+		{
+			ppR[i]->Reset();
+
+			if (i)
+			{
+				ppR[i]->get_Start(body1, prefix1);
+				body0.Merge(body1);
+			}
+			else
+				ppR[i]->get_Start(body0, prefix0);
+		}
 
-		body0.Merge(body1);
 		put_Start(body0, prefix0);
 
-		while (r0.get_NextHdr(elem))
+		for (int i = 0; i < nR; i++)
 		{
-			if (bStop)
-				return false;
-			put_NextHdr(elem);
+			while (ppR[i]->get_NextHdr(elem))
+			{
+				if (bStop)
+					return false;
+				put_NextHdr(elem);
+			}
 		}
 
-		while (r1.get_NextHdr(elem))
+		return true;
+	}
+
+	bool Block::BodyBase::RW::CombineMT(IMacroReader** ppR, int nR, const volatile bool& bStop)
+	{
+		// headers are small, and the sources are reset by CombineHdr, hence it goes first
+		if (!CombineHdr(ppR, nR, bStop))
+			return false;
+
+		// kernels are read via separate clones, so that no reader is shared between the threads
+		std::vector<IReader::Ptr> vKrn(nR);
+		std::vector<IReader*> vKrnPtr(nR);
+
+		for (int i = 0; i < nR; i++)
 		{
-			if (bStop)
-				return false;
-			put_NextHdr(elem);
+			ppR[i]->Reset();
+
+			ppR[i]->Clone(vKrn[i]);
+			vKrnPtr[i] = vKrn[i].get();
+			vKrnPtr[i]->Reset();
 		}
 
-		return true;
+		std::vector<IReader*> vUtxoPtr(ppR, ppR + nR);
+
+		bool bKrnOk = false;
+		std::exception_ptr pExc;
+
+		std::thread t([&]() {
+			try {
+				bKrnOk = CombineKernels(vKrnPtr.empty() ? NULL : &vKrnPtr.front(), nR, bStop);
+			} catch (...) {
+				pExc = std::current_exception();
+			}
+		});
+
+		bool bUtxoOk = false;
+		try {
+			bUtxoOk = CombineUtxos(vUtxoPtr.empty() ? NULL : &vUtxoPtr.front(), nR, bStop);
+		} catch (...) {
+			t.join();
+			throw;
+		}
+
+		t.join();
+
+		if (pExc)
+			std::rethrow_exception(pExc);
+
+		return bUtxoOk && bKrnOk;
 	}
 
 	/////////////
@@ -192,7 +192,7 @@ namespace beam
 	{
 		size_t iState, iHash;
 		return
-			IsValidInternal(iState, iHash, m_LowerBound, pTip) &&
+			IsValidInternal(iState, iHash, m_LowerBound, pTip, false) &&
 			(m_vArbitraryStates.size() + m_Heading.m_vElements.size() == iState) &&
 			(m_Proof.m_vData.size() == iHash);
 	}
@@ -202,10 +202,10 @@ namespace beam
 		std::copy(src.cbegin(), src.cbegin() + dst.size(), dst.begin());
 	}
 
-	bool Block::ChainWorkProof::Crop(const ChainWorkProof& src)
+	bool Block::ChainWorkProof::Crop(const ChainWorkProof& src, bool bTrusted /* = false */)
 	{
 		size_t iState, iHash;
-		if (!src.IsValidInternal(iState, iHash, m_LowerBound, NULL))
+		if (!src.IsValidInternal(iState, iHash, m_LowerBound, NULL, bTrusted))
 			return false;
 
 		bool bInPlace = (&src == this);
@@ -258,7 +258,7 @@ namespace beam
 		return Crop(*this);
 	}
 
-	bool Block::ChainWorkProof::IsValidInternal(size_t& iState, size_t& iHash, const Difficulty::Raw& lowerBound, Block::SystemState::Full* pTip) const
+	bool Block::ChainWorkProof::IsValidInternal(size_t& iState, size_t& iHash, const Difficulty::Raw& lowerBound, Block::SystemState::Full* pTip, bool bTrusted) const
 	{
 		if (m_Heading.m_vElements.empty())
 			return false;
@@ -267,10 +267,19 @@ namespace beam
 		Cast::Down<SystemState::Sequence::Prefix>(s) = m_Heading.m_Prefix;
 		Cast::Down<SystemState::Sequence::Element>(s) = m_Heading.m_vElements.back();
 
+		// the heading states are unpacked for the PoW verification, which is done in parallel with the arbitrary states
+		std::vector<SystemState::Full> vStates;
+		if (!bTrusted)
+			vStates.reserve(m_Heading.m_vElements.size() + m_vArbitraryStates.size());
+
 		for (size_t i = m_Heading.m_vElements.size() - 1; ; )
 		{
-			if (!(s.IsValid()))
-				return false;
+			if (!bTrusted)
+			{
+				if (!s.IsSane())
+					return false;
+				vStates.push_back(s);
+			}
 
 			if (!i--)
 				break;
@@ -280,10 +289,15 @@ namespace beam
 			s.m_ChainWork += s.m_PoW.m_Difficulty;
 		}
 
-		for (size_t i = 0; i < m_vArbitraryStates.size(); i++)
+		if (!bTrusted)
 		{
-			const Block::SystemState::Full& s2 = m_vArbitraryStates[i];
-			if (!(s2.IsValid()))
+			for (size_t i = 0; i < m_vArbitraryStates.size(); i++)
+				if (!m_vArbitraryStates[i].IsSane())
+					return false;
+
+			vStates.insert(vStates.end(), m_vArbitraryStates.begin(), m_vArbitraryStates.end());
+
+			if (!SystemState::Full::IsValidPoW(vStates.data(), vStates.size()))
 				return false;
 		}
 
@@ -580,7 +580,10 @@ void FlyClient::NetworkStd::PostRequestInternal(Request& r)
     m_lst.push_back(*pNode);
     pNode->m_pRequest = &r;
 
-    OnNewRequests();
+    if (!m_pTimerNewRequests)
+        m_pTimerNewRequests = io::Timer::create(io::Reactor::get_Current());
+
+    m_pTimerNewRequests->start(0, false, [this]() { OnNewRequests(); });
 }
 
 void FlyClient::NetworkStd::OnNewRequests()
@@ -607,6 +610,8 @@ void FlyClient::NetworkStd::Connection::AssignRequests()
     for (RequestList::iterator it = m_This.m_lst.begin(); m_This.m_lst.end() != it; )
         AssignRequest(*it++);
 
+    FlushUtxos();
+
     if (m_lst.empty() && m_This.m_Cfg.m_PollPeriod_ms)
         SetTimer(0);
     else
@@ -705,6 +710,65 @@ void FlyClient::NetworkStd::Connection::OnRequestData(RequestUtxo& req)
             ThrowUnexpected();
 }
 
+void FlyClient::NetworkStd::Connection::SendRequest(RequestUtxo& req)
+{
+    if (!(LoginFlags::Extension2 & m_LoginFlags) || req.m_Msg.m_MaturityMin)
+    {
+        FlushUtxos();
+        Send(req.m_Msg);
+        return;
+    }
+
+    m_UtxosOut.m_Utxos.push_back(req.m_Msg.m_Utxo);
+    if (m_UtxosOut.m_Utxos.size() >= g_ProofUtxoMultiMaxSize)
+        FlushUtxos();
+}
+
+void FlyClient::NetworkStd::Connection::FlushUtxos()
+{
+    if (m_UtxosOut.m_Utxos.empty())
+        return;
+
+    // the node expects them sorted, the answers are matched back in OnMsg
+    std::sort(m_UtxosOut.m_Utxos.begin(), m_UtxosOut.m_Utxos.end());
+    Send(m_UtxosOut);
+    m_UtxosOut.m_Utxos.clear();
+}
+
+void FlyClient::NetworkStd::Connection::OnMsg(ProofUtxoMulti&& msg)
+{
+    std::vector<std::vector<Input::Proof> > vProofs;
+    if (!UnpackProofUtxoMulti(vProofs, msg))
+        ThrowUnexpected();
+
+    // the answers go in the sorted order of the first pending requests
+    std::vector<std::pair<const ECC::Point*, RequestUtxo*> > vReqs;
+    vReqs.reserve(vProofs.size());
+
+    for (RequestList::iterator it = m_lst.begin(); vReqs.size() < vProofs.size(); it++)
+    {
+        if ((m_lst.end() == it) || (Request::Type::Utxo != it->m_pRequest->get_Type()))
+            ThrowUnexpected();
+
+        RequestUtxo& req = Cast::Up<RequestUtxo>(*it->m_pRequest);
+        vReqs.emplace_back(&req.m_Msg.m_Utxo, &req);
+    }
+
+    std::stable_sort(vReqs.begin(), vReqs.end(), [](const std::pair<const ECC::Point*, RequestUtxo*>& a, const std::pair<const ECC::Point*, RequestUtxo*>& b) {
+        return *a.first < *b.first;
+    });
+
+    for (size_t i = 0; i < vReqs.size(); i++)
+        vReqs[i].second->m_Res.m_Proofs.swap(vProofs[i]);
+
+    for (size_t i = 0; i < vReqs.size(); i++)
+    {
+        RequestUtxo& req = Cast::Up<RequestUtxo>(get_FirstRequestStrict(Request::Type::Utxo));
+        OnRequestData(req);
+        OnFirstRequestDone(IsSupported(req));
+    }
+}
+
 bool FlyClient::NetworkStd::Connection::IsSupported(RequestKernel& req)
 {
     return (Flags::Node & m_Flags) && IsAtTip();
@@ -753,6 +817,8 @@ bool FlyClient::NetworkStd::Connection::IsSupported(RequestBbsMsg& req)
 
 void FlyClient::NetworkStd::Connection::SendRequest(RequestBbsMsg& req)
 {
+    FlushUtxos();
+
 	if (LoginFlags::Extension1 & m_LoginFlags)
 	    Send(req.m_Msg);
 	else
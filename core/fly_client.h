@@ -124,6 +124,9 @@ namespace proto {
 			RequestList m_lst; // idle
 			void OnNewRequests();
 
+			// The posted requests are assigned on the next loop iteration, so that the ones posted together can be batched
+			io::Timer::Ptr m_pTimerNewRequests;
+
 			struct Config {
 				std::vector<io::Address> m_vNodes;
 				uint32_t m_PollPeriod_ms = 0; // set to 0 to keep connection. Anyway poll period would be no less than the expected rate of blocks
@@ -206,6 +209,7 @@ namespace proto {
 				virtual void OnMsg(proto::ProofChainWork&& msg) override;
 				virtual void OnMsg(proto::BbsMsg&& msg) override;
 				virtual void OnMsg(proto::BbsMsgV0&& msg) override;
+				virtual void OnMsg(proto::ProofUtxoMulti&& msg) override;
 #define THE_MACRO(type, msgOut, msgIn) \
 				virtual void OnMsg(proto::msgIn&&) override; \
 				bool IsSupported(Request##type&); \
@@ -213,8 +217,13 @@ namespace proto {
 				REQUEST_TYPES_All(THE_MACRO)
 #undef THE_MACRO
 
-				template <typename Req> void SendRequest(Req& r) { Send(r.m_Msg); }
+				template <typename Req> void SendRequest(Req& r) { FlushUtxos(); Send(r.m_Msg); }
 				void SendRequest(RequestBbsMsg&);
+				void SendRequest(RequestUtxo&);
+
+				// consecutive utxo requests are sent as a single GetProofUtxoMulti, if supported
+				GetProofUtxoMulti m_UtxosOut;
+				void FlushUtxos();
 			};
 
 			typedef boost::intrusive::list<Connection> ConnectionList;
@@ -312,6 +312,19 @@ namespace beam
 		assert(b.m_Tail < m_nMapping);
 	}
 
+	void MappedFile::EnsureSize(Offset n)
+	{
+		if (m_nMapping >= n)
+			return;
+
+		// grow geometrically, to avoid remapping on each append
+		Offset n1 = AlignUp(std::max(n, m_nMapping + (m_nMapping >> 1)), s_PageSize);
+
+		CloseMapping();
+		Resize(n1);
+		OpenMapping();
+	}
+
 	////////////////////////////////////////
 	// ChainNavigator
 	void ChainNavigator::Open(const char* sz)
@@ -81,6 +81,9 @@ namespace beam
 
 		void* Allocate(uint32_t iBank, uint32_t nSize);
 		void Free(uint32_t iBank, void*);
+
+		// For flat layouts, w/o banks. Grows the file (with some reserve) to be at least of the given size. Invalidates the pointers
+		void EnsureSize(Offset);
 	};
 
 	class ChainNavigator
@@ -17,6 +17,8 @@
 #include "core/ecc_native.h"
 #include "proto.h"
 #include "../utility/logger.h"
+#include "../utility/parallel.h"
+#include <atomic>
 
 namespace beam {
 namespace proto {
@@ -159,6 +161,18 @@ bool ImportPeerID(ECC::Point::Native& res, const PeerID& pid)
     return res.ImportNnz(pt);
 }
 
+void InitViaDiffieHellman(const ECC::Scalar::Native& myPrivate, const ECC::Point::Native& ptRemote, const PeerID& myPublic, AES::Encoder& enc, ECC::Hash::Mac& hmac, AES::StreamCipher& cIn)
+{
+    ECC::Point::Native ptSecret = ptRemote * myPrivate;
+
+    ECC::NoLeak<ECC::Hash::Value> hvSecret;
+    ECC::Hash::Processor() << ptSecret >> hvSecret.V;
+
+    enc.Init(hvSecret.V.m_pData);
+    hmac.Reset(hvSecret.V.m_pData, hvSecret.V.nBytes);
+    InitCipherIV(cIn, hvSecret.V, myPublic);
+}
+
 bool InitViaDiffieHellman(const ECC::Scalar::Native& myPrivate, const PeerID& remotePublic, AES::Encoder& enc, ECC::Hash::Mac& hmac, AES::StreamCipher* pCipherOut, AES::StreamCipher* pCipherIn)
 {
     // Diffie-Hellman
@@ -261,6 +275,58 @@ bool Bbs::Decrypt(uint8_t*& p, uint32_t& n, const ECC::Scalar::Native& privateAd
     return (hvMac == hvMac2);
 }
 
+uint32_t Bbs::DecryptMulti(uint8_t*& p, uint32_t& n, const Recipient* pR, uint32_t nCount)
+{
+    PeerID remotePublic;
+    const uint32_t nHdr = remotePublic.nBytes + ECC::Hash::Value::nBytes;
+
+    if (n < nHdr)
+        return nCount;
+
+    memcpy(remotePublic.m_pData, p, remotePublic.nBytes);
+
+    ECC::Point::Native ptRemote;
+    ImportPeerID(ptRemote, remotePublic);
+
+    const ByteBuffer bufSrc(p + remotePublic.nBytes, p + n);
+    ByteBuffer bufRes;
+
+    std::atomic<uint32_t> iFound(nCount);
+
+    RunParallel(nCount, [&](size_t i)
+    {
+        ByteBuffer buf(bufSrc);
+
+        AES::Encoder enc;
+        AES::StreamCipher cIn;
+        ECC::Hash::Mac hmac;
+        InitViaDiffieHellman(*pR[i].m_pSk, ptRemote, *pR[i].m_pPk, enc, hmac, cIn);
+
+        cIn.XCrypt(enc, &buf.front(), static_cast<uint32_t>(buf.size()));
+
+        ECC::Hash::Value hvMac;
+        hmac.Write(&buf.front() + hvMac.nBytes, static_cast<uint32_t>(buf.size() - hvMac.nBytes));
+        hmac >> hvMac;
+
+        if (memcmp(hvMac.m_pData, &buf.front(), hvMac.nBytes))
+            return true; // not this one
+
+        uint32_t iExpected = nCount;
+        if (iFound.compare_exchange_strong(iExpected, static_cast<uint32_t>(i)))
+            bufRes.swap(buf);
+        return false;
+    }, 8);
+
+    if (nCount != iFound)
+    {
+        memcpy(p + remotePublic.nBytes, &bufRes.front(), bufRes.size());
+        p += nHdr;
+        n -= nHdr;
+    }
+
+    return iFound;
+}
+
 void Bbs::get_HashPartial(ECC::Hash::Processor& hp, const BbsMsg& msg)
 {
 	hp
@@ -288,6 +354,75 @@ bool Bbs::IsHashValid(const ECC::Hash::Value& hv)
 	return nHigh < (1 << 10); // upper 22 bits should be zero, probability ~ 1 / 4mln
 }
 
+void PackProofUtxoMulti(ProofUtxoMulti& msg, std::vector<std::vector<Input::Proof> >& v)
+{
+	Merkle::Proof vPrev;
+
+	for (size_t i = 0; i < v.size(); i++)
+	{
+		msg.m_Counts.push_back(static_cast<uint32_t>(v[i].size()));
+
+		for (size_t j = 0; j < v[i].size(); j++)
+		{
+			msg.m_Proofs.push_back(std::move(v[i][j]));
+			Merkle::Proof& p = msg.m_Proofs.back().m_Proof;
+
+			size_t nShared = 0;
+			for (size_t n0 = vPrev.size(), n1 = p.size(); (nShared < n0) && (nShared < n1); nShared++)
+			{
+				const Merkle::Node& a = vPrev[n0 - nShared - 1];
+				const Merkle::Node& b = p[n1 - nShared - 1];
+				if ((a.first != b.first) || (a.second != b.second))
+					break;
+			}
+
+			msg.m_Shared.push_back(static_cast<uint32_t>(nShared));
+
+			vPrev.swap(p);
+			p.assign(vPrev.begin(), vPrev.end() - nShared);
+		}
+	}
+}
+
+bool UnpackProofUtxoMulti(std::vector<std::vector<Input::Proof> >& v, ProofUtxoMulti& msg)
+{
+	if (msg.m_Shared.size() != msg.m_Proofs.size())
+		return false;
+
+	v.resize(msg.m_Counts.size());
+
+	const Merkle::Proof* pPrev = NULL;
+	size_t iProof = 0;
+
+	for (size_t i = 0; i < v.size(); i++)
+	{
+		uint32_t nCount = msg.m_Counts[i];
+		if (nCount > msg.m_Proofs.size() - iProof)
+			return false;
+
+		v[i].resize(nCount);
+
+		for (uint32_t j = 0; j < nCount; j++)
+		{
+			Input::Proof& x = v[i][j];
+			x = std::move(msg.m_Proofs[iProof]);
+
+			uint32_t nShared = msg.m_Shared[iProof++];
+			if (nShared)
+			{
+				if (!pPrev || (nShared > pPrev->size()))
+					return false;
+
+				x.m_Proof.insert(x.m_Proof.end(), pPrev->end() - nShared, pPrev->end());
+			}
+
+			pPrev = &x.m_Proof;
+		}
+	}
+
+	return (msg.m_Proofs.size() == iProof);
+}
+
 union HighestMsgCode
 {
 #define THE_MACRO(code, msg) uint8_t m_pBuf_##msg[code + 1];
@@ -334,6 +469,7 @@ void NodeConnection::Reset()
         m_ConnectPending = false;
     }
 
+    DetachInbound();
     m_Connection = NULL;
     m_pAsyncFail = NULL;
 
@@ -505,6 +641,7 @@ void NodeConnection::Accept(io::TcpStream::Ptr&& newStream)
     assert(!m_Connection && !m_ConnectPending);
 
     newStream->enable_keepalive(Rules::get().DA.Target_s); // it should be comparable to the block rate
+    newStream->enable_cork(); // bursts of small messages are sent at once, at the end of the loop iteration
 
     m_Connection = std::make_unique<Connection>(
         m_Protocol,
@@ -520,19 +657,44 @@ bool NodeConnection::IsLive() const
     return m_Connection && !m_pAsyncFail;
 }
 
+struct RawMsgBody
+{
+    const ByteBuffer& m_Body;
+
+    template <typename Archive>
+    void serialize(Archive& ar)
+    {
+        if (!m_Body.empty())
+            ar.write(&m_Body.front(), m_Body.size());
+    }
+};
+
+template <typename T>
+void NodeConnection::SendInternal(uint8_t nCode, const T& v)
+{
+    if (!IsLive())
+        return;
+
+    m_SerializeCache.clear();
+    MsgSerializer& ser = m_Protocol.serializeNoFinalize(m_SerializeCache, nCode, v);
+    m_Protocol.Encrypt(m_SerializeCache, ser);
+    io::Result res = m_Connection->write_msg(m_SerializeCache);
+    m_SerializeCache.clear();
+
+    TestIoResultAsync(res);
+    TestNotDrown();
+}
+
+void NodeConnection::SendRaw(uint8_t nCode, const ByteBuffer& body)
+{
+    RawMsgBody rmb = { body };
+    SendInternal(nCode, rmb);
+}
+
 #define THE_MACRO(code, msg) \
 void NodeConnection::Send(const msg& v) \
 { \
-    if (!IsLive()) \
-        return; \
-    m_SerializeCache.clear(); \
-    MsgSerializer& ser = m_Protocol.serializeNoFinalize(m_SerializeCache, uint8_t(code), v); \
-    m_Protocol.Encrypt(m_SerializeCache, ser); \
-    io::Result res = m_Connection->write_msg(m_SerializeCache); \
-    m_SerializeCache.clear(); \
-\
-    TestIoResultAsync(res); \
-    TestNotDrown(); \
+    SendInternal(uint8_t(code), v); \
 } \
 \
 bool NodeConnection::OnMsgInternal(uint64_t, msg##_NoInit&& v) \
@@ -616,6 +778,11 @@ void NodeConnection::OnMsg(SChannelReady&& msg)
         ThrowUnexpected();
 
     m_Protocol.m_Mode = ProtocolPlus::Mode::Duplex;
+
+    // The input cipher won't change anymore, the rest of the inbound traffic can be decoded elsewhere.
+    // The remaining of the current chunk is still handled here, the Inbound is created on the next one.
+    if (m_pIoPool && m_pIoPool->IsEnabled())
+        m_Connection->divert_read([this](io::ErrorCode err, void* p, size_t n) { return OnInboundRaw(err, p, n); });
 }
 
 void NodeConnection::ProveID(ECC::Scalar::Native& sk, uint8_t nIDType)
@@ -820,6 +987,245 @@ void NodeConnection::VerifyCfg(const Login& msg)
 	}
 }
 
+/////////////////////////
+// NodeConnection::Inbound
+struct NodeConnection::Inbound
+    :public IErrorHandler
+    ,public std::enable_shared_from_this<Inbound>
+{
+    // reactor thread only
+    NodeConnection* m_pThis;
+    size_t m_Pending = 0;
+    bool m_Paused = false;
+
+    // I/O thread only
+    ProtocolPlus m_Protocol;
+    MsgReader m_Reader;
+    bool m_Failed = false;
+
+    TX<IoPool::Chunk> m_TxIn;
+    TX<IoPool::Item::Ptr> m_TxOut;
+
+    Inbound(NodeConnection&, IoPool&);
+
+    void OnChunk(IoPool::Chunk&);
+    void Post(IoPool::Item*);
+
+    // IErrorHandler
+    virtual void on_protocol_error(uint64_t, ProtocolError error) override;
+    virtual void on_connection_error(uint64_t, io::ErrorCode errorCode) override;
+
+#define THE_MACRO(code, msg) bool OnMsgInternal(uint64_t, msg##_NoInit&& v);
+    BeamNodeMsgsAll(THE_MACRO)
+#undef THE_MACRO
+};
+
+template <typename TMsg>
+struct NodeConnection::IoPool::ItemMsg
+    :public Item
+{
+    TMsg m_Msg;
+    ItemMsg(TMsg&& v) :m_Msg(std::move(v)) {}
+
+    virtual bool Dispatch(NodeConnection& x) override
+    {
+        return x.OnMsgInternal(0, std::move(m_Msg));
+    }
+};
+
+struct NodeConnection::IoPool::ItemProtoErr
+    :public Item
+{
+    ProtocolError m_Err;
+
+    virtual bool Dispatch(NodeConnection& x) override
+    {
+        x.on_protocol_error(0, m_Err);
+        return false;
+    }
+};
+
+struct NodeConnection::IoPool::ItemIoErr
+    :public Item
+{
+    io::ErrorCode m_Err;
+
+    virtual bool Dispatch(NodeConnection& x) override
+    {
+        x.on_connection_error(0, m_Err);
+        return false;
+    }
+};
+
+NodeConnection::Inbound::Inbound(NodeConnection& x, IoPool& pool)
+    :m_pThis(&x)
+    ,m_Protocol('B', 'm', 10, sizeof(HighestMsgCode), *this, 1024)
+    ,m_Reader(m_Protocol, 0, 100)
+    ,m_TxIn(pool.m_vThreads[pool.m_iNext++ % pool.m_vThreads.size()].m_pRx->get_tx())
+    ,m_TxOut(pool.m_pRx->get_tx())
+{
+#define THE_MACRO(code, msg) \
+    m_Protocol.add_message_handler<Inbound, msg##_NoInit, &Inbound::OnMsgInternal>(uint8_t(code), this, 0, 1024*1024*10);
+
+    BeamNodeMsgsAll(THE_MACRO)
+#undef THE_MACRO
+
+    // take over the input cipher, and the partially received message (if any)
+    assert(ProtocolPlus::Mode::Duplex == x.m_Protocol.m_Mode);
+    m_Protocol.m_Mode = x.m_Protocol.m_Mode;
+    m_Protocol.m_Enc = x.m_Protocol.m_Enc;
+    m_Protocol.m_CipherIn = x.m_Protocol.m_CipherIn;
+    m_Protocol.m_HMac = x.m_Protocol.m_HMac;
+
+    m_Reader.take_state(x.m_Connection->get_reader());
+}
+
+void NodeConnection::Inbound::OnChunk(IoPool::Chunk& c)
+{
+    if (!m_Failed)
+    {
+        const void* p = c.m_Data.empty() ? NULL : &c.m_Data.front();
+        if (!m_Reader.new_data_from_stream(c.m_Err, p, c.m_Data.size()))
+            m_Failed = true;
+    }
+
+    // acknowledge the chunk, even if it's ignored
+    IoPool::Item* pItem = new IoPool::Item;
+    pItem->m_Size = static_cast<uint32_t>(c.m_Data.size());
+    Post(pItem);
+}
+
+void NodeConnection::Inbound::Post(IoPool::Item* pItem)
+{
+    IoPool::Item::Ptr p(pItem);
+    p->m_pInbound = shared_from_this();
+    m_TxOut.send(std::move(p));
+}
+
+void NodeConnection::Inbound::on_protocol_error(uint64_t, ProtocolError error)
+{
+    m_Failed = true;
+
+    IoPool::ItemProtoErr* pItem = new IoPool::ItemProtoErr;
+    pItem->m_Err = error;
+    Post(pItem);
+}
+
+void NodeConnection::Inbound::on_connection_error(uint64_t, io::ErrorCode errorCode)
+{
+    m_Failed = true;
+
+    IoPool::ItemIoErr* pItem = new IoPool::ItemIoErr;
+    pItem->m_Err = errorCode;
+    Post(pItem);
+}
+
+#define THE_MACRO(code, msg) \
+bool NodeConnection::Inbound::OnMsgInternal(uint64_t, msg##_NoInit&& v) \
+{ \
+    Post(new IoPool::ItemMsg<msg##_NoInit>(std::move(v))); \
+    return true; \
+}
+
+BeamNodeMsgsAll(THE_MACRO)
+#undef THE_MACRO
+
+bool NodeConnection::OnInboundRaw(io::ErrorCode err, void* p, size_t n)
+{
+    assert(m_pIoPool && m_Connection);
+
+    if (!m_pInbound)
+        m_pInbound = std::make_shared<Inbound>(*this, *m_pIoPool);
+
+    IoPool::Chunk c;
+    c.m_pInbound = m_pInbound;
+    c.m_Err = err;
+    if (n)
+    {
+        c.m_Data.resize(n);
+        memcpy(&c.m_Data.front(), p, n);
+    }
+
+    m_pInbound->m_Pending += n;
+    m_pInbound->m_TxIn.send(std::move(c));
+
+    if (!m_pInbound->m_Paused && (m_pInbound->m_Pending > m_pIoPool->m_MaxPending))
+    {
+        m_pInbound->m_Paused = true;
+        m_Connection->pause_read();
+    }
+
+    return true;
+}
+
+void NodeConnection::DetachInbound()
+{
+    if (m_pInbound)
+    {
+        m_pInbound->m_pThis = NULL; // pending items would be ignored
+        m_pInbound.reset();
+    }
+}
+
+/////////////////////////
+// NodeConnection::IoPool
+void NodeConnection::IoPool::Start(uint32_t nThreads)
+{
+    assert(!IsEnabled() && nThreads);
+
+    m_pRx = std::make_unique<RX<Item::Ptr> >(io::Reactor::get_Current(), [this](Item::Ptr&& p) { OnItem(std::move(p)); });
+
+    m_vThreads.resize(nThreads);
+    for (uint32_t i = 0; i < nThreads; i++)
+    {
+        Thread& t = m_vThreads[i];
+        t.m_pReactor = io::Reactor::create();
+        t.m_pRx = std::make_unique<RX<Chunk> >(*t.m_pReactor, [](Chunk&& c) {
+            Chunk cOwned(std::move(c)); // don't keep it in the queue
+            cOwned.m_pInbound->OnChunk(cOwned);
+        });
+        t.m_Thread = std::thread(&io::Reactor::run, t.m_pReactor);
+    }
+}
+
+void NodeConnection::IoPool::Stop()
+{
+    for (size_t i = 0; i < m_vThreads.size(); i++)
+    {
+        Thread& t = m_vThreads[i];
+        t.m_pReactor->stop();
+        if (t.m_Thread.joinable())
+            t.m_Thread.join();
+
+        t.m_pRx.reset(); // before the reactor
+    }
+
+    m_vThreads.clear();
+    m_pRx.reset();
+}
+
+void NodeConnection::IoPool::OnItem(Item::Ptr&& pItem)
+{
+    Item::Ptr p(std::move(pItem)); // don't keep it in the queue
+    Inbound& x = *p->m_pInbound;
+
+    assert(x.m_Pending >= p->m_Size);
+    x.m_Pending -= p->m_Size;
+
+    if (!x.m_pThis)
+        return; // detached
+
+    NodeConnection& nc = *x.m_pThis;
+
+    if (x.m_Paused && (x.m_Pending <= (m_MaxPending >> 1)) && nc.m_Connection)
+    {
+        x.m_Paused = false;
+        nc.m_Connection->resume_read();
+    }
+
+    p->Dispatch(nc); // may delete the connection
+}
+
 /////////////////////////
 // NodeConnection::Server
 void NodeConnection::Server::Listen(const io::Address& addr)
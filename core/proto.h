@@ -23,6 +23,7 @@
 #include "../utility/io/timer.h"
 #include "aes.h"
 #include "block_crypt.h"
+#include <thread>
 
 namespace beam {
 namespace proto {
@@ -73,6 +74,9 @@ namespace proto {
     macro(ECC::Point, Utxo) \
     macro(Height, MaturityMin) /* set to non-zero in case the result is too big, and should be retrieved within multiple queries */
 
+#define BeamNodeMsg_GetProofUtxoMulti(macro) \
+    macro(std::vector<ECC::Point>, Utxos) /* sorted, up to g_ProofUtxoMultiMaxSize, each is answered as GetProofUtxo with zero MaturityMin */
+
 #define BeamNodeMsg_GetProofChainWork(macro) \
     macro(Difficulty::Raw, LowerBound)
 
@@ -87,6 +91,11 @@ namespace proto {
 #define BeamNodeMsg_ProofUtxo(macro) \
     macro(std::vector<Input::Proof>, Proofs)
 
+#define BeamNodeMsg_ProofUtxoMulti(macro) \
+    macro(std::vector<uint32_t>, Counts) /* number of proofs per commitment, in the order of the request */ \
+    macro(std::vector<Input::Proof>, Proofs) \
+    macro(std::vector<uint32_t>, Shared) /* per proof, the number of the omitted top nodes, same as in the previous proof */
+
 #define BeamNodeMsg_ProofState(macro) \
     macro(Merkle::HardProof, Proof)
 
@@ -236,6 +245,8 @@ namespace proto {
     macro(0x23, ProofCommonState) \
     macro(0x24, GetProofKernel2) \
     macro(0x25, ProofKernel2) \
+    macro(0x26, GetProofUtxoMulti) \
+    macro(0x27, ProofUtxoMulti) \
     /* onwer-relevant */ \
     macro(0x2c, GetUtxoEvents) \
     macro(0x2d, UtxoEvents) \
@@ -262,7 +273,9 @@ namespace proto {
         static const uint8_t SendPeers              = 0x4; // Please send me periodically peers recommendations
         static const uint8_t MiningFinalization     = 0x8; // I want to finalize block construction for my owned node
         static const uint8_t Extension1             = 0x10; // Supports Bbs with POW, more advanced proof/disproof scheme for SPV clients (?)
-	    static const uint8_t Recognized             = 0x1f;
+        static const uint8_t Extension2             = 0x20; // Supports GetProofUtxoMulti
+        static const uint8_t Extension3             = 0x40; // Supports the macroblocks with the compressed output blocks
+	    static const uint8_t Recognized             = 0x7f;
     };
 
     struct IDType
@@ -273,6 +286,7 @@ namespace proto {
     };
 
     static const uint32_t g_HdrPackMaxSize = 128;
+    static const uint32_t g_ProofUtxoMultiMaxSize = 256;
 
     struct UtxoEvent
     {
@@ -347,6 +361,17 @@ namespace proto {
 
 		bool Encrypt(ByteBuffer& res, const PeerID& publicAddr, ECC::Scalar::Native& nonce, const void*, uint32_t); // will fail iff addr is invalid
 		bool Decrypt(uint8_t*& p, uint32_t& n, const ECC::Scalar::Native& privateAddr);
+
+		struct Recipient
+		{
+			const ECC::Scalar::Native* m_pSk; // normalized
+			const PeerID* m_pPk;
+		};
+
+		// Same as Decrypt, tried against several addresses. The sender key is imported once, no public key derivation per attempt,
+		// and the buffer is modified only on success. Many addresses are tried in parallel.
+		// Returns the index of the matching recipient, or nCount if none.
+		uint32_t DecryptMulti(uint8_t*& p, uint32_t& n, const Recipient*, uint32_t nCount);
 	};
 
 
@@ -385,6 +410,10 @@ namespace proto {
 		bool IsHashValid(const ECC::Hash::Value&);
 	}
 
+	// The proofs for the sorted commitments share the path towards the root (and the history hash), only the differing part is sent
+	void PackProofUtxoMulti(ProofUtxoMulti&, std::vector<std::vector<Input::Proof> >&); // the proofs are moved
+	bool UnpackProofUtxoMulti(std::vector<std::vector<Input::Proof> >&, ProofUtxoMulti&); // fails if malformed
+
     struct ProtocolPlus
         :public Protocol
     {
@@ -463,13 +492,25 @@ namespace proto {
     class NodeConnection
         :public INodeMsgHandler
     {
+    public:
+        struct IoPool;
+    private:
+        struct Inbound;
+
         ProtocolPlus m_Protocol;
         std::unique_ptr<Connection> m_Connection;
         io::AsyncEvent::Ptr m_pAsyncFail;
         bool m_ConnectPending;
 
+        std::shared_ptr<Inbound> m_pInbound; // set once the inbound traffic is diverted to the IoPool
+        bool OnInboundRaw(io::ErrorCode, void*, size_t);
+        void DetachInbound();
+
         SerializedMsg m_SerializeCache;
 
+        template <typename T>
+        void SendInternal(uint8_t nCode, const T&);
+
         void TestIoResultAsync(const io::Result& res);
         void TestInputMsgContext(uint8_t);
 
@@ -577,6 +618,9 @@ namespace proto {
         BeamNodeMsgsAll(THE_MACRO)
 #undef THE_MACRO
 
+        // the message body serialized in advance (by Serializer). Saves the re-serialization of the same big message sent to many peers
+        void SendRaw(uint8_t nCode, const ByteBuffer& body);
+
         struct Server
         {
             io::TcpServer::Ptr m_pServer; // just delete it to stop listening
@@ -584,6 +628,57 @@ namespace proto {
 
             virtual void OnAccepted(io::TcpStream::Ptr&&, int errorCode) = 0;
         };
+
+        // I/O threads for the inbound traffic. Once the secure channel is established, the raw data is decrypted, verified
+        // and deserialized there, and the decoded messages are dispatched in order on the reactor thread.
+        struct IoPool
+        {
+            struct Item
+            {
+                typedef std::unique_ptr<Item> Ptr;
+
+                std::shared_ptr<Inbound> m_pInbound;
+                uint32_t m_Size = 0; // raw bytes acknowledged by this item
+
+                virtual ~Item() {}
+                virtual bool Dispatch(NodeConnection&) { return true; }
+            };
+
+            template <typename TMsg> struct ItemMsg;
+            struct ItemProtoErr;
+            struct ItemIoErr;
+
+            struct Chunk
+            {
+                std::shared_ptr<Inbound> m_pInbound;
+                ByteBuffer m_Data;
+                io::ErrorCode m_Err = io::EC_OK;
+            };
+
+            struct Thread
+            {
+                io::Reactor::Ptr m_pReactor;
+                std::unique_ptr<RX<Chunk> > m_pRx;
+                std::thread m_Thread;
+            };
+
+            std::vector<Thread> m_vThreads;
+            std::unique_ptr<RX<Item::Ptr> > m_pRx; // on the reactor thread
+            uint32_t m_iNext = 0;
+
+            size_t m_MaxPending = 1024 * 1024 * 16; // per connection. Reading from the socket is paused above it
+
+            bool IsEnabled() const { return !m_vThreads.empty(); }
+
+            void Start(uint32_t nThreads); // must be called on the reactor thread
+            void Stop();
+            ~IoPool() { Stop(); }
+
+        private:
+            void OnItem(Item::Ptr&&);
+        };
+
+        IoPool* m_pIoPool = nullptr; // optional. Must outlive the connection
     };
 
     std::ostream& operator << (std::ostream& s, const NodeConnection::DisconnectReason&);
@@ -433,13 +433,7 @@ namespace detail
         template<typename Archive>
         static Archive& save(Archive& ar, const beam::Output& output)
         {
-			uint8_t nFlags =
-				(output.m_Commitment.m_Y ? 1 : 0) |
-				(output.m_Coinbase ? 2 : 0) |
-				(output.m_pConfidential ? 4 : 0) |
-				(output.m_pPublic ? 8 : 0) |
-				(output.m_Incubation ? 0x10 : 0) |
-				((output.m_AssetID == beam::Zero) ? 0 : 0x20);
+			uint8_t nFlags = output.get_Flags();
 
 			ar
 				& nFlags
@@ -454,7 +448,7 @@ namespace detail
 			if (output.m_Incubation)
 				ar & output.m_Incubation;
 
-			if (0x20 & nFlags)
+			if (beam::Output::Flags::Asset & nFlags)
 				ar & output.m_AssetID;
 
             return ar;
@@ -468,28 +462,19 @@ namespace detail
 				& nFlags
 				& output.m_Commitment.m_X;
 
-			output.m_Commitment.m_Y = (1 & nFlags);
-			output.m_Coinbase = 0 != (2 & nFlags);
+			output.set_Flags(nFlags);
 
-			if (4 & nFlags)
-			{
-				output.m_pConfidential = std::make_unique<ECC::RangeProof::Confidential>();
+			if (beam::Output::Flags::Confidential & nFlags)
 				ar & *output.m_pConfidential;
-			}
 
-			if (8 & nFlags)
-			{
-				output.m_pPublic = std::make_unique<ECC::RangeProof::Public>();
+			if (beam::Output::Flags::Public & nFlags)
 				ar & *output.m_pPublic;
-			}
 
-			if (0x10 & nFlags)
+			if (beam::Output::Flags::Incubation & nFlags)
 				ar & output.m_Incubation;
 
-			if (0x20 & nFlags)
+			if (beam::Output::Flags::Asset & nFlags)
 				ar & output.m_AssetID;
-			else
-				output.m_AssetID = beam::Zero;
 
             return ar;
         }
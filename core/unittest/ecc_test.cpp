@@ -1124,6 +1124,34 @@ void TestBbs()
 	n = (uint32_t) buf.size();
 
 	verify_test(!beam::proto::Bbs::Decrypt(p, n, privateAddr));
+
+	// several addresses, enough to go parallel
+	const uint32_t nAddrs = 50, iMy = 37;
+	Scalar::Native pSk[nAddrs];
+	beam::PeerID pPk[nAddrs];
+	beam::proto::Bbs::Recipient pR[nAddrs];
+
+	for (uint32_t i = 0; i < nAddrs; i++)
+	{
+		SetRandom(pSk[i]);
+		beam::proto::Sk2Pk(pPk[i], pSk[i]);
+		pR[i].m_pSk = pSk + i;
+		pR[i].m_pPk = pPk + i;
+	}
+
+	SetRandom(nonce);
+	verify_test(beam::proto::Bbs::Encrypt(buf, pPk[iMy], nonce, szMsg, sizeof(szMsg)));
+	beam::ByteBuffer buf2 = buf;
+
+	p = &buf.at(0);
+	n = (uint32_t) buf.size();
+
+	verify_test(beam::proto::Bbs::DecryptMulti(p, n, pR, iMy) == iMy); // not among them
+	verify_test((p == &buf.at(0)) && (buf == buf2));
+
+	verify_test(beam::proto::Bbs::DecryptMulti(p, n, pR, nAddrs) == iMy);
+	verify_test(n == sizeof(szMsg));
+	verify_test(!memcmp(p, szMsg, n));
 }
 
 void TestRatio(const beam::Difficulty& d0, const beam::Difficulty& d1, double k)
@@ -13,6 +13,11 @@
 // limitations under the License.
 
 #include "db.h"
+#include "core/navigator.h"
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 namespace beam {
 
@@ -124,8 +129,83 @@ void NodeDB::Statement::Close()
 	}
 }
 
+struct NodeDB::Checkpointer
+{
+	sqlite3* m_pDb = NULL;
+	std::thread m_Thread;
+	std::mutex m_Mutex;
+	std::condition_variable m_cvRequest;
+	std::condition_variable m_cvDone;
+	uint32_t m_nPending = 0; // commits since the last checkpoint has started
+	bool m_bStop = false;
+
+	~Checkpointer()
+	{
+		if (m_Thread.joinable())
+		{
+			{
+				std::unique_lock<std::mutex> scope(m_Mutex);
+				m_bStop = true;
+				m_cvRequest.notify_one();
+			}
+			m_Thread.join();
+		}
+
+		if (m_pDb)
+			sqlite3_close(m_pDb);
+	}
+
+	void Start(NodeDB& db, const char* szPath)
+	{
+		db.TestRet(sqlite3_open_v2(szPath, &m_pDb, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, NULL));
+		sqlite3_busy_timeout(m_pDb, 5000);
+		m_Thread = std::thread(&Checkpointer::RunThread, this);
+	}
+
+	void RunThread()
+	{
+		std::unique_lock<std::mutex> scope(m_Mutex);
+
+		while (true)
+		{
+			if (!m_nPending)
+			{
+				if (m_bStop)
+					break;
+				m_cvRequest.wait(scope);
+				continue;
+			}
+
+			uint32_t n = m_nPending;
+			scope.unlock();
+
+			// passive: doesn't interfere with the writer. Failures are ok, the frames will be checkpointed next time
+			int nLog = 0, nCkpt = 0;
+			sqlite3_wal_checkpoint_v2(m_pDb, NULL, SQLITE_CHECKPOINT_PASSIVE, &nLog, &nCkpt);
+
+			scope.lock();
+			m_nPending -= n;
+			m_cvDone.notify_all();
+		}
+	}
+
+	void OnCommitted(uint32_t nMaxPending)
+	{
+		std::unique_lock<std::mutex> scope(m_Mutex);
+
+		m_nPending++;
+		m_cvRequest.notify_one();
+
+		while (m_nPending > nMaxPending)
+			m_cvDone.wait(scope);
+	}
+};
+
 void NodeDB::Close()
 {
+	m_pCheckpointer.reset(); // before the main connection, so that it does the final checkpoint
+	m_pStatesMmr.reset();
+
 	if (m_pDb)
 	{
 		for (size_t i = 0; i < _countof(m_pPrep); i++)
@@ -138,12 +218,14 @@ void NodeDB::Close()
 
 NodeDB::Recordset::Recordset(NodeDB& db)
 	:m_pStmt(NULL)
+	,m_nBytesBound(0)
 	,m_DB(db)
 {
 }
 
 NodeDB::Recordset::Recordset(NodeDB& db, Query::Enum val, const char* sql)
 	:m_pStmt(NULL)
+	,m_nBytesBound(0)
 	,m_DB(db)
 {
 	m_pStmt = m_DB.get_Statement(val, sql);
@@ -161,6 +243,8 @@ void NodeDB::Recordset::Reset()
 		sqlite3_reset(m_pStmt); // don't care about retval
 		sqlite3_clear_bindings(m_pStmt);
 	}
+
+	m_nBytesBound = 0;
 }
 
 void NodeDB::Recordset::Reset(Query::Enum val, const char* sql)
@@ -171,7 +255,16 @@ void NodeDB::Recordset::Reset(Query::Enum val, const char* sql)
 
 bool NodeDB::Recordset::Step()
 {
-	return m_DB.ExecStep(m_pStmt);
+	bool bRet = m_DB.ExecStep(m_pStmt);
+
+	if (m_nBytesBound)
+	{
+		if (!sqlite3_stmt_readonly(m_pStmt))
+			m_DB.m_Stats.m_BytesDirty += m_nBytesBound;
+		m_nBytesBound = 0;
+	}
+
+	return bRet;
 }
 
 void NodeDB::Recordset::StepStrict()
@@ -193,21 +286,25 @@ void NodeDB::Recordset::putNull(int col)
 void NodeDB::Recordset::put(int col, uint32_t x)
 {
 	m_DB.TestRet(sqlite3_bind_int(m_pStmt, col+1, x));
+	m_nBytesBound += sizeof(x);
 }
 
 void NodeDB::Recordset::put(int col, uint64_t x)
 {
 	m_DB.TestRet(sqlite3_bind_int64(m_pStmt, col+1, x));
+	m_nBytesBound += sizeof(x);
 }
 
 void NodeDB::Recordset::put(int col, const Blob& x)
 {
 	m_DB.TestRet(sqlite3_bind_blob(m_pStmt, col+1, x.p, x.n, NULL));
+	m_nBytesBound += x.n;
 }
 
 void NodeDB::Recordset::put(int col, const char* sz)
 {
 	m_DB.TestRet(sqlite3_bind_text(m_pStmt, col+1, sz, -1, NULL));
+	m_nBytesBound += static_cast<uint32_t>(strlen(sz));
 }
 
 void NodeDB::Recordset::get(int col, uint32_t& x)
@@ -258,7 +355,9 @@ void NodeDB::Open(const char* szPath)
 	if (s != "ok")
 		ThrowError(("sqlite integrity: " + s).c_str());
 
-	ExecTextOut("PRAGMA locking_mode = EXCLUSIVE");
+	bool bCheckpointThread = m_Tuning.m_Wal && m_Tuning.m_CheckpointThread;
+	if (!bCheckpointThread)
+		ExecTextOut("PRAGMA locking_mode = EXCLUSIVE");
 
 	bool bCreate;
 	{
@@ -267,6 +366,8 @@ void NodeDB::Open(const char* szPath)
 		bCreate = !rs.Step();
 	}
 
+	ApplyTuning(bCreate);
+
 	const uint64_t nVersionTop = 15;
 	const uint64_t nVersionNoBbsPoW = 14;
 
@@ -298,6 +399,50 @@ void NodeDB::Open(const char* szPath)
 	}
 
 	t.Commit();
+
+	OpenStatesMmr(szPath);
+
+	if (bCheckpointThread)
+	{
+		ExecQuick("PRAGMA wal_autocheckpoint = 0");
+
+		m_pCheckpointer.reset(new Checkpointer);
+		m_pCheckpointer->Start(*this, szPath);
+	}
+}
+
+void NodeDB::ApplyTuning(bool bCreate)
+{
+	char sz[0x80];
+
+	if (bCreate && m_Tuning.m_PageSize)
+	{
+		// must precede the tables creation, and the WAL mode
+		snprintf(sz, _countof(sz), "PRAGMA page_size = %u", m_Tuning.m_PageSize);
+		ExecQuick(sz);
+	}
+
+	bool bWal = (ExecTextOut("PRAGMA journal_mode") == "wal");
+	if (bWal != m_Tuning.m_Wal)
+		ExecTextOut(m_Tuning.m_Wal ? "PRAGMA journal_mode = WAL" : "PRAGMA journal_mode = DELETE");
+
+	if (m_Tuning.m_Synchronous >= 0)
+	{
+		snprintf(sz, _countof(sz), "PRAGMA synchronous = %d", m_Tuning.m_Synchronous);
+		ExecQuick(sz);
+	}
+
+	if (m_Tuning.m_CacheSize)
+	{
+		snprintf(sz, _countof(sz), "PRAGMA cache_size = %d", m_Tuning.m_CacheSize);
+		ExecQuick(sz);
+	}
+
+	if (m_Tuning.m_MmapSize)
+	{
+		snprintf(sz, _countof(sz), "PRAGMA mmap_size = %llu", static_cast<unsigned long long>(m_Tuning.m_MmapSize));
+		ExecQuick(sz);
+	}
 }
 
 void NodeDB::Create()
@@ -495,6 +640,24 @@ void NodeDB::TestChanged1Row()
 		ThrowError("1row change failed");
 }
 
+void NodeDB::TestChangedRows(uint32_t n)
+{
+	if (static_cast<int>(n) != get_RowsChanged())
+		ThrowError("multi-row change failed");
+}
+
+std::string NodeDB::get_InsBatchSql(const char* szPrefix, const char* szRow)
+{
+	std::string s = szPrefix;
+	for (uint32_t i = 0; i < s_InsBatch; i++)
+	{
+		if (i)
+			s += ',';
+		s += szRow;
+	}
+	return s;
+}
+
 void NodeDB::ParamSet(uint32_t ID, const uint64_t* p0, const Blob* p1)
 {
 	Recordset rs(*this, Query::ParamUpd, "UPDATE " TblParams " SET " TblParams_Int "=?," TblParams_Blob "=? WHERE " TblParams_ID "=?");
@@ -579,7 +742,26 @@ void NodeDB::Transaction::Start(NodeDB& db)
 void NodeDB::Transaction::Commit()
 {
 	assert(m_pDB);
+
+	auto t0 = std::chrono::steady_clock::now();
 	m_pDB->ExecStep(Query::Commit, "COMMIT");
+	uint64_t dt_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+
+	Stats& s = m_pDB->m_Stats;
+
+	if (m_pDB->m_pCheckpointer)
+	{
+		auto t1 = std::chrono::steady_clock::now();
+		m_pDB->m_pCheckpointer->OnCommitted(m_pDB->m_Tuning.m_CheckpointMaxPending);
+		s.m_CommitWait_us += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t1).count();
+	}
+
+	s.m_BytesDirty = 0;
+	s.m_Commits++;
+	s.m_CommitLast_us = dt_us;
+	s.m_CommitTotal_us += dt_us;
+	s.m_CommitMax_us = std::max(s.m_CommitMax_us, dt_us);
+
 	m_pDB = NULL;
 }
 
@@ -588,6 +770,7 @@ void NodeDB::Transaction::Rollback()
 	if (m_pDB)
 	{
 		m_pDB->ExecStep(Query::Rollback, "ROLLBACK");
+		m_pDB->m_Stats.m_BytesDirty = 0;
 		m_pDB = nullptr;
 	}
 }
@@ -1370,8 +1553,88 @@ void NodeDB::StateID::SetNull()
 	m_Height = Rules::HeightGenesis - 1;
 }
 
+struct NodeDB::StatesMmr
+	:public Merkle::Mmr
+{
+	MappedFile m_Mapping;
+	MappedFile::Offset m_Offset0; // of the 1st node
+
+	struct Hdr
+	{
+		uint64_t m_Count; // of all the active states. Mmr::m_Count is set for the specific state
+	};
+
+	Hdr& get_Hdr() const { return *static_cast<Hdr*>(m_Mapping.get_FixedHdr()); }
+
+	void Open(const char*);
+	void AppendTotal(const Merkle::Hash&);
+
+	static uint64_t get_Nodes(uint64_t nCount);
+	static uint64_t get_Idx(const Merkle::Position&);
+
+	// Mmr
+	virtual void LoadElement(Merkle::Hash&, const Merkle::Position&) const override;
+	virtual void SaveElement(const Merkle::Hash&, const Merkle::Position&) override;
+};
+
+void NodeDB::StatesMmr::Open(const char* sz)
+{
+	static const char s_szSig[] = "BeamStatesMmr.1";
+
+	MappedFile::Defs d;
+	d.m_pSig = reinterpret_cast<const uint8_t*>(s_szSig);
+	d.m_nSizeSig = sizeof(s_szSig);
+	d.m_nBanks = 0;
+	d.m_nFixedHdr = sizeof(Hdr);
+
+	m_Mapping.Open(sz, d);
+	m_Offset0 = m_Mapping.get_Offset(m_Mapping.get_FixedHdr()) + sizeof(Hdr);
+}
+
+uint64_t NodeDB::StatesMmr::get_Nodes(uint64_t n)
+{
+	// each element adds a leaf and the parents that it completes
+	uint64_t nRet = n << 1;
+	for (; n; n &= n - 1)
+		nRet--;
+	return nRet;
+}
+
+uint64_t NodeDB::StatesMmr::get_Idx(const Merkle::Position& pos)
+{
+	// the node is saved right after the last leaf that it covers, and its children
+	uint64_t nLeaf = ((pos.X + 1) << pos.H) - 1;
+	return get_Nodes(nLeaf) + pos.H;
+}
+
+void NodeDB::StatesMmr::LoadElement(Merkle::Hash& hv, const Merkle::Position& pos) const
+{
+	hv = m_Mapping.get_At<Merkle::Hash>(m_Offset0 + get_Idx(pos) * sizeof(Merkle::Hash));
+}
+
+void NodeDB::StatesMmr::SaveElement(const Merkle::Hash& hv, const Merkle::Position& pos)
+{
+	MappedFile::Offset n = m_Offset0 + get_Idx(pos) * sizeof(Merkle::Hash);
+	m_Mapping.EnsureSize(n + sizeof(Merkle::Hash));
+	m_Mapping.get_At<Merkle::Hash>(n) = hv;
+}
+
+void NodeDB::StatesMmr::AppendTotal(const Merkle::Hash& hv)
+{
+	m_Count = get_Hdr().m_Count;
+	Append(hv);
+	get_Hdr().m_Count = m_Count; // the mapping may have moved
+}
+
 void NodeDB::MoveBack(StateID& sid)
 {
+	if (m_pStatesMmr)
+	{
+		// the state is removed from the active chain
+		uint64_t& nCount = m_pStatesMmr->get_Hdr().m_Count;
+		nCount = std::min(nCount, sid.m_Height - Rules::HeightGenesis);
+	}
+
 	Recordset rs(*this, Query::Unactivate, "UPDATE " TblStates " SET " TblStates_Flags "=" TblStates_Flags " & ? WHERE rowid=?");
 	rs.put(0, ~uint32_t(StateFlags::Active));
 	rs.put(1, sid.m_Row);
@@ -1393,6 +1656,22 @@ void NodeDB::MoveFwd(const StateID& sid)
 	TestChanged1Row();
 
 	put_Cursor(sid);
+
+	if (m_pStatesMmr)
+	{
+		StatesMmr& x = *m_pStatesMmr;
+		uint64_t n = sid.m_Height - Rules::HeightGenesis;
+
+		if (x.get_Hdr().m_Count >= n)
+		{
+			x.get_Hdr().m_Count = n;
+
+			Merkle::Hash hv;
+			get_StateHash(sid.m_Row, hv);
+			x.AppendTotal(hv);
+		}
+		// otherwise it's not in sync, will be rebuilt on the next start
+	}
 }
 
 struct NodeDB::Dmmr
@@ -1495,10 +1774,86 @@ void NodeDB::BuildMmr(uint64_t rowid, uint64_t rowPrev, Height h)
 	TestChanged1Row();
 }
 
+void NodeDB::OpenStatesMmr(const char* szPath)
+{
+	m_pStatesMmr.reset(new StatesMmr);
+	m_pStatesMmr->Open((std::string(szPath) + ".mmr").c_str());
+
+	StatesMmr& x = *m_pStatesMmr;
+
+	StateID sid;
+	get_Cursor(sid);
+	uint64_t n = sid.m_Height - Rules::HeightGenesis + 1;
+
+	if (x.get_Hdr().m_Count > n)
+		x.get_Hdr().m_Count = n;
+
+	if ((x.get_Hdr().m_Count < n) || (n && !get_StatesMmr(sid)))
+		RebuildStatesMmr();
+}
+
+void NodeDB::RebuildStatesMmr()
+{
+	StatesMmr& x = *m_pStatesMmr;
+	x.get_Hdr().m_Count = 0;
+
+	StateID sid;
+	if (!get_Cursor(sid))
+		return;
+
+	std::vector<Merkle::Hash> v;
+	v.reserve(static_cast<size_t>(sid.m_Height - Rules::HeightGenesis + 1));
+
+	do
+	{
+		v.emplace_back();
+		get_StateHash(sid.m_Row, v.back());
+	} while (get_Prev(sid));
+
+	if (Rules::HeightGenesis != sid.m_Height)
+		return; // the chain doesn't go down to the genesis, the Dmmr will be used
+
+	for (size_t i = v.size(); i--; )
+		x.AppendTotal(v[i]);
+}
+
+NodeDB::StatesMmr* NodeDB::get_StatesMmr(const StateID& sid)
+{
+	if (!m_pStatesMmr)
+		return NULL;
+
+	StatesMmr& x = *m_pStatesMmr;
+
+	// make sure the state is indeed in it. Since each state references the previous one, the whole chain below it matches too.
+	Merkle::Position pos;
+	pos.H = 0;
+	pos.X = sid.m_Height - Rules::HeightGenesis;
+
+	if (pos.X >= x.get_Hdr().m_Count)
+		return NULL;
+
+	Merkle::Hash hv, hvMmr;
+	get_StateHash(sid.m_Row, hv);
+	x.LoadElement(hvMmr, pos);
+
+	if (hv != hvMmr)
+		return NULL;
+
+	x.m_Count = pos.X; // only the states below it
+	return &x;
+}
+
 void NodeDB::get_Proof(Merkle::IProofBuilder& bld, const StateID& sid, Height hPrev)
 {
 	assert((hPrev >= Rules::HeightGenesis) && (hPrev < sid.m_Height));
 
+	StatesMmr* pMmr = get_StatesMmr(sid);
+	if (pMmr)
+	{
+		pMmr->get_Proof(bld, hPrev - Rules::HeightGenesis);
+		return;
+	}
+
     Dmmr dmmr(*this);
     dmmr.m_Count = sid.m_Height - Rules::HeightGenesis;
     dmmr.m_kLast = sid.m_Row;
@@ -1510,6 +1865,13 @@ void NodeDB::get_PredictedStatesHash(Merkle::Hash& hv, const StateID& sid)
 {
 	get_StateHash(sid.m_Row, hv);
 
+	StatesMmr* pMmr = get_StatesMmr(sid);
+	if (pMmr)
+	{
+		pMmr->get_PredictedHash(hv, hv);
+		return;
+	}
+
     Dmmr dmmr(*this);
     dmmr.m_Count = sid.m_Height - Rules::HeightGenesis;
     dmmr.m_kLast = sid.m_Row;
@@ -1528,6 +1890,34 @@ void NodeDB::InsertEvent(Height h, const Blob& b, const Blob& key)
 	TestChanged1Row();
 }
 
+void NodeDB::InsertEvents(const EventData* p, uint32_t nCount)
+{
+	if (nCount >= s_InsBatch)
+	{
+		static const std::string s_Sql = get_InsBatchSql("INSERT INTO " TblEvents "(" TblEvents_Height "," TblEvents_Body "," TblEvents_Key ") VALUES", "(?,?,?)");
+		Recordset rs(*this, Query::EventInsBatch, s_Sql.c_str());
+
+		for (; nCount >= s_InsBatch; nCount -= s_InsBatch)
+		{
+			for (int iCol = 0; iCol < static_cast<int>(s_InsBatch * 3); p++)
+			{
+				rs.put(iCol++, p->m_Height);
+				rs.put(iCol++, p->m_Body);
+				if (p->m_Key.n)
+					rs.put(iCol, p->m_Key);
+				iCol++;
+			}
+
+			rs.Step();
+			TestChangedRows(s_InsBatch);
+			rs.Reset();
+		}
+	}
+
+	for (; nCount; nCount--, p++)
+		InsertEvent(p->m_Height, p->m_Body, p->m_Key);
+}
+
 void NodeDB::DeleteEventsAbove(Height h)
 {
 	Recordset rs(*this, Query::EventDel, "DELETE FROM " TblEvents " WHERE " TblEvents_Height ">?");
@@ -1862,6 +2252,33 @@ void NodeDB::InsertKernel(const Blob& key, Height h)
 	TestChanged1Row();
 }
 
+void NodeDB::InsertKernels(const Merkle::Hash* p, uint32_t nCount, Height h)
+{
+	assert(h >= Rules::HeightGenesis);
+
+	if (nCount >= s_InsBatch)
+	{
+		static const std::string s_Sql = get_InsBatchSql("INSERT INTO " TblKernels "(" TblKernels_Key "," TblKernels_Height ") VALUES", "(?,?)");
+		Recordset rs(*this, Query::KernelInsBatch, s_Sql.c_str());
+
+		for (; nCount >= s_InsBatch; nCount -= s_InsBatch)
+		{
+			for (int iCol = 0; iCol < static_cast<int>(s_InsBatch * 2); p++)
+			{
+				rs.put(iCol++, *p);
+				rs.put(iCol++, h);
+			}
+
+			rs.Step();
+			TestChangedRows(s_InsBatch);
+			rs.Reset();
+		}
+	}
+
+	for (; nCount; nCount--, p++)
+		InsertKernel(*p, h);
+}
+
 void NodeDB::DeleteKernel(const Blob& key, Height h)
 {
 	assert(h >= Rules::HeightGenesis);
@@ -97,6 +97,7 @@ public:
 			//StateDelBlock,
 			StateSetRollback,
 			EventIns,
+			EventInsBatch,
 			EventDel,
 			EventEnum,
 			EventFind,
@@ -121,6 +122,7 @@ public:
 			DummyUpdHeight,
 			DummyDel,
 			KernelIns,
+			KernelInsBatch,
 			KernelFind,
 			KernelDel,
 			KernelDelAll,
@@ -139,6 +141,31 @@ public:
 	NodeDB();
 	virtual ~NodeDB();
 
+	// sqlite settings, applied on Open
+	struct Tuning
+	{
+		bool m_Wal = false; // journal_mode: WAL or the default (DELETE)
+		int m_Synchronous = -1; // 0: OFF, 1: NORMAL, 2: FULL, 3: EXTRA. Negative: sqlite default
+		uint64_t m_MmapSize = 0; // 0: memory-mapped I/O is off
+		int m_CacheSize = 0; // positive: num of pages, negative: size in KiB. 0: sqlite default
+		uint32_t m_PageSize = 0; // applied only when the DB is created. 0: sqlite default
+
+		// WAL only. The checkpoints (and hence the fsyncs, with synchronous=NORMAL) are done by a background thread, on its own connection,
+		// so that the commits are quick. Requires the normal (not exclusive) locking mode.
+		bool m_CheckpointThread = false;
+		uint32_t m_CheckpointMaxPending = 16; // commits not checkpointed yet, beyond which the commit waits for the background thread
+	} m_Tuning;
+
+	struct Stats
+	{
+		uint64_t m_BytesDirty = 0; // data written within the current transaction (roughly, by the values bound to the modifying statements)
+		uint64_t m_Commits = 0;
+		uint64_t m_CommitTotal_us = 0;
+		uint64_t m_CommitMax_us = 0;
+		uint64_t m_CommitLast_us = 0;
+		uint64_t m_CommitWait_us = 0; // total, waiting for the background checkpoints
+	} m_Stats;
+
 	void Close();
 	void Open(const char* szPath);
 
@@ -147,6 +174,7 @@ public:
 	class Recordset
 	{
 		sqlite3_stmt* m_pStmt;
+		uint32_t m_nBytesBound; // accounted in m_Stats.m_BytesDirty if the statement modifies the data
 	public:
 
 		NodeDB & m_DB;
@@ -277,6 +305,16 @@ public:
 	void MacroblockDel(uint64_t rowid);
 
 	void InsertEvent(Height, const Blob&, const Blob& key);
+
+	struct EventData
+	{
+		Height m_Height;
+		Blob m_Body;
+		Blob m_Key;
+	};
+	void InsertEvents(const EventData*, uint32_t nCount); // multi-row inserts
+
+	static const uint32_t s_InsBatch = 16; // rows per multi-row insert, the remainder is inserted row-by-row
 	void DeleteEventsAbove(Height);
 
 	struct WalkerEvent {
@@ -368,6 +406,7 @@ public:
 	void SetDummyHeight(uint64_t, Height);
 
 	void InsertKernel(const Blob&, Height h);
+	void InsertKernels(const Merkle::Hash*, uint32_t nCount, Height h); // multi-row inserts
 	void DeleteKernel(const Blob&, Height h);
 	Height FindKernel(const Blob&); // in case of duplicates - returning the one with the largest Height
 
@@ -418,8 +457,25 @@ private:
 	void put_Cursor(const StateID& sid); // jump
 
 	void TestChanged1Row();
+	void TestChangedRows(uint32_t);
+
+	static std::string get_InsBatchSql(const char* szPrefix, const char* szRow);
+
+	void ApplyTuning(bool bCreate);
+
+	struct Checkpointer;
+	std::unique_ptr<Checkpointer> m_pCheckpointer;
 
 	struct Dmmr;
+
+	// The states MMR of the active chain, kept in a flat memory-mapped file. Nodes are stored in the append order, so that any node is addressed directly by its position.
+	// Not covered by the DB transactions, hence it's verified wrt the DB before use, and the Dmmr is used as a fallback.
+	struct StatesMmr;
+	std::unique_ptr<StatesMmr> m_pStatesMmr;
+
+	void OpenStatesMmr(const char* szPath);
+	void RebuildStatesMmr();
+	StatesMmr* get_StatesMmr(const StateID&); // NULL if not on the active chain, or not in sync
 };
 
 
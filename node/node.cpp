@@ -43,7 +43,17 @@ void Node::RefreshCongestions()
     for (TaskSet::iterator it = m_setTasks.begin(); m_setTasks.end() != it; it++)
         it->m_hTarget = MaxHeight;
 
-    m_Processor.EnumCongestions(m_Cfg.m_MaxConcurrentBlocksRequest);
+    // the window of blocks requested ahead of the cursor grows with the number of peers we can download from
+    uint32_t nPeers = 0;
+    for (PeerList::iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
+        if (it->ShouldAssignTasks())
+            nPeers++;
+
+    uint64_t nWindow = static_cast<uint64_t>(std::max(nPeers, 1U)) * m_Cfg.m_MaxConcurrentBlocksRequest;
+    if (nWindow > m_Cfg.m_MaxBlocksBacklog)
+        nWindow = m_Cfg.m_MaxBlocksBacklog;
+
+    m_Processor.EnumCongestions(static_cast<uint32_t>(nWindow));
 
     for (TaskList::iterator it = m_lstTasksUnassigned.begin(); m_lstTasksUnassigned.end() != it; )
     {
@@ -284,6 +294,12 @@ void Node::TryAssignTask(Task& t, const PeerID* pPeerID)
             return;
     }
 
+    if (t.m_Key.second)
+    {
+        TryAssignBlockTask(t);
+        return;
+    }
+
     for (PeerList::iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
     {
         Peer& p = *it;
@@ -292,6 +308,65 @@ void Node::TryAssignTask(Task& t, const PeerID* pPeerID)
     }
 }
 
+bool Node::TryAssignBlockTask(Task& t)
+{
+    assert(t.m_Key.second);
+
+    // Estimate when each peer would deliver this block: its queue (incl. this one) times its measured latency.
+    // Peers without measurement are assumed as fast as the average, so that they get the chance.
+    uint64_t nLatencySum = 0;
+    uint32_t nLatencyCount = 0;
+    for (PeerList::iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
+        if (it->m_BlockLatency_ms)
+        {
+            nLatencySum += it->m_BlockLatency_ms;
+            nLatencyCount++;
+        }
+
+    uint32_t nLatencyDef = nLatencyCount ? static_cast<uint32_t>(nLatencySum / nLatencyCount) : 1;
+
+    struct Candidate
+    {
+        uint64_t m_Eta;
+        uint32_t m_Rating;
+        Peer* m_pPeer;
+
+        bool operator < (const Candidate& x) const
+        {
+            if (m_Eta != x.m_Eta)
+                return m_Eta < x.m_Eta;
+            return m_Rating > x.m_Rating;
+        }
+    };
+
+    std::vector<Candidate> vCandidates;
+    vCandidates.reserve(m_lstPeers.size());
+
+    for (PeerList::iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
+    {
+        Peer& p = *it;
+        if (!p.ShouldAssignTasks())
+            continue;
+
+        uint32_t nBlocks = p.get_BlocksInProgress();
+        if (nBlocks >= m_Cfg.m_MaxConcurrentBlocksRequest)
+            continue;
+
+        Candidate& c = vCandidates.emplace_back();
+        c.m_Eta = static_cast<uint64_t>(nBlocks + 1) * (p.m_BlockLatency_ms ? p.m_BlockLatency_ms : nLatencyDef);
+        c.m_Rating = p.m_pInfo->m_RawRating.m_Value;
+        c.m_pPeer = &p;
+    }
+
+    std::sort(vCandidates.begin(), vCandidates.end());
+
+    for (size_t i = 0; i < vCandidates.size(); i++)
+        if (TryAssignTask(t, *vCandidates[i].m_pPeer))
+            return true;
+
+    return false;
+}
+
 bool Node::TryAssignTask(Task& t, Peer& p)
 {
     if (!p.ShouldAssignTasks())
@@ -322,10 +397,7 @@ bool Node::TryAssignTask(Task& t, Peer& p)
         return false;
 
     // check if the peer currently transfers a block
-    uint32_t nBlocks = 0;
-    for (TaskList::iterator it = p.m_lstTasks.begin(); p.m_lstTasks.end() != it; it++)
-        if (it->m_Key.second)
-            nBlocks++;
+    uint32_t nBlocks = p.get_BlocksInProgress();
 
     // assign
     uint32_t nPackSize = 0;
@@ -391,10 +463,66 @@ bool Node::TryAssignTask(Task& t, Peer& p)
 
 void Node::Peer::SetTimerWrtFirstTask()
 {
+    m_bStallTimer = false;
+
     if (m_lstTasks.empty())
         KillTimer();
     else
-        SetTimer(m_lstTasks.front().m_Key.second ? m_This.m_Cfg.m_Timeout.m_GetBlock_ms : m_This.m_Cfg.m_Timeout.m_GetState_ms);
+    {
+        m_FirstTask_ms = GetTime_ms();
+
+        const Task& t = m_lstTasks.front();
+        if (t.m_Key.second)
+        {
+            uint32_t timeout_ms = m_This.m_Cfg.m_Timeout.m_GetBlock_ms;
+
+            // If the whole download waits for this block - don't let a slow peer hold it, if there are others to ask.
+            if ((t.m_Key.first.m_Height == m_This.m_Processor.m_Cursor.m_ID.m_Height + 1) && (m_This.m_Cfg.m_Timeout.m_BlockStall_ms < timeout_ms))
+            {
+                for (PeerList::iterator it = m_This.m_lstPeers.begin(); m_This.m_lstPeers.end() != it; it++)
+                {
+                    Peer& p = *it;
+                    if ((this != &p) && p.CanServe(t))
+                    {
+                        timeout_ms = m_This.m_Cfg.m_Timeout.m_BlockStall_ms;
+                        m_bStallTimer = true;
+                        break;
+                    }
+                }
+            }
+
+            SetTimer(timeout_ms);
+        }
+        else
+            SetTimer(m_This.m_Cfg.m_Timeout.m_GetState_ms);
+    }
+}
+
+void Node::Peer::OnBlockStalled()
+{
+    // Not a timeout, the peer may be just slow. Move the block to another peer. The response is still expected, it will be ignored
+    Task& t = get_FirstTask();
+    assert(t.m_Key.second);
+
+    LOG_INFO() << "Peer " << m_RemoteAddr << " stalls the block " << t.m_Key.first << ", reassigning";
+
+    m_nBlocksStalled++;
+    m_setRejected.insert(t.m_Key); // don't take it back
+
+    ReleaseTask(t);
+    SetTimerWrtFirstTask();
+}
+
+bool Node::Peer::OnStalledBlockResponse()
+{
+    if (!m_nBlocksStalled)
+        return false;
+
+    m_nBlocksStalled--;
+    m_FirstTask_ms = GetTime_ms(); // the current task starts now
+
+    TakeTasks();
+    return true;
 }
 
 void Node::Processor::RequestData(const Block::SystemState::ID& id, bool bBlock, const PeerID* pPreferredPeer, Height hTarget)
@@ -464,6 +592,7 @@ void Node::Processor::FlushInsanePeers()
 void Node::Processor::OnNewState()
 {
     m_Cwp.Reset();
+    m_mapCwpCropped.clear();
 
 	if (!m_Extra.m_TreasuryHandled)
         return;
@@ -515,6 +644,11 @@ void Node::Processor::OnNewState()
 void Node::Processor::OnRolledBack()
 {
     LOG_INFO() << "Rolled back to: " << m_Cursor.m_ID;
+
+    m_Cwp.Reset();
+    m_mapCwpCropped.clear();
+    m_mapCwpStates.erase(m_mapCwpStates.upper_bound(m_Cursor.m_Full.m_ChainWork), m_mapCwpStates.end());
+
     get_ParentObj().m_Compressor.OnRolledBack();
 }
 
@@ -563,6 +697,21 @@ bool Node::Processor::Verifier::ValidateAndSummarize(TxBase::Context& ctx, const
     return !m_bFail;
 }
 
+bool Node::Processor::ValidateAndSummarize(TxBase::Context& ctx, const TxBase& txb, TxBase::IReader&& r)
+{
+    return m_Verifier.ValidateAndSummarize(ctx, txb, std::move(r));
+}
+
+uint32_t Node::Processor::get_MaxThreads()
+{
+    // same limit as for the verification. If there are no verification threads - the caller only
+    int nThreads = get_ParentObj().m_Cfg.m_VerificationThreads;
+    if (nThreads < 0)
+        return 0; // not resolved yet, all the cores
+
+    return std::max(nThreads, 1);
+}
+
 bool Node::Processor::VerifyBlock(const Block::BodyBase& block, TxBase::IReader&& r, const HeightRange& hr)
 {
     if (hr.m_Min < Rules::HeightGenesis)
@@ -605,6 +754,7 @@ void Node::Processor::Verifier::Thread(uint32_t iVerifier)
 
         TxBase::Context ctx;
         ctx.m_bBlockMode = m_pCtx->m_bBlockMode;
+        ctx.m_bVerifyOrder = m_pCtx->m_bVerifyOrder;
         ctx.m_Height = m_pCtx->m_Height;
         ctx.m_nVerifiers = nThreads;
         ctx.m_iVerifier = iVerifier;
@@ -646,10 +796,9 @@ void Node::Processor::AdjustFossilEnd(Height& h)
         h = hOldest;
 }
 
-bool Node::Processor::OpenMacroblock(Block::BodyBase::RW& rw, const NodeDB::StateID& sid)
+bool Node::Processor::OpenMacroblock(Block::BodyBase::MultiRW& rw, const NodeDB::StateID& sid)
 {
-    get_ParentObj().m_Compressor.FmtPath(rw, sid.m_Height, NULL);
-    rw.ROpen();
+    get_ParentObj().m_Compressor.OpenMacroblock(rw, sid.m_Height);
     return true;
 }
 
@@ -695,6 +844,9 @@ void Node::Processor::OnFlushTimer()
 {
     m_bFlushPending = false;
     CommitDB();
+
+    const NodeDB::Stats& s = get_DB().m_Stats;
+    LOG_DEBUG() << "DB commit: " << s.m_CommitLast_us << " us, max " << s.m_CommitMax_us << " us, avg " << (s.m_CommitTotal_us / std::max<uint64_t>(s.m_Commits, 1)) << " us";
 }
 
 void Node::Processor::FlushDB()
@@ -714,6 +866,7 @@ Node::Peer* Node::AllocPeer(const beam::io::Address& addr)
     m_lstPeers.push_back(*pPeer);
 
 	pPeer->m_UnsentHiMark = m_Cfg.m_BandwidthCtl.m_Drown;
+	pPeer->m_pIoPool = &m_IoPool;
     pPeer->m_pInfo = NULL;
     pPeer->m_Flags = 0;
     pPeer->m_Port = 0;
@@ -722,6 +875,14 @@ Node::Peer* Node::AllocPeer(const beam::io::Address& addr)
     pPeer->m_LoginFlags = 0;
 	pPeer->m_CursorBbs = std::numeric_limits<int64_t>::max();
 	pPeer->m_pCursorTx = nullptr;
+	pPeer->m_FirstTask_ms = 0;
+	pPeer->m_BlockLatency_ms = 0;
+	pPeer->m_nBlocksStalled = 0;
+	pPeer->m_bStallTimer = false;
+	pPeer->m_iSyncData = 0;
+	pPeer->m_SyncOffset = 0;
+	pPeer->m_SyncSize = 0;
+	pPeer->m_SyncGeneration = 0;
 
     LOG_INFO() << "+Peer " << addr;
 
@@ -747,6 +908,9 @@ void Node::Keys::SetSingleKey(const Key::IKdf::Ptr& pKdf)
 void Node::Initialize(IExternalPOW* externalPOW)
 {
     m_Processor.m_Horizon = m_Cfg.m_Horizon;
+    m_Processor.m_ImportWindow = m_Cfg.m_ImportWindow;
+    m_Processor.m_CommitBytes = m_Cfg.m_DbCommitBytes;
+    m_Processor.get_DB().m_Tuning = m_Cfg.m_DbTuning;
     m_Processor.Initialize(m_Cfg.m_sPathLocal.c_str(), m_Cfg.m_Sync.m_ForceResync);
 
     if (m_Cfg.m_Sync.m_ForceResync)
@@ -767,6 +931,9 @@ void Node::Initialize(IExternalPOW* externalPOW)
 
     InitMode();
 
+	if (m_Cfg.m_IoThreads)
+		m_IoPool.Start(m_Cfg.m_IoThreads);
+
 	ZeroObject(m_SyncStatus);
     RefreshCongestions();
 
@@ -857,7 +1024,25 @@ void Node::InitMode()
 
     if (m_pSync->m_Trg.m_Height)
     {
-        m_pSync->m_SizeCompleted = m_Compressor.get_SizeTotal(m_pSync->m_Trg.m_Height);
+        m_pSync->m_SizeCompleted = 0;
+
+        Block::Body::RW rw;
+        m_Compressor.FmtPath(rw, m_pSync->m_Trg.m_Height, NULL);
+
+        for (uint8_t i = 0; i < Block::Body::RW::Type::count; i++)
+        {
+            std::string sPath;
+            rw.GetPath(sPath, i);
+
+            FirstTimeSync::Stream& x = m_pSync->m_pStream[i];
+
+            std::FStream fs;
+            if (fs.Open(sPath.c_str(), true))
+                x.m_SizeDone = x.m_OffsetNext = fs.get_Remaining();
+
+            m_pSync->m_SizeCompleted += x.m_SizeDone;
+        }
+
         m_pSync->m_SizeTotal = m_pSync->m_SizeCompleted; // will change when peer responds
 
         LOG_INFO() << "Resuming sync up to " << m_pSync->m_Trg;
@@ -939,6 +1124,8 @@ Node::~Node()
 
     assert(m_setTasks.empty());
 
+    m_IoPool.Stop();
+
     Processor::Verifier& v = m_Processor.m_Verifier; // alias
     if (!v.m_vThreads.empty())
     {
@@ -979,6 +1166,12 @@ void Node::Peer::OnTimer()
     {
         assert(!m_lstTasks.empty());
 
+        if (m_bStallTimer)
+        {
+            OnBlockStalled();
+            return;
+        }
+
         LOG_WARNING() << "Peer " << m_RemoteAddr << " request timeout";
 
         if (m_pInfo)
@@ -1043,6 +1236,8 @@ void Node::Peer::OnConnectedSecure()
     msgLogin.m_CfgChecksum = Rules::get().Checksum; // checksum of all consesnsus related configuration
     msgLogin.m_Flags =
 		proto::LoginFlags::Extension1 |
+		proto::LoginFlags::Extension2 |
+		proto::LoginFlags::Extension3 |
         proto::LoginFlags::SpreadingTransactions | // indicate ability to receive and broadcast transactions
         proto::LoginFlags::SendPeers; // request a another node to periodically send a list of recommended peers
 
@@ -1191,6 +1386,25 @@ bool Node::Peer::ShouldAssignTasks()
     return true;
 }
 
+bool Node::Peer::CanServe(const Task& t)
+{
+    return
+        (Flags::Connected & m_Flags) &&
+        ShouldAssignTasks() &&
+        (m_Tip.m_Height >= t.m_Key.first.m_Height) &&
+        (m_setRejected.end() == m_setRejected.find(t.m_Key));
+}
+
+uint32_t Node::Peer::get_BlocksInProgress() const
+{
+    uint32_t nBlocks = m_nBlocksStalled; // still in progress, from the peer's point of view
+    for (TaskList::const_iterator it = m_lstTasks.begin(); m_lstTasks.end() != it; it++)
+        if (it->m_Key.second)
+            nBlocks++;
+
+    return nBlocks;
+}
+
 bool Node::Peer::ShouldFinalizeMining()
 {
     return
@@ -1313,10 +1527,8 @@ void Node::Peer::DeleteSelf(bool bIsError, uint8_t nByeReason)
 
     if (m_This.m_pSync && (Flags::SyncPending & m_Flags))
     {
-        assert(m_This.m_pSync->m_RequestsPending);
-        m_Flags &= ~Flags::SyncPending;
+        m_This.OnSyncLost(*this);
         m_Flags |= Flags::DontSync;
-        m_This.m_pSync->m_RequestsPending--;
 
         m_This.SyncCycle();
     }
@@ -1346,7 +1558,13 @@ void Node::Peer::TakeTasks()
         return;
 
     for (TaskList::iterator it = m_This.m_lstTasksUnassigned.begin(); m_This.m_lstTasksUnassigned.end() != it; )
-        m_This.TryAssignTask(*it++, *this);
+    {
+        Task& t = *it++;
+        if (t.m_Key.second)
+            m_This.TryAssignBlockTask(t); // maybe there's a better peer for it
+        else
+            m_This.TryAssignTask(t, *this);
+    }
 }
 
 void Node::Peer::OnMsg(proto::Pong&&)
@@ -1482,22 +1700,21 @@ void Node::Peer::OnMsg(proto::Macroblock&& msg)
 
     if (Flags::SyncPending & m_Flags)
     {
-        assert(m_This.m_pSync->m_RequestsPending);
-        m_Flags &= ~Flags::SyncPending;
-        m_This.m_pSync->m_RequestsPending--;
-
         if (msg.m_ID == m_This.m_pSync->m_Trg)
         {
             LOG_INFO() << "Peer " << m_RemoteAddr << " DL Macroblock portion";
-            m_This.SyncCycle(*this, msg.m_Portion);
+            m_This.SyncCycle(*this, msg);
         }
         else
         {
             LOG_INFO() << "Peer incompatible";
 
+            m_This.OnSyncLost(*this);
             m_Flags |= Flags::DontSync;
-            m_This.SyncCycle();
         }
+
+        if (m_This.m_pSync)
+            m_This.SyncCycle();
     }
     else
     {
@@ -1565,22 +1782,64 @@ void Node::OnSyncTimer()
 void Node::SyncCycle()
 {
     assert(m_pSync);
-    if (m_pSync->m_bDetecting || m_pSync->m_RequestsPending)
+    if (m_pSync->m_bDetecting)
         return;
 
+    // assign portions to all the idle peers
     for (PeerList::iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
-        if (SyncCycle(*it))
-            break;
+        SyncCycle(*it);
+}
+
+bool Node::FirstTimeSync::Stream::get_Next(uint64_t& nOffset, uint64_t& nSize, uint32_t nPortion, uint32_t nMaxAhead)
+{
+    if (m_bDone)
+        return false;
+
+    if (!m_mapMissing.empty())
+    {
+        auto it = m_mapMissing.begin();
+        nOffset = it->first;
+        nSize = it->second;
+        m_mapMissing.erase(it);
+        return true;
+    }
+
+    if (m_bSequential || !m_SizeTotal || !nPortion)
+    {
+        // the stream size isn't known (or trusted) yet, request sequentially
+        if (m_Pending)
+            return false;
+
+        nOffset = m_OffsetNext;
+        nSize = 0;
+        return true;
+    }
+
+    if (m_OffsetNext >= m_SizeTotal)
+        return false;
+
+    if (m_OffsetNext - m_SizeDone >= static_cast<uint64_t>(nPortion) * nMaxAhead)
+        return false; // too much ahead, wait for the gap to be filled
+
+    nOffset = m_OffsetNext;
+    nSize = std::min(static_cast<uint64_t>(nPortion), m_SizeTotal - m_OffsetNext);
+    m_OffsetNext += nSize;
+    return true;
+}
+
+void Node::FirstTimeSync::Stream::OnLost(uint64_t nOffset, uint64_t nSize)
+{
+    if (nSize)
+        m_mapMissing[nOffset] = nSize;
 }
 
 bool Node::SyncCycle(Peer& p)
 {
     assert(m_pSync);
-    if (m_pSync->m_bDetecting || m_pSync->m_RequestsPending)
+    if (m_pSync->m_bDetecting)
         return false;
 
-    assert(!(Peer::Flags::SyncPending & p.m_Flags));
-    if (Peer::Flags::DontSync & p.m_Flags)
+    if ((Peer::Flags::SyncPending | Peer::Flags::DontSync) & p.m_Flags)
         return false;
 
     if (p.m_Tip.m_Height < m_pSync->m_Trg.m_Height/* + Rules::get().Macroblock.MaxRollback*/)
@@ -1588,22 +1847,23 @@ bool Node::SyncCycle(Peer& p)
 
     proto::MacroblockGet msg;
     msg.m_ID = m_pSync->m_Trg;
-    msg.m_Data = m_pSync->m_iData;
 
-    assert(m_pSync->m_iData < Block::Body::RW::Type::count);
-
-    Block::Body::RW rw;
-    m_Compressor.FmtPath(rw, m_pSync->m_Trg.m_Height, NULL);
+    for (msg.m_Data = 0; ; msg.m_Data++)
+    {
+        if (Block::Body::RW::Type::count == msg.m_Data)
+            return false; // nothing to request atm
 
-    std::string sPath;
-    rw.GetPath(sPath, m_pSync->m_iData);
+        if (m_pSync->m_pStream[msg.m_Data].get_Next(msg.m_Offset, p.m_SyncSize, m_pSync->m_nPortion, m_Cfg.m_Sync.m_MaxPortionsAhead))
+            break;
+    }
 
-    std::FStream fs;
-    if (fs.Open(sPath.c_str(), true))
-        msg.m_Offset = fs.get_Remaining();
+    p.m_iSyncData = msg.m_Data;
+    p.m_SyncOffset = msg.m_Offset;
+    p.m_SyncGeneration = m_pSync->m_pStream[msg.m_Data].m_Generation;
 
     p.Send(msg);
     p.m_Flags |= Peer::Flags::SyncPending;
+    m_pSync->m_pStream[msg.m_Data].m_Pending++;
     m_pSync->m_RequestsPending++;
 
     LOG_INFO() << " Sending MacroblockGet/request to " << p.m_RemoteAddr << ". Idx=" << uint32_t(msg.m_Data) << ", Offset=" << msg.m_Offset;
@@ -1611,49 +1871,187 @@ bool Node::SyncCycle(Peer& p)
     return true;
 }
 
-void Node::SyncCycle(Peer& p, const ByteBuffer& buf)
+void Node::OnSyncLost(Peer& p)
+{
+    assert(m_pSync && (Peer::Flags::SyncPending & p.m_Flags));
+    p.m_Flags &= ~Peer::Flags::SyncPending;
+
+    FirstTimeSync::Stream& x = m_pSync->m_pStream[p.m_iSyncData];
+
+    assert(x.m_Pending && m_pSync->m_RequestsPending);
+    x.m_Pending--;
+    m_pSync->m_RequestsPending--;
+
+    if (p.m_SyncGeneration == x.m_Generation)
+        x.OnLost(p.m_SyncOffset, p.m_SyncSize);
+}
+
+void Node::RestartSyncStream(uint8_t iData)
 {
-    assert(m_pSync && !m_pSync->m_bDetecting && !m_pSync->m_RequestsPending);
-    assert(m_pSync->m_iData < Block::Body::RW::Type::count);
+    FirstTimeSync::Stream& x = m_pSync->m_pStream[iData];
+
+    Block::Body::RW rw;
+    m_Compressor.FmtPath(rw, m_pSync->m_Trg.m_Height, NULL);
+
+    std::string sPath;
+    rw.GetPath(sPath, iData);
+    DeleteFile(sPath.c_str());
+
+    m_pSync->m_SizeCompleted -= x.m_SizeDone;
+
+    x.m_SizeTotal = 0;
+    x.m_SizeDone = 0;
+    x.m_OffsetNext = 0;
+    x.m_mapAhead.clear();
+    x.m_mapMissing.clear();
+
+    x.m_bSequential = true; // so that the size reported by the peers doesn't matter anymore
+    x.m_Generation++;
+}
 
-    if (buf.empty())
+void Node::SyncCycle(Peer& p, const proto::Macroblock& msg)
+{
+    assert(m_pSync && !m_pSync->m_bDetecting);
+    assert(p.m_iSyncData < Block::Body::RW::Type::count);
+
+    FirstTimeSync::Stream& x = m_pSync->m_pStream[p.m_iSyncData];
+    const ByteBuffer& buf = msg.m_Portion;
+
+    if (p.m_SyncGeneration != x.m_Generation)
     {
-        LOG_INFO() << "Sync cycle complete for Idx=" << uint32_t(m_pSync->m_iData);
+        // requested before the stream was restarted
+        OnSyncLost(p);
+        return;
+    }
 
-        if (++m_pSync->m_iData == Block::Body::RW::Type::count)
-        {
-            Height h = m_pSync->m_Trg.m_Height;
-            m_pSync = NULL;
+    // The stream size is reported along with the data (older peers report 0). Peers that disagree on it don't have the same data,
+    // but it's not known which of them is right, so none is excluded. Restart the stream and download it sequentially, as before.
+    // The data is anyway authenticated by the full verification at import.
+    bool bMismatch = !x.m_bSequential && msg.m_SizeTotal && x.m_SizeTotal && (msg.m_SizeTotal != x.m_SizeTotal);
+
+    // An older peer that has no data within the known size evidently has a shorter stream, which is the same disagreement
+    if (p.m_SyncSize && buf.empty() && !msg.m_SizeTotal)
+        bMismatch = true;
+
+    if (bMismatch)
+    {
+        LOG_WARNING() << "Peer " << p.m_RemoteAddr << " stream size mismatch, Idx=" << uint32_t(p.m_iSyncData) << ". Restarting the stream";
+
+        OnSyncLost(p);
+        RestartSyncStream(p.m_iSyncData);
+        return;
+    }
 
-            LOG_INFO() << "Sync DL complete";
+    p.m_Flags &= ~Peer::Flags::SyncPending;
+    assert(x.m_Pending && m_pSync->m_RequestsPending);
+    x.m_Pending--;
+    m_pSync->m_RequestsPending--;
 
-            ImportMacroblock(h);
-            RefreshCongestions();
-			m_Miner.SetTimer(0, true);
+    bool bEnd = false;
 
+    if (p.m_SyncSize)
+    {
+        // a portion of the known size
+        if (buf.empty())
+        {
+            // the peer doesn't have it, though it reported the same size
+            x.OnLost(p.m_SyncOffset, p.m_SyncSize);
+            p.m_Flags |= Peer::Flags::DontSync;
             return;
         }
+
+        size_t nSize = buf.size();
+        if (nSize >= p.m_SyncSize)
+            nSize = static_cast<size_t>(p.m_SyncSize); // the peer portion may be bigger than ours
+        else
+            x.OnLost(p.m_SyncOffset + nSize, p.m_SyncSize - nSize); // the rest should be requested again
+
+        if (p.m_SyncOffset == x.m_SizeDone)
+            WriteSyncPortion(p.m_iSyncData, buf, nSize);
+        else
+        {
+            assert(p.m_SyncOffset > x.m_SizeDone);
+            ByteBuffer& bufAhead = x.m_mapAhead[p.m_SyncOffset];
+            bufAhead.assign(buf.begin(), buf.begin() + nSize);
+        }
     }
     else
+    {
+        // sequential
+        assert(p.m_SyncOffset == x.m_SizeDone);
+
+        if (msg.m_SizeTotal && !x.m_bSequential)
+            x.m_SizeTotal = msg.m_SizeTotal;
+
+        if (buf.empty())
+        {
+            x.m_SizeTotal = x.m_SizeDone;
+            bEnd = true; // even if the stream is empty
+        }
+        else
+        {
+            if (!x.m_SizeTotal || (x.m_SizeDone + buf.size() < x.m_SizeTotal))
+                m_pSync->m_nPortion = std::max(m_pSync->m_nPortion, static_cast<uint32_t>(buf.size())); // not the tail, this is the peer portion size
+
+            WriteSyncPortion(p.m_iSyncData, buf, buf.size());
+            x.m_OffsetNext = x.m_SizeDone;
+        }
+    }
+
+    // append the portions received ahead
+    while (!x.m_mapAhead.empty())
+    {
+        auto it = x.m_mapAhead.begin();
+        if (it->first != x.m_SizeDone)
+            break;
+
+        WriteSyncPortion(p.m_iSyncData, it->second, it->second.size());
+        x.m_mapAhead.erase(it);
+    }
+
+    if (x.m_SizeTotal && (x.m_SizeDone == x.m_SizeTotal))
+        bEnd = true;
+
+    if (bEnd && !x.m_bDone)
+    {
+        x.m_bDone = true;
+        LOG_INFO() << "Sync cycle complete for Idx=" << uint32_t(p.m_iSyncData);
+
+        for (uint8_t i = 0; i < Block::Body::RW::Type::count; i++)
+            if (!m_pSync->m_pStream[i].m_bDone)
+                return;
+
+        Height h = m_pSync->m_Trg.m_Height;
+        m_pSync = NULL;
+
+        LOG_INFO() << "Sync DL complete";
+
+        ImportMacroblock(h);
+        RefreshCongestions();
+        m_Miner.SetTimer(0, true);
+    }
+}
+
+void Node::WriteSyncPortion(uint8_t iData, const ByteBuffer& buf, size_t nSize)
+{
+    FirstTimeSync::Stream& x = m_pSync->m_pStream[iData];
+
+    if (nSize)
     {
         Block::Body::RW rw;
         m_Compressor.FmtPath(rw, m_pSync->m_Trg.m_Height, NULL);
 
         std::string sPath;
-        rw.GetPath(sPath, m_pSync->m_iData);
+        rw.GetPath(sPath, iData);
 
         std::FStream fs;
         fs.Open(sPath.c_str(), false, true, true);
 
-        fs.write(&buf.at(0), buf.size());
-        m_pSync->m_SizeCompleted += buf.size();
-
-        LOG_INFO() << "Portion appended";
-
-        // Macroblock download progress should be reported here!
+        fs.write(&buf.at(0), nSize);
     }
 
-    SyncCycle(p);
+    x.m_SizeDone += nSize;
+    m_pSync->m_SizeCompleted += nSize;
 }
 
 Node::Task& Node::Peer::get_FirstTask()
@@ -1673,6 +2071,9 @@ void Node::Peer::OnFirstTaskDone()
 
 void Node::Peer::OnMsg(proto::DataMissing&&)
 {
+    if (OnStalledBlockResponse())
+        return;
+
     Task& t = get_FirstTask();
     m_setRejected.insert(t.m_Key);
 
@@ -1849,6 +2250,9 @@ void Node::Peer::OnMsg(proto::GetBody&& msg)
 
 void Node::Peer::OnMsg(proto::Body&& msg)
 {
+    if (OnStalledBlockResponse())
+        return;
+
     Task& t = get_FirstTask();
 
     if (!t.m_Key.second || t.m_bPack)
@@ -1857,6 +2261,9 @@ void Node::Peer::OnMsg(proto::Body&& msg)
     assert((Flags::PiRcvd & m_Flags) && m_pInfo);
     m_This.m_PeerMan.ModifyRating(*m_pInfo, PeerMan::Rating::RewardBlock, true);
 
+    uint32_t dt_ms = std::max(GetTime_ms() - m_FirstTask_ms, 1U);
+    m_BlockLatency_ms = m_BlockLatency_ms ? ((m_BlockLatency_ms * 3 + dt_ms) >> 2) : dt_ms;
+
     const Block::SystemState::ID& id = t.m_Key.first;
     Height h = id.m_Height;
 
@@ -2607,11 +3014,11 @@ void Node::Peer::OnMsg(proto::GetProofKernel2&& msg)
     Send(msgOut);
 }
 
-void Node::Peer::OnMsg(proto::GetProofUtxo&& msg)
+void Node::Peer::get_ProofUtxo(std::vector<Input::Proof>& vRes, const ECC::Point& comm, Height hMaturityMin)
 {
     struct Traveler :public UtxoTree::ITraveler
     {
-        proto::ProofUtxo m_Msg;
+        std::vector<Input::Proof>* m_pRes;
         UtxoTree* m_pTree;
         Merkle::Hash m_hvHistory;
 
@@ -2621,8 +3028,8 @@ void Node::Peer::OnMsg(proto::GetProofUtxo&& msg)
             UtxoTree::Key::Data d;
             d = v.m_Key;
 
-            m_Msg.m_Proofs.resize(m_Msg.m_Proofs.size() + 1);
-            Input::Proof& ret = m_Msg.m_Proofs.back();
+            m_pRes->resize(m_pRes->size() + 1);
+            Input::Proof& ret = m_pRes->back();
 
             ret.m_State.m_Count = v.m_Value.m_Count;
             ret.m_State.m_Maturity = d.m_Maturity;
@@ -2632,10 +3039,11 @@ void Node::Peer::OnMsg(proto::GetProofUtxo&& msg)
             ret.m_Proof.back().first = false;
             ret.m_Proof.back().second = m_hvHistory;
 
-            return m_Msg.m_Proofs.size() < Input::Proof::s_EntriesMax;
+            return m_pRes->size() < Input::Proof::s_EntriesMax;
         }
     } t;
 
+    t.m_pRes = &vRes;
     t.m_pTree = &m_This.m_Processor.get_Utxos();
     t.m_hvHistory = m_This.m_Processor.m_Cursor.m_History;
 
@@ -2646,8 +3054,8 @@ void Node::Peer::OnMsg(proto::GetProofUtxo&& msg)
     UtxoTree::Key kMin, kMax;
 
     UtxoTree::Key::Data d;
-    d.m_Commitment = msg.m_Utxo;
-    d.m_Maturity = msg.m_MaturityMin;
+    d.m_Commitment = comm;
+    d.m_Maturity = hMaturityMin;
     kMin = d;
     d.m_Maturity = Height(-1);
     kMax = d;
@@ -2656,8 +3064,28 @@ void Node::Peer::OnMsg(proto::GetProofUtxo&& msg)
     t.m_pBound[1] = kMax.m_pArr;
 
     t.m_pTree->Traverse(t);
+}
+
+void Node::Peer::OnMsg(proto::GetProofUtxo&& msg)
+{
+    proto::ProofUtxo msgOut;
+    get_ProofUtxo(msgOut.m_Proofs, msg.m_Utxo, msg.m_MaturityMin);
+    Send(msgOut);
+}
+
+void Node::Peer::OnMsg(proto::GetProofUtxoMulti&& msg)
+{
+    if ((msg.m_Utxos.size() > proto::g_ProofUtxoMultiMaxSize) || !std::is_sorted(msg.m_Utxos.begin(), msg.m_Utxos.end()))
+        ThrowUnexpected();
+
+    // in the sorted order the neighbor proofs share the longest part of the path
+    std::vector<std::vector<Input::Proof> > vProofs(msg.m_Utxos.size());
+    for (size_t i = 0; i < msg.m_Utxos.size(); i++)
+        get_ProofUtxo(vProofs[i], msg.m_Utxos[i], 0);
 
-    Send(t.m_Msg);
+    proto::ProofUtxoMulti msgOut;
+    proto::PackProofUtxoMulti(msgOut, vProofs);
+    Send(msgOut);
 }
 
 bool Node::Processor::BuildCwp()
@@ -2672,12 +3100,22 @@ bool Node::Processor::BuildCwp()
         :public Block::ChainWorkProof::ISource
     {
         Processor& m_Proc;
+        CwpStatesMap m_mapUsed;
         Source(Processor& proc) :m_Proc(proc) {}
 
         virtual void get_StateAt(Block::SystemState::Full& s, const Difficulty::Raw& d) override
         {
-            uint64_t rowid = m_Proc.get_DB().FindStateWorkGreater(d);
-            m_Proc.get_DB().get_State(rowid, s);
+            // the active chain states cover the work axis contiguously, [ChainWork - Difficulty, ChainWork)
+            CwpStatesMap::iterator it = m_Proc.m_mapCwpStates.upper_bound(d);
+            if ((m_Proc.m_mapCwpStates.end() != it) && (it->second.m_ChainWork - it->second.m_PoW.m_Difficulty <= d))
+                s = it->second;
+            else
+            {
+                uint64_t rowid = m_Proc.get_DB().FindStateWorkGreater(d);
+                m_Proc.get_DB().get_State(rowid, s);
+            }
+
+            m_mapUsed[s.m_ChainWork] = s;
         }
 
         virtual void get_Proof(Merkle::IProofBuilder& bld, Height h) override
@@ -2692,21 +3130,44 @@ bool Node::Processor::BuildCwp()
     m_Cwp.Create(src, m_Cursor.m_Full);
     get_Utxos().get_Hash(m_Cwp.m_hvRootLive);
 
+    src.m_mapUsed[m_Cursor.m_Full.m_ChainWork] = m_Cursor.m_Full;
+    m_mapCwpStates.swap(src.m_mapUsed);
+
     return true;
 }
 
-void Node::Peer::OnMsg(proto::GetProofChainWork&& msg)
+const ByteBuffer& Node::Processor::get_CwpCropped(const Difficulty::Raw& lowerBound)
 {
-    proto::ProofChainWork msgOut;
+    auto it = m_mapCwpCropped.find(lowerBound);
+    if (m_mapCwpCropped.end() != it)
+        return it->second;
 
-    Processor& p = m_This.m_Processor;
-    if (p.BuildCwp())
+    if (m_mapCwpCropped.size() >= s_CwpCroppedMax)
+        m_mapCwpCropped.clear();
+
+    proto::ProofChainWork msg;
+    Serializer ser;
+
+    if (!BuildCwp())
     {
-        msgOut.m_Proof.m_LowerBound = msg.m_LowerBound;
-        verify(msgOut.m_Proof.Crop(p.m_Cwp));
+        ser & msg;
+        ser.swap_buf(m_CwpNone);
+        return m_CwpNone;
     }
 
-    Send(msgOut);
+    msg.m_Proof.m_LowerBound = lowerBound;
+    verify(msg.m_Proof.Crop(m_Cwp, true));
+
+    ser & msg;
+
+    ByteBuffer& buf = m_mapCwpCropped[lowerBound];
+    ser.swap_buf(buf);
+    return buf;
+}
+
+void Node::Peer::OnMsg(proto::GetProofChainWork&& msg)
+{
+    SendRaw(proto::ProofChainWork::s_Code, m_This.m_Processor.get_CwpCropped(msg.m_LowerBound));
 }
 
 void Node::Peer::OnMsg(proto::PeerInfoSelf&& msg)
@@ -2973,13 +3434,27 @@ void Node::Peer::OnMsg(proto::MacroblockGet&& msg)
         ThrowUnexpected();
 
     proto::Macroblock msgOut;
+    bool bRequestFull = false;
 
     if (m_This.m_Cfg.m_HistoryCompression.m_UploadPortion)
     {
         Processor& p = m_This.m_Processor;
+        bool bLatest = true;
+
         NodeDB::WalkerState ws(p.get_DB());
-        for (p.get_DB().EnumMacroblocks(ws); ws.MoveNext(); )
+        for (p.get_DB().EnumMacroblocks(ws); ws.MoveNext(); bLatest = false)
         {
+            // only the self-contained ones can be downloaded
+            if (!m_This.m_Compressor.IsFull(ws.m_Sid.m_Height))
+            {
+                if (bLatest && !msg.m_ID.m_Height)
+                    bRequestFull = true; // meanwhile the older one is offered
+                continue;
+            }
+
+            if (!(proto::LoginFlags::Extension3 & m_LoginFlags) && (Block::BodyBase::RW::Format::Legacy != m_This.m_Compressor.get_Format(ws.m_Sid.m_Height)))
+                continue; // the peer can't read it
+
             Block::SystemState::ID id;
             p.get_DB().get_StateID(ws.m_Sid, id);
 
@@ -2999,7 +3474,10 @@ void Node::Peer::OnMsg(proto::MacroblockGet&& msg)
                 rw.GetPath(sPath, msg.m_Data);
 
                 std::FStream fs;
-                if (fs.Open(sPath.c_str(), true) && (fs.get_Remaining() > msg.m_Offset))
+                if (fs.Open(sPath.c_str(), true))
+                    msgOut.m_SizeTotal = fs.get_Remaining(); // of this stream, lets the peer download the portions in parallel
+
+                if (fs.IsOpen() && (fs.get_Remaining() > msg.m_Offset))
                 {
                     uint64_t nDelta = fs.get_Remaining() - msg.m_Offset;
 
@@ -3021,6 +3499,9 @@ void Node::Peer::OnMsg(proto::MacroblockGet&& msg)
         }
     }
 
+    if (bRequestFull)
+        m_This.m_Compressor.RequestFull(); // after the enumeration is closed, it uses the same query
+
     Send(msgOut);
 }
 
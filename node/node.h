@@ -49,6 +49,7 @@ struct Node
 		struct Timeout {
 			uint32_t m_GetState_ms	= 1000 * 5;
 			uint32_t m_GetBlock_ms	= 1000 * 30;
+			uint32_t m_BlockStall_ms = 1000 * 10; // the block the cursor waits for. If not received in time - it's reassigned to another peer
 			uint32_t m_GetTx_ms		= 1000 * 5;
 			uint32_t m_GetBbsMsg_ms	= 1000 * 10;
 			uint32_t m_MiningSoftRestart_ms = 1000;
@@ -60,7 +61,8 @@ struct Node
 			uint32_t m_BbsChannelUpdate_ms = 60 * 5; // 5 minutes
 		} m_Timeout;
 
-		uint32_t m_MaxConcurrentBlocksRequest = 5;
+		uint32_t m_MaxConcurrentBlocksRequest = 5; // per peer
+		uint32_t m_MaxBlocksBacklog = 128; // blocks requested ahead of the cursor, spread across the peers (at most m_MaxConcurrentBlocksRequest per peer)
 		uint32_t m_BbsIdealChannelPopulation = 100;
 		uint32_t m_MaxPoolTransactions = 100 * 1000;
 		uint32_t m_MiningThreads = 0; // by default disabled
@@ -72,6 +74,16 @@ struct Node
 		// negative: number of cores minus number of mining threads.
 		int m_VerificationThreads = 0;
 
+		// Number of I/O threads that decrypt and deserialize the inbound traffic of the peers.
+		// 0: everything is done on the reactor thread
+		uint32_t m_IoThreads = 0;
+
+		// Max num of utxos (and kernels) verified and applied at once during the macroblock import (fast-sync)
+		uint32_t m_ImportWindow = 10000;
+
+		NodeDB::Tuning m_DbTuning;
+		uint64_t m_DbCommitBytes = 32 * 1024 * 1024; // commit once that much is written, even if the node is busy. 0: only when idle
+
 		bool m_Bbs = true;
 		bool m_BbsAllowV0 = true; // allow older format, without pow
 
@@ -88,8 +100,13 @@ struct Node
 			std::string m_sPathTmp;
 
 			uint32_t m_Naggling = 32;			// combine up to 32 blocks in memory, before involving file system
+			uint32_t m_MergeFanIn = 8;			// number of files merged in a single pass
 			uint32_t m_MaxBacklog = 7;
 
+			// The history is kept as a stack of segments, the newly compressed range is merged only with the few newest ones.
+			uint32_t m_SegmentRatio = 4;		// merge the segment underneath if it's not bigger than the merged data times this ratio
+			uint32_t m_MaxSegments = 8;			// set to 1 to always rewrite the whole history
+
 			uint32_t m_UploadPortion = 5 * 1024 * 1024; // set to 0 to disable upload
 
 		} m_HistoryCompression;
@@ -108,6 +125,7 @@ struct Node
 			uint32_t m_SrcPeers = 5;
 			uint32_t m_Timeout_ms = 10 * 1000; // timeout since at least 1 tip is received
 			uint32_t m_TimeoutHi_ms = 60 * 1000; // timeout since at least 1 peer connected.
+			uint32_t m_MaxPortionsAhead = 16; // per data stream, received out of order and buffered until the gap is filled
 
 			bool m_ForceResync = false;
 			bool m_NoFastSync = false;
@@ -181,9 +199,11 @@ private:
 		void OnNewState() override;
 		void OnRolledBack() override;
 		bool VerifyBlock(const Block::BodyBase&, TxBase::IReader&&, const HeightRange&) override;
+		bool ValidateAndSummarize(TxBase::Context&, const TxBase&, TxBase::IReader&&) override;
 		void AdjustFossilEnd(Height&) override;
-		bool OpenMacroblock(Block::BodyBase::RW&, const NodeDB::StateID&) override;
+		bool OpenMacroblock(Block::BodyBase::MultiRW&, const NodeDB::StateID&) override;
 		void OnModified() override;
+		uint32_t get_MaxThreads() override;
 		bool EnumViewerKeys(IKeyWalker&) override;
 		void OnUtxoEvent(const UtxoEvent::Key&, const UtxoEvent::Value&) override;
 
@@ -215,6 +235,18 @@ private:
 		Block::ChainWorkProof m_Cwp; // cached
 		bool BuildCwp();
 
+		// The states sampled for the last proof, by their chainwork. The new proof is built for the new tip, but mostly samples the same states
+		// (all the recent ones are included). Trimmed on rollback, so that only the active chain states remain.
+		typedef std::map<Difficulty::Raw, Block::SystemState::Full> CwpStatesMap;
+		CwpStatesMap m_mapCwpStates;
+
+		// Cropped proofs, by the lower bound. Typically many clients ask with the same bound (their last confirmed tip).
+		// Kept serialized (the ProofChainWork message body), sent as-is
+		std::map<Difficulty::Raw, ByteBuffer> m_mapCwpCropped;
+		static const size_t s_CwpCroppedMax = 64;
+		ByteBuffer m_CwpNone; // the empty proof, in case it can't be built. Not cached, the next request retries
+		const ByteBuffer& get_CwpCropped(const Difficulty::Raw& lowerBound);
+
 		void GenerateProofStateStrict(Merkle::HardProof&, Height);
 
 		bool m_bFlushPending = false;
@@ -232,6 +264,8 @@ private:
 
 	TxPool::Fluff m_TxPool;
 
+	proto::NodeConnection::IoPool m_IoPool; // must outlive the peers
+
 	struct Peer;
 
 	struct Task
@@ -272,10 +306,32 @@ private:
 		Block::SystemState::ID m_Trg;
 
 		uint32_t m_RequestsPending = 0;
-		uint8_t m_iData = 0;
 
 		uint64_t m_SizeTotal;
 		uint64_t m_SizeCompleted;
+
+		// During the 2nd phase the data streams are downloaded concurrently, each one in disjoint portions from different peers.
+		// The portions are appended to the files in order, hence the file size is the persistent progress, and the download resumes from there.
+		// Portions received ahead are kept in memory until the gap is filled.
+		struct Stream
+		{
+			uint64_t m_SizeTotal = 0; // 0 if not known yet
+			uint64_t m_SizeDone = 0; // appended to the file
+			uint64_t m_OffsetNext = 0; // next portion to request
+			uint32_t m_Pending = 0; // requests in flight
+			uint32_t m_Generation = 0; // incremented on restart, the responses to the older requests are discarded
+			bool m_bDone = false;
+			bool m_bSequential = false; // the peers disagreed on the size, the stream is downloaded as a whole from one peer at a time
+
+			std::map<uint64_t, ByteBuffer> m_mapAhead;
+			std::map<uint64_t, uint64_t> m_mapMissing; // offset -> size. Portions to request again (peer dropped or sent less)
+
+			bool get_Next(uint64_t& nOffset, uint64_t& nSize, uint32_t nPortion, uint32_t nMaxAhead);
+			void OnLost(uint64_t nOffset, uint64_t nSize);
+		};
+
+		Stream m_pStream[Block::Body::RW::Type::count];
+		uint32_t m_nPortion = 0; // the portion size used by the peers, learned from the responses. Used to split the streams
 	};
 
 	void UpdateSyncStatus();
@@ -284,12 +340,16 @@ private:
 	void OnSyncTimer();
 	void SyncCycle();
 	bool SyncCycle(Peer&);
-	void SyncCycle(Peer&, const ByteBuffer&);
+	void SyncCycle(Peer&, const proto::Macroblock&);
+	void RestartSyncStream(uint8_t iData);
+	void OnSyncLost(Peer&);
+	void WriteSyncPortion(uint8_t iData, const ByteBuffer&, size_t nSize);
 
 	std::unique_ptr<FirstTimeSync> m_pSync;
 
 	void TryAssignTask(Task&, const PeerID*);
 	bool TryAssignTask(Task&, Peer&);
+	bool TryAssignBlockTask(Task&); // to the peer that's expected to deliver it first
 	void DeleteUnassignedTask(Task&);
 
 	void InitKeys();
@@ -468,6 +528,17 @@ private:
 		io::Timer::Ptr m_pTimer;
 		io::Timer::Ptr m_pTimerPeers;
 
+		uint32_t m_FirstTask_ms; // when the current first task started
+		uint32_t m_BlockLatency_ms; // moving average of the block response time, 0 if not measured yet
+		uint32_t m_nBlocksStalled; // block requests reassigned to other peers. Their responses precede the others, and are ignored
+		bool m_bStallTimer; // the timer is for the stalled block, not the request timeout
+
+		// the macroblock portion requested, valid if SyncPending
+		uint8_t m_iSyncData;
+		uint64_t m_SyncOffset;
+		uint64_t m_SyncSize; // 0 if the stream size isn't known yet, then the whole remaining is requested
+		uint32_t m_SyncGeneration;
+
 		Peer(Node& n) :m_This(n) {}
 
 		void TakeTasks();
@@ -477,6 +548,8 @@ private:
 		void Unsubscribe(Bbs::Subscription&);
 		void Unsubscribe();
 		void OnTimer();
+		void OnBlockStalled();
+		bool OnStalledBlockResponse();
 		void SetTimer(uint32_t timeout_ms);
 		void KillTimer();
 		void OnResendPeers();
@@ -491,6 +564,8 @@ private:
 
 		bool IsChocking(size_t nExtra = 0);
 		bool ShouldAssignTasks();
+		bool CanServe(const Task&);
+		uint32_t get_BlocksInProgress() const;
 		bool ShouldFinalizeMining();
 		Task& get_FirstTask();
 		void OnFirstTaskDone();
@@ -499,6 +574,7 @@ private:
 		void OnMsg(const proto::BbsMsg&, bool bNonceValid);
 
 		void SendTx(Transaction::Ptr& ptx, bool bFluff);
+		void get_ProofUtxo(std::vector<Input::Proof>&, const ECC::Point&, Height hMaturityMin);
 
 		// proto::NodeConnection
 		virtual void OnConnectedSecure() override;
@@ -525,6 +601,7 @@ private:
 		virtual void OnMsg(proto::GetProofKernel&&) override;
 		virtual void OnMsg(proto::GetProofKernel2&&) override;
 		virtual void OnMsg(proto::GetProofUtxo&&) override;
+		virtual void OnMsg(proto::GetProofUtxoMulti&&) override;
 		virtual void OnMsg(proto::GetProofChainWork&&) override;
 		virtual void OnMsg(proto::PeerInfoSelf&&) override;
 		virtual void OnMsg(proto::PeerInfo&&) override;
@@ -663,14 +740,20 @@ private:
 		void OnNewState();
 		void FmtPath(std::string&, Height, const Height* pH0);
 		void FmtPath(Block::BodyBase::RW&, Height, const Height* pH0);
+		void get_Segments(std::vector<Height>&, Height); // tops of the segments, from the oldest
+		void OpenMacroblock(Block::BodyBase::MultiRW&, Height);
+		bool IsFull(Height); // consists of a single segment
+		uint8_t get_Format(Height);
+		void RequestFull(); // merge all the segments of the latest macroblock (in the background), so that it can be uploaded
 		void StopCurrent();
 
 		void OnNotify();
 		void Proceed();
 		bool ProceedInternal();
-		bool SquashOnce(std::vector<HeightRange>&);
-		bool SquashOnce(Block::BodyBase::RW&, Block::BodyBase::RW& rwSrc0, Block::BodyBase::RW& rwSrc1);
+		bool SquashOnce(std::vector<HeightRange>&, uint32_t nSrc); // merges the last nSrc ranges
+		bool SquashOnce(Block::BodyBase::RW&, Block::BodyBase::RW* pSrc, uint32_t nSrc);
 		uint64_t get_SizeTotal(Height);
+		static uint64_t get_SizeTotal(const Block::BodyBase::RW&);
 
 		PerThread m_Link;
 		std::mutex m_Mutex;
@@ -679,11 +762,14 @@ private:
 		volatile bool m_bStop;
 		bool m_bEnabled;
 		bool m_bSuccess;
+		bool m_bFullRequested;
+		bool m_bMergeAll; // current task should produce a self-contained macroblock
 
 		// current data exchanged
 		HeightRange m_hrNew; // requested range. If min is non-zero - should be merged with previously-generated
 		HeightRange m_hrInplaceRequest;
 		Merkle::Hash m_hvTag;
+		Height m_hOutMin; // the lower bound of the generated segment
 
 		IMPLEMENT_GET_PARENT_OBJ(Node, m_Compressor)
 	} m_Compressor;
@@ -21,6 +21,8 @@ void Node::Compressor::Init()
 {
 	ZeroObject(m_hrNew);
 	m_bStop = true;
+	m_bFullRequested = false;
+	m_bMergeAll = false;
 	m_bEnabled = !get_ParentObj().m_Cfg.m_HistoryCompression.m_sPathOutput.empty();
 
 	if (m_bEnabled)
@@ -34,34 +36,43 @@ void Node::Compressor::Init()
 
 void Node::Compressor::Cleanup()
 {
-	// delete missing datas, delete exceeding backlog
+	// delete missing datas, delete exceeding backlog.
+	// Segments of the remaining macroblocks are kept, as well as the most recent self-contained one (this is what we upload)
 	Processor& p = get_ParentObj().m_Processor;
 
 	uint32_t nBacklog = get_ParentObj().m_Cfg.m_HistoryCompression.m_MaxBacklog + 1;
+	bool bFull = false;
+	std::set<Height> setKeep;
+	std::vector<Height> vSeg;
 
 	NodeDB::WalkerState ws(p.get_DB());
 	for (p.get_DB().EnumMacroblocks(ws); ws.MoveNext(); )
 	{
-		if (nBacklog)
-		{
-			// check if it's valid
-			try {
+		bool bKeep = setKeep.end() != setKeep.find(ws.m_Sid.m_Height);
+
+		// check if it's valid
+		try {
 
-				Block::BodyBase::RW rw;
-				FmtPath(rw, ws.m_Sid.m_Height, NULL);
-				rw.ROpen();
+			get_Segments(vSeg, ws.m_Sid.m_Height);
+			bool bThisFull = (1 == vSeg.size());
 
-				Block::BodyBase body;
-				Block::SystemState::Sequence::Prefix prf;
-				rw.get_Start(body, prf);
+			if (nBacklog || (bThisFull && !bFull))
+				bKeep = true;
 
+			if (bKeep)
+			{
 				// ok
-				nBacklog--;
-				continue;
+				if (nBacklog)
+					nBacklog--;
+				if (bThisFull)
+					bFull = true;
 
-			} catch (const std::exception& e) {
-				LOG_WARNING() << "History at height " << ws.m_Sid.m_Height << " corrupted: " << e.what();
+				setKeep.insert(vSeg.begin(), vSeg.end());
+				continue;
 			}
+
+		} catch (const std::exception& e) {
+			LOG_WARNING() << "History at height " << ws.m_Sid.m_Height << " corrupted: " << e.what();
 		}
 
 		Delete(ws.m_Sid);
@@ -124,9 +135,19 @@ void Node::Compressor::OnNewState()
 	hr.m_Min = ws.MoveNext() ? ws.m_Sid.m_Height : 0;
 
 	if (hr.m_Min >= hr.m_Max)
-		return;
+	{
+		// nothing new. Still may need to merge the segments of the latest one
+		if (!m_bFullRequested || !hr.m_Min || IsFull(hr.m_Min))
+			return;
+
+		hr.m_Max = hr.m_Min;
+		LOG_INFO() << "History merge of all the segments at height " << hr.m_Max;
+	}
+	else
+		LOG_INFO() << "History generation started up to height " << hr.m_Max;
 
-	LOG_INFO() << "History generation started up to height " << hr.m_Max;
+	m_bMergeAll = m_bFullRequested;
+	m_bFullRequested = false;
 
 	// Start aggregation
 	m_hrNew = hr;
@@ -157,6 +178,88 @@ void Node::Compressor::FmtPath(std::string& out, Height h, const Height* pH0)
 	out = str.str();
 }
 
+void Node::Compressor::get_Segments(std::vector<Height>& v, Height h)
+{
+	v.clear();
+
+	while (true)
+	{
+		Block::BodyBase::RW rw;
+		FmtPath(rw, h, NULL);
+		rw.ROpen();
+
+		Block::BodyBase body;
+		Block::SystemState::Sequence::Prefix prf;
+		rw.get_Start(body, prf);
+
+		v.push_back(h);
+
+		if (prf.m_Height <= Rules::HeightGenesis)
+			break;
+
+		if (prf.m_Height > h)
+			throw std::runtime_error("bad segment");
+
+		h = prf.m_Height - 1; // the top of the segment underneath
+	}
+
+	std::reverse(v.begin(), v.end());
+}
+
+void Node::Compressor::RequestFull()
+{
+	if (!m_bEnabled)
+		return;
+
+	m_bFullRequested = true;
+	OnNewState(); // if busy - will be handled after the current task
+}
+
+bool Node::Compressor::IsFull(Height h)
+{
+	try {
+		Block::BodyBase::RW rw;
+		FmtPath(rw, h, NULL);
+		rw.ROpen();
+
+		Block::BodyBase body;
+		Block::SystemState::Sequence::Prefix prf;
+		rw.get_Start(body, prf);
+
+		return prf.m_Height <= Rules::HeightGenesis;
+
+	} catch (const std::exception&) {
+		return false;
+	}
+}
+
+uint8_t Node::Compressor::get_Format(Height h)
+{
+	try {
+		Block::BodyBase::RW rw;
+		FmtPath(rw, h, NULL);
+		rw.ROpen();
+
+		return rw.m_Format;
+
+	} catch (const std::exception&) {
+		return Block::BodyBase::RW::Format::Latest;
+	}
+}
+
+void Node::Compressor::OpenMacroblock(Block::BodyBase::MultiRW& rw, Height h)
+{
+	std::vector<Height> vSeg;
+	get_Segments(vSeg, h);
+
+	for (size_t i = 0; i < vSeg.size(); i++)
+	{
+		Block::BodyBase::RW& rwSeg = rw.AddSegment();
+		FmtPath(rwSeg, vSeg[i], NULL);
+		rwSeg.ROpen();
+	}
+}
+
 void Node::Compressor::OnNotify()
 {
 	assert(m_hrNew.m_Max);
@@ -188,12 +291,13 @@ void Node::Compressor::OnNotify()
 	else
 	{
 		Height h = m_hrNew.m_Max;
+		bool bMergeOnly = (m_hrNew.m_Min == h); // the macroblock at this height is replaced, not added
 		StopCurrent();
 
 		if (m_bSuccess)
 		{
 			Block::Body::RW rwSrc, rwTrg;
-			FmtPath(rwSrc, h, &Rules::HeightGenesis);
+			FmtPath(rwSrc, h, &m_hOutMin);
 			FmtPath(rwTrg, h, NULL);
 
 			for (int i = 0; i < Block::Body::RW::Type::count; i++)
@@ -203,14 +307,21 @@ void Node::Compressor::OnNotify()
 				rwSrc.GetPath(sSrc, i);
 				rwTrg.GetPath(sTrg, i);
 
+				// The stream may be missing in the new output (e.g. all the inputs are cut-through). When replaced in-place - the previous one must not survive
 #ifdef WIN32
-				bool bOk =
-					MoveFileExW(Utf8toUtf16(sSrc.c_str()).c_str(), Utf8toUtf16(sTrg.c_str()).c_str(), MOVEFILE_REPLACE_EXISTING) ||
-					(GetLastError() == ERROR_FILE_NOT_FOUND);
+				bool bOk = MoveFileExW(Utf8toUtf16(sSrc.c_str()).c_str(), Utf8toUtf16(sTrg.c_str()).c_str(), MOVEFILE_REPLACE_EXISTING);
+				if (!bOk && (GetLastError() == ERROR_FILE_NOT_FOUND))
+					bOk =
+						!bMergeOnly ||
+						DeleteFileW(Utf8toUtf16(sTrg.c_str()).c_str()) ||
+						(GetLastError() == ERROR_FILE_NOT_FOUND);
 #else // WIN32
-				bool bOk =
-					!rename(sSrc.c_str(), sTrg.c_str()) ||
-					(ENOENT == errno);
+				bool bOk = !rename(sSrc.c_str(), sTrg.c_str());
+				if (!bOk && (ENOENT == errno))
+					bOk =
+						!bMergeOnly ||
+						!remove(sTrg.c_str()) ||
+						(ENOENT == errno);
 #endif // WIN32
 
 				if (!bOk)
@@ -224,23 +335,38 @@ void Node::Compressor::OnNotify()
 			if (!m_bSuccess)
 			{
 				rwSrc.Delete();
-				rwTrg.Delete();
+
+				if (bMergeOnly)
+				{
+					// may be partially replaced
+					NodeDB::StateID sid;
+					sid.m_Height = h;
+					sid.m_Row = get_ParentObj().m_Processor.FindActiveAtStrict(h);
+					Delete(sid);
+				}
+				else
+					rwTrg.Delete();
 			}
 		}
 
 		if (m_bSuccess)
 		{
-			uint64_t rowid = get_ParentObj().m_Processor.FindActiveAtStrict(h);
-			get_ParentObj().m_Processor.get_DB().MacroblockIns(rowid);
-			get_ParentObj().m_Processor.FlushDB();
+			if (!bMergeOnly)
+			{
+				uint64_t rowid = get_ParentObj().m_Processor.FindActiveAtStrict(h);
+				get_ParentObj().m_Processor.get_DB().MacroblockIns(rowid);
+				get_ParentObj().m_Processor.FlushDB();
+			}
 
-			LOG_INFO() << "History generated up to height " << h;
+			LOG_INFO() << "History generated up to height " << h << ", segment from " << m_hOutMin;
 
 			Cleanup();
 		}
 		else
 			LOG_WARNING() << "History generation failed";
 
+		if (m_bFullRequested)
+			OnNewState();
 	}
 }
 
@@ -283,7 +409,31 @@ bool Node::Compressor::ProceedInternal()
 	assert(m_hrNew.m_Max);
 	const Config::HistoryCompression& cfg = get_ParentObj().m_Cfg.m_HistoryCompression;
 
+	if (m_hrNew.m_Min == m_hrNew.m_Max)
+	{
+		// no new blocks, only merge all the segments
+		std::vector<Height> vSeg;
+		get_Segments(vSeg, m_hrNew.m_Max);
+
+		std::vector<Block::Body::RW> vSrc(vSeg.size());
+		for (size_t k = 0; k < vSeg.size(); k++)
+			FmtPath(vSrc[k], vSeg[k], NULL);
+
+		m_hOutMin = Rules::HeightGenesis;
+
+		Block::Body::RW rw;
+		FmtPath(rw, m_hrNew.m_Max, &m_hOutMin);
+		rw.m_bAutoDelete = true;
+
+		if (!SquashOnce(rw, &vSrc.front(), static_cast<uint32_t>(vSrc.size())))
+			return false;
+
+		rw.m_bAutoDelete = false;
+		return true;
+	}
+
 	std::vector<HeightRange> v;
+	const uint32_t nFanIn = std::max(cfg.m_MergeFanIn, 2U);
 
 	uint32_t i = 0;
 	for (Height hPos = m_hrNew.m_Min; hPos < m_hrNew.m_Max; i++)
@@ -307,82 +457,125 @@ bool Node::Compressor::ProceedInternal()
 		v.push_back(hr);
 		hPos = hr.m_Max;
 
-		for (uint32_t j = i; 1 & j; j >>= 1)
-			SquashOnce(v);
+		// k-ary counter: each time there are enough ranges of the same level - merge them in a single pass
+		for (uint32_t j = i + 1; !(j % nFanIn); j /= nFanIn)
+			if (!SquashOnce(v, nFanIn))
+				return false;
 	}
 
 	while (v.size() > 1)
-		SquashOnce(v);
+		if (!SquashOnce(v, std::min(nFanIn, static_cast<uint32_t>(v.size()))))
+			return false;
+
+	m_hOutMin = m_hrNew.m_Min + 1;
 
 	if (m_hrNew.m_Min >= Rules::HeightGenesis)
 	{
-		Block::Body::RW rw, rwSrc0, rwSrc1;
+		// Merge into the newest segments, while they're not too big wrt the merged data.
+		// The older history is left intact, so the amortized cost doesn't grow with the chain length.
+		std::vector<Height> vSeg;
+		get_Segments(vSeg, m_hrNew.m_Min);
 
-		FmtPath(rw, m_hrNew.m_Max, &Rules::HeightGenesis);
-		FmtPath(rwSrc0, m_hrNew.m_Min, NULL);
+		uint64_t nSize;
+		{
+			Block::Body::RW rwAcc;
+			FmtPath(rwAcc, m_hrNew.m_Max, &m_hOutMin);
+			nSize = get_SizeTotal(rwAcc);
+		}
 
-		Height h0 = m_hrNew.m_Min + 1;
-		FmtPath(rwSrc1, m_hrNew.m_Max, &h0);
+		uint32_t nMerge = 0;
+		for (; nMerge < vSeg.size(); nMerge++)
+		{
+			uint64_t nSizeSeg = get_SizeTotal(vSeg[vSeg.size() - nMerge - 1]);
 
-		rw.m_bAutoDelete = rwSrc1.m_bAutoDelete = true;
+			if (!m_bMergeAll && (vSeg.size() - nMerge < cfg.m_MaxSegments) && (nSizeSeg > nSize * cfg.m_SegmentRatio))
+				break;
 
-		if (!SquashOnce(rw, rwSrc0, rwSrc1))
-			return false;
+			nSize += nSizeSeg; // just an estimation, w/o cut-through
+		}
 
-		rw.m_bAutoDelete = false;
+		if (nMerge)
+		{
+			// all at once
+			std::vector<Block::Body::RW> vSrc(nMerge + 1);
+			for (uint32_t k = 0; k < nMerge; k++)
+				FmtPath(vSrc[k], vSeg[vSeg.size() - nMerge + k], NULL);
+
+			FmtPath(vSrc[nMerge], m_hrNew.m_Max, &m_hOutMin);
+			vSrc[nMerge].m_bAutoDelete = true;
+
+			Height h0 = (vSeg.size() > nMerge) ? (vSeg[vSeg.size() - nMerge - 1] + 1) : Rules::HeightGenesis;
+
+			Block::Body::RW rw;
+			FmtPath(rw, m_hrNew.m_Max, &h0);
+			rw.m_bAutoDelete = true;
+
+			if (!SquashOnce(rw, &vSrc.front(), nMerge + 1))
+				return false;
+
+			rw.m_bAutoDelete = false;
+			m_hOutMin = h0;
+		}
 	}
 
 	return true;
 }
 
-bool Node::Compressor::SquashOnce(std::vector<HeightRange>& v)
+bool Node::Compressor::SquashOnce(std::vector<HeightRange>& v, uint32_t nSrc)
 {
-	assert(v.size() >= 2);
+	assert((nSrc >= 2) && (v.size() >= nSrc));
 
-	HeightRange& hr0 = v[v.size() - 2];
-	HeightRange& hr1 = v[v.size() - 1];
+	HeightRange* pHr = &v[v.size() - nSrc];
 
-	Block::Body::RW rw, rwSrc0, rwSrc1;
-	FmtPath(rw, hr1.m_Max, &hr0.m_Min);
-	FmtPath(rwSrc0, hr0.m_Max, &hr0.m_Min);
-	FmtPath(rwSrc1, hr1.m_Max, &hr1.m_Min);
+	Block::Body::RW rw;
+	FmtPath(rw, v.back().m_Max, &pHr[0].m_Min);
+
+	std::vector<Block::Body::RW> vSrc(nSrc);
+	for (uint32_t k = 0; k < nSrc; k++)
+	{
+		FmtPath(vSrc[k], pHr[k].m_Max, &pHr[k].m_Min);
+		vSrc[k].m_bAutoDelete = true;
+	}
 
-	hr0.m_Max = hr1.m_Max;
-	v.pop_back();
+	pHr[0].m_Max = v.back().m_Max;
+	v.resize(v.size() - nSrc + 1);
 
-	rw.m_bAutoDelete = rwSrc0.m_bAutoDelete = rwSrc1.m_bAutoDelete = true;
+	rw.m_bAutoDelete = true;
 
-	if (!SquashOnce(rw, rwSrc0, rwSrc1))
+	if (!SquashOnce(rw, &vSrc.front(), nSrc))
 		return false;
 
 	rw.m_bAutoDelete = false;
 	return true;
 }
 
-bool Node::Compressor::SquashOnce(Block::BodyBase::RW& rw, Block::BodyBase::RW& rwSrc0, Block::BodyBase::RW& rwSrc1)
+bool Node::Compressor::SquashOnce(Block::BodyBase::RW& rw, Block::BodyBase::RW* pSrc, uint32_t nSrc)
 {
-	rwSrc0.ROpen();
-	rwSrc1.ROpen();
+	std::vector<Block::BodyBase::IMacroReader*> vSrc(nSrc);
+	for (uint32_t k = 0; k < nSrc; k++)
+	{
+		pSrc[k].ROpen();
+		vSrc[k] = pSrc + k;
+	}
 
 	rw.m_hvContentTag = m_hvTag;
 	rw.WCreate();
 
-	if (!rw.CombineHdr(std::move(rwSrc0), std::move(rwSrc1), m_bStop))
-		return false;
-
-	if (!rw.Combine(std::move(rwSrc0), std::move(rwSrc1), m_bStop))
-		return false;
-
-	return true;
+	return rw.CombineMT(&vSrc.front(), static_cast<int>(nSrc), m_bStop);
 }
 
 uint64_t Node::Compressor::get_SizeTotal(Height h)
 {
-	uint64_t ret = 0;
-
 	Block::Body::RW rw;
 	FmtPath(rw, h, NULL);
 
+	return get_SizeTotal(rw);
+}
+
+uint64_t Node::Compressor::get_SizeTotal(const Block::BodyBase::RW& rw)
+{
+	uint64_t ret = 0;
+
 	for (uint8_t iData = 0; iData < Block::Body::RW::Type::count; iData++)
 	{
 		std::string sPath;
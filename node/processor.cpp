@@ -18,6 +18,7 @@
 #include "../utility/serialize.h"
 #include "../utility/logger.h"
 #include "../utility/logger_checkpoints.h"
+#include "../utility/parallel.h"
 
 namespace beam {
 
@@ -145,8 +146,8 @@ void NodeProcessor::EnumCongestions(uint32_t nMaxBlocksBacklog)
 
 		Height hTarget = sid.m_Height;
 		Height nBlocks = 0;
-		const uint32_t nMaxBlocks = 32;
-		uint64_t pBlockRow[nMaxBlocks];
+		const uint32_t nMaxBlocks = std::max(nMaxBlocksBacklog, 1U);
+		std::vector<uint64_t> pBlockRow(nMaxBlocks); // ring buffer of the lowest missing blocks
 
 		while (true)
 		{
@@ -173,18 +174,11 @@ void NodeProcessor::EnumCongestions(uint32_t nMaxBlocksBacklog)
 
 		if (nBlocks)
 		{
-			if (!nMaxBlocksBacklog)
-				nMaxBlocksBacklog = 1;
-			else
-			{
-				if (nMaxBlocksBacklog > nMaxBlocks)
-					nMaxBlocksBacklog = nMaxBlocks;
-
-				if (nMaxBlocksBacklog > nBlocks)
-					nMaxBlocksBacklog = static_cast<uint32_t>(nBlocks);
-			}
+			uint32_t nRequest = nMaxBlocks;
+			if (nRequest > nBlocks)
+				nRequest = static_cast<uint32_t>(nBlocks);
 
-			for (uint32_t i = 0; i < nMaxBlocksBacklog; i++)
+			for (uint32_t i = 0; i < nRequest; i++)
 			{
 				sid.m_Height++;
 				sid.m_Row = pBlockRow[(--nBlocks) % nMaxBlocks];
@@ -290,6 +284,9 @@ void NodeProcessor::TryGoUp()
 				bPathOk = false;
 				break;
 			}
+
+			if (m_CommitBytes && (m_DB.m_Stats.m_BytesDirty >= m_CommitBytes))
+				CommitDB();
 		}
 
 		if (bPathOk)
@@ -462,7 +459,7 @@ Height NodeProcessor::get_ProofKernel(Merkle::Proof& proof, TxKernel::Ptr* ppRes
 
 	if (h <= get_FossilHeight())
 	{
-		Block::Body::RW rw;
+		Block::BodyBase::MultiRW rw;
 		if (!OpenLatestMacroblock(rw))
 			OnCorrupted();
 
@@ -715,14 +712,14 @@ bool NodeProcessor::HandleBlock(const NodeDB::StateID& sid, bool bFwd)
 
 	if (bOk)
 	{
-		for (size_t i = 0; i < vKrnID.size(); i++)
+		if (bFwd)
 		{
-			const Merkle::Hash& hv = vKrnID[i];
-			if (bFwd)
-				m_DB.InsertKernel(hv, sid.m_Height);
-			else
-				m_DB.DeleteKernel(hv, sid.m_Height);
+			if (!vKrnID.empty())
+				m_DB.InsertKernels(&vKrnID.front(), static_cast<uint32_t>(vKrnID.size()), sid.m_Height);
 		}
+		else
+			for (size_t i = 0; i < vKrnID.size(); i++)
+				m_DB.DeleteKernel(vKrnID[i], sid.m_Height);
 
 		if (bFwd)
 		{
@@ -766,37 +763,54 @@ void NodeProcessor::RecognizeUtxos(TxBase::IReader&& r, Height hMax)
 		}
 	}
 
-	for (; r.m_pUtxoOut; r.NextUtxoOut())
-	{
-		const Output& x = *r.m_pUtxoOut;
+	// the recognized outputs are inserted in batches
+	std::vector<std::pair<UtxoEvent::Key, UtxoEvent::Value> > vOut;
+	std::vector<NodeDB::EventData> vData;
 
-		struct Walker :public IKeyWalker
-		{
-			const Output& m_Output;
-			UtxoEvent::Value m_Value;
+	struct KeyProbe :public IKeyWalker {
+		virtual bool OnKey(Key::IPKdf&, Key::Index) override { return false; }
+	} kp;
 
-			Walker(const Output& x) :m_Output(x) {}
+	if (EnumViewerKeys(kp))
+		return; // no keys
 
-			virtual bool OnKey(Key::IPKdf& tag, Key::Index) override
-			{
-				Key::IDV kidv;
-				if (!m_Output.Recover(tag, kidv))
-					return true; // continue enumeration
+	// The recovery (key derivation per output) dominates, it's done in parallel for a chunk of outputs.
+	// The reader may reuse its output object, hence the copies.
+	const size_t nChunk = 1024;
+	std::vector<Output::Ptr> vChunk;
+	std::vector<uint8_t> vFound;
+	std::vector<Key::IDV> vKidv;
 
-				m_Value.m_Kidv = kidv;
-				return false; // stop
-			}
-		};
+	while (r.m_pUtxoOut)
+	{
+		size_t n = 0;
+		for (; r.m_pUtxoOut && (n < nChunk); r.NextUtxoOut(), n++)
+		{
+			if (vChunk.size() == n)
+				vChunk.emplace_back(new Output);
+			*vChunk[n] = *r.m_pUtxoOut;
+		}
+
+		vFound.resize(n);
+		vKidv.resize(n);
+		RecognizeOutputs(&vChunk.front(), &vFound.front(), &vKidv.front(), n);
 
-		Walker w(x);
-		w.m_Value.m_Added = 1;
-		if (!EnumViewerKeys(w))
+		for (size_t i = 0; i < n; i++)
 		{
+			if (!vFound[i])
+				continue;
+
+			const Output& x = *vChunk[i];
+
+			UtxoEvent::Value evt;
+			evt.m_Added = 1;
+			evt.m_Kidv = vKidv[i];
+
 			// filter-out dummies
-			if (w.m_Value.m_Kidv.m_Value == Zero)
+			if (evt.m_Kidv.m_Value == Zero)
 			{
 				uint32_t nType;
-				w.m_Value.m_Kidv.m_Type.Export(nType);
+				evt.m_Kidv.m_Type.Export(nType);
 				if (Key::Type::Decoy == nType)
 					continue;
 			}
@@ -805,23 +819,38 @@ void NodeProcessor::RecognizeUtxos(TxBase::IReader&& r, Height hMax)
 			Height h;
 			if (x.m_Maturity)
 			{
-				w.m_Value.m_Maturity = x.m_Maturity;
+				evt.m_Maturity = x.m_Maturity;
 				// try to reverse-engineer the original block from the maturity
 				h = x.m_Maturity - x.get_MinMaturity(0);
 			}
 			else
 			{
 				h = hMax;
-				w.m_Value.m_Maturity = x.get_MinMaturity(h);
+				evt.m_Maturity = x.get_MinMaturity(h);
 			}
 
-			w.m_Value.m_AssetID = r.m_pUtxoOut->m_AssetID;
+			evt.m_AssetID = x.m_AssetID;
 
-			const UtxoEvent::Key& key = x.m_Commitment;
-			m_DB.InsertEvent(h, Blob(&w.m_Value, sizeof(w.m_Value)), Blob(&key, sizeof(key)));
-			OnUtxoEvent(key, w.m_Value);
+			vOut.emplace_back(x.m_Commitment, evt);
+			vData.emplace_back();
+			vData.back().m_Height = h;
 		}
 	}
+
+	if (vOut.empty())
+		return;
+
+	for (size_t i = 0; i < vOut.size(); i++)
+	{
+		// vOut won't be reallocated anymore
+		vData[i].m_Key = Blob(&vOut[i].first, sizeof(vOut[i].first));
+		vData[i].m_Body = Blob(&vOut[i].second, sizeof(vOut[i].second));
+	}
+
+	m_DB.InsertEvents(&vData.front(), static_cast<uint32_t>(vData.size()));
+
+	for (size_t i = 0; i < vOut.size(); i++)
+		OnUtxoEvent(vOut[i].first, vOut[i].second);
 }
 
 bool NodeProcessor::HandleValidatedTx(TxBase::IReader&& r, Height h, bool bFwd, const Height* pHMax)
@@ -1609,6 +1638,11 @@ bool NodeProcessor::VerifyBlock(const Block::BodyBase& block, TxBase::IReader&&
 	return block.IsValid(hr, std::move(r));
 }
 
+bool NodeProcessor::ValidateAndSummarize(TxBase::Context& ctx, const TxBase& txb, TxBase::IReader&& r)
+{
+	return ctx.ValidateAndSummarize(txb, std::move(r));
+}
+
 void NodeProcessor::ExtractBlockWithExtra(Block::Body& block, const NodeDB::StateID& sid)
 {
 	ByteBuffer bbP, bbE;
@@ -1829,21 +1863,10 @@ bool NodeProcessor::ImportMacroBlockInternal(Block::BodyBase::IMacroReader& r)
 		return false;
 	}
 
-	LOG_INFO() << "Context-free validation...";
-
-	if (!VerifyBlock(body, std::move(r), HeightRange(m_Cursor.m_ID.m_Height + 1, id.m_Height)))
-	{
-		LOG_WARNING() << "Context-free verification failed";
-		return false;
-	}
-
-	LOG_INFO() << "Applying macroblock...";
+	LOG_INFO() << "Verifying and applying macroblock...";
 
-	if (!HandleValidatedBlock(std::move(r), body, m_Cursor.m_ID.m_Height + 1, true, &id.m_Height))
-	{
-		LOG_WARNING() << "Invalid in its context";
+	if (!ImportMacroBlockBody(r, body, HeightRange(m_Cursor.m_ID.m_Height + 1, id.m_Height)))
 		return false;
-	}
 
 	// evaluate the Definition
 	Merkle::Hash hvDef, hv;
@@ -1907,7 +1930,162 @@ bool NodeProcessor::ImportMacroBlockInternal(Block::BodyBase::IMacroReader& r)
 	return true;
 }
 
-Height NodeProcessor::OpenLatestMacroblock(Block::Body::RW& rw)
+bool NodeProcessor::ImportMacroBlockBody(TxBase::IReader& r, const Block::BodyBase& body, const HeightRange& hr)
+{
+	// The elements are read in windows, each one is verified (in parallel, if supported) and applied, so that the memory consumption is bounded.
+	// The order and the cut-through are verified here, in a single pass. The verifiers only deal with the cryptography.
+	if ((hr.m_Min < Rules::HeightGenesis) || hr.IsEmpty())
+		return false;
+
+	TxBase::Context ctxTotal;
+	ctxTotal.m_Height = hr;
+	ctxTotal.m_bBlockMode = true;
+
+	TxBase txbZero; // the offset is accounted once, at the end
+	txbZero.m_Offset = Zero;
+
+	TxVectors::Full txv;
+	Input::Ptr pInpPrev;
+	Output::Ptr pOutPrev;
+	TxKernel::Ptr pKrnPrev;
+
+	uint64_t nInp = 0, nOut = 0; // applied so far
+	bool bOk = true;
+
+	for (r.Reset(); ; )
+	{
+		// keep the last elements, to verify the order across the windows
+		if (!txv.m_vInputs.empty())
+			pInpPrev = std::move(txv.m_vInputs.back());
+		if (!txv.m_vOutputs.empty())
+			pOutPrev = std::move(txv.m_vOutputs.back());
+		if (!txv.m_vKernels.empty())
+			pKrnPrev = std::move(txv.m_vKernels.back());
+
+		txv.m_vInputs.clear();
+		txv.m_vOutputs.clear();
+		txv.m_vKernels.clear();
+
+		if (!ReadImportWindow(r, txv, pInpPrev.get(), pOutPrev.get(), pKrnPrev.get()))
+		{
+			LOG_WARNING() << "Wrong order or redundant outputs";
+			bOk = false;
+			break;
+		}
+
+		if (txv.m_vInputs.empty() && txv.m_vOutputs.empty() && txv.m_vKernels.empty())
+			break;
+
+		TxBase::Context ctx;
+		ctx.m_Height = hr;
+		ctx.m_bBlockMode = true;
+		ctx.m_bVerifyOrder = false; // already checked
+
+		if (!ValidateAndSummarize(ctx, txbZero, txv.get_Reader()) || !ctxTotal.Merge(ctx))
+		{
+			LOG_WARNING() << "Context-free verification failed";
+			bOk = false;
+			break;
+		}
+
+		if (!HandleValidatedTx(txv.get_Reader(), hr.m_Min, true, &hr.m_Max)) // reverts this window on failure
+		{
+			LOG_WARNING() << "Invalid in its context";
+			bOk = false;
+			break;
+		}
+
+		nInp += txv.m_vInputs.size();
+		nOut += txv.m_vOutputs.size();
+	}
+
+	if (bOk)
+	{
+		ctxTotal.m_Sigma += ECC::Context::get().G * body.m_Offset;
+
+		if (!ctxTotal.IsValidBlock(body))
+		{
+			LOG_WARNING() << "Context-free verification failed";
+			bOk = false;
+		}
+	}
+
+	if (!bOk)
+	{
+		// revert the windows applied so far
+		r.Reset();
+
+		for (; nOut; nOut--, r.NextUtxoOut())
+			HandleBlockElement(*r.m_pUtxoOut, hr.m_Min, &hr.m_Max, false);
+
+		for (; nInp; nInp--, r.NextUtxoIn())
+			HandleBlockElement(*r.m_pUtxoIn, hr.m_Min, &hr.m_Max, false);
+	}
+
+	return bOk;
+}
+
+bool NodeProcessor::ReadImportWindow(TxBase::IReader& r, TxVectors::Full& txv, const Input* pInpPrev, const Output* pOutPrev, const TxKernel* pKrnPrev)
+{
+	// utxos are read in the merged order, as in IWriter::Combine
+	for (uint32_t n = 0; n < m_ImportWindow; n++)
+	{
+		const Input* pInp = r.m_pUtxoIn;
+		const Output* pOut = r.m_pUtxoOut;
+
+		if (pInp && pOut)
+		{
+			int nCmp = TxBase::CmpInOut(*pInp, *pOut);
+			if (!nCmp)
+				return false; // should've been cut-through
+
+			if (nCmp < 0)
+				pOut = NULL;
+			else
+				pInp = NULL;
+		}
+
+		if (pInp)
+		{
+			if (pInpPrev && (*pInpPrev > *pInp))
+				return false;
+
+			txv.m_vInputs.emplace_back(new Input);
+			*txv.m_vInputs.back() = *pInp;
+			pInpPrev = txv.m_vInputs.back().get();
+
+			r.NextUtxoIn();
+		}
+		else
+		{
+			if (!pOut)
+				break;
+
+			if (pOutPrev && (*pOutPrev > *pOut))
+				return false;
+
+			txv.m_vOutputs.emplace_back(new Output);
+			*txv.m_vOutputs.back() = *pOut;
+			pOutPrev = txv.m_vOutputs.back().get();
+
+			r.NextUtxoOut();
+		}
+	}
+
+	for (uint32_t n = 0; (n < m_ImportWindow) && r.m_pKernel; n++, r.NextKernel())
+	{
+		if (pKrnPrev && (*pKrnPrev > *r.m_pKernel))
+			return false;
+
+		txv.m_vKernels.emplace_back(new TxKernel);
+		*txv.m_vKernels.back() = *r.m_pKernel;
+		pKrnPrev = txv.m_vKernels.back().get();
+	}
+
+	return true;
+}
+
+Height NodeProcessor::OpenLatestMacroblock(Block::BodyBase::MultiRW& rw)
 {
 	NodeDB::WalkerState ws(m_DB);
 	for (m_DB.EnumMacroblocks(ws); ws.MoveNext(); )
@@ -1922,12 +2100,35 @@ Height NodeProcessor::OpenLatestMacroblock(Block::Body::RW& rw)
 	return Rules::HeightGenesis - 1;
 }
 
+void NodeProcessor::RecognizeOutputs(const Output::Ptr* pOut, uint8_t* pFound, Key::IDV* pKidv, size_t nCount)
+{
+	struct Walker :public IKeyWalker
+	{
+		const Output& m_Output;
+		Key::IDV& m_Kidv;
+
+		Walker(const Output& x, Key::IDV& kidv) :m_Output(x), m_Kidv(kidv) {}
+
+		virtual bool OnKey(Key::IPKdf& tag, Key::Index) override
+		{
+			return !m_Output.Recover(tag, m_Kidv); // stop on success
+		}
+	};
+
+	RunParallel(nCount, [this, pOut, pFound, pKidv](size_t i)
+	{
+		Walker w(*pOut[i], pKidv[i]);
+		pFound[i] = !EnumViewerKeys(w);
+		return true;
+	}, 16, get_MaxThreads());
+}
+
 bool NodeProcessor::EnumBlocks(IBlockWalker& wlk)
 {
 	if (m_Cursor.m_ID.m_Height < Rules::HeightGenesis)
 		return true;
 
-	Block::Body::RW rw;
+	Block::BodyBase::MultiRW rw;
 
 	Height h = OpenLatestMacroblock(rw);
 	if (h >= Rules::HeightGenesis)
@@ -56,7 +56,10 @@ class NodeProcessor
 	bool HandleBlockElement(const Output&, Height, const Height*, bool bFwd);
 
 	bool ImportMacroBlockInternal(Block::BodyBase::IMacroReader&);
+	bool ImportMacroBlockBody(TxBase::IReader&, const Block::BodyBase&, const HeightRange&);
+	bool ReadImportWindow(TxBase::IReader&, TxVectors::Full&, const Input* pInpPrev, const Output* pOutPrev, const TxKernel* pKrnPrev);
 	void RecognizeUtxos(TxBase::IReader&&, Height hMax);
+	void RecognizeOutputs(const Output::Ptr*, uint8_t* pFound, Key::IDV*, size_t nCount);
 
 	static void SquashOnce(std::vector<Block::Body>&);
 	static uint64_t ProcessKrnMmr(Merkle::Mmr&, TxBase::IReader&&, Height, const Merkle::Hash& idKrn, TxKernel::Ptr* ppRes);
@@ -95,7 +98,7 @@ class NodeProcessor
 	};
 
 	bool EnumBlocks(IBlockWalker&);
-	Height OpenLatestMacroblock(Block::Body::RW&);
+	Height OpenLatestMacroblock(Block::BodyBase::MultiRW&);
 
 public:
 
@@ -111,6 +114,9 @@ public:
 
 	} m_Horizon;
 
+	uint32_t m_ImportWindow = 10000; // max num of utxos (and kernels) kept in memory during the macroblock import
+	uint64_t m_CommitBytes = 0; // commit between the blocks once that much is written to the DB. 0: only by CommitDB
+
 	struct Cursor
 	{
 		// frequently used data
@@ -165,9 +171,11 @@ public:
 	virtual void OnNewState() {}
 	virtual void OnRolledBack() {}
 	virtual bool VerifyBlock(const Block::BodyBase&, TxBase::IReader&&, const HeightRange&);
+	virtual bool ValidateAndSummarize(TxBase::Context&, const TxBase&, TxBase::IReader&&);
 	virtual void AdjustFossilEnd(Height&) {}
-	virtual bool OpenMacroblock(Block::BodyBase::RW&, const NodeDB::StateID&) { return false; }
+	virtual bool OpenMacroblock(Block::BodyBase::MultiRW&, const NodeDB::StateID&) { return false; }
 	virtual void OnModified() {}
+	virtual uint32_t get_MaxThreads() { return 0; } // for the parallel work (such as outputs recognition), 0 = no limit
 
 	struct IKeyWalker {
 		virtual bool OnKey(Key::IPKdf&, Key::Index) = 0;
@@ -393,6 +393,28 @@ namespace beam
 		{
 			sid.m_Row = pRows[sid.m_Height - Rules::HeightGenesis];
 			db.MoveFwd(sid);
+
+			// the active chain proofs are served from the flat MMR
+			if (sid.m_Height + 1 < hMax + Rules::HeightGenesis)
+			{
+				Merkle::Hash hv;
+				db.get_PredictedStatesHash(hv, sid);
+				Merkle::Interpret(hv, hvZero, true);
+				verify_test(hv == vStates[(size_t) sid.m_Height + 1 - Rules::HeightGenesis].m_Definition);
+			}
+
+			for (Height h = Rules::HeightGenesis; h < sid.m_Height; h++)
+			{
+				Merkle::ProofBuilderStd bld;
+				db.get_Proof(bld, sid, h);
+
+				Merkle::Hash hv;
+				vStates[h - Rules::HeightGenesis].get_Hash(hv);
+				Merkle::Interpret(hv, bld.m_Proof);
+				Merkle::Interpret(hv, hvZero, true);
+
+				verify_test(vStates[(size_t) sid.m_Height - Rules::HeightGenesis].m_Definition == hv);
+			}
 		}
 
 		tr.Commit();
@@ -537,6 +559,21 @@ namespace beam
 		db.DeleteKernel(bBodyP, 5);
 		verify_test(db.FindKernel(bBodyP) == 0);
 
+		// batched, with a remainder
+		std::vector<Merkle::Hash> vKrn(NodeDB::s_InsBatch * 2 + 3);
+		for (size_t i = 0; i < vKrn.size(); i++)
+			vKrn[i] = i + 100U;
+
+		uint64_t nDirty = db.m_Stats.m_BytesDirty;
+		db.InsertKernels(&vKrn.front(), (uint32_t) vKrn.size(), 9);
+		verify_test(db.m_Stats.m_BytesDirty >= nDirty + vKrn.size() * sizeof(Merkle::Hash));
+
+		for (size_t i = 0; i < vKrn.size(); i++)
+		{
+			verify_test(db.FindKernel(vKrn[i]) == 9);
+			db.DeleteKernel(vKrn[i], 9);
+		}
+
 
 		tr.Commit();
 	}
@@ -559,6 +596,35 @@ namespace beam
 			NodeDB db;
 			db.Open(g_sz); // test to open already-existing DB
 		}
+
+		{
+			NodeDB db;
+			db.m_Tuning.m_Wal = true;
+			db.m_Tuning.m_CheckpointThread = true;
+			db.m_Tuning.m_CheckpointMaxPending = 2;
+			db.Open(g_sz);
+
+			for (uint64_t i = 1; i <= 100; i++)
+			{
+				NodeDB::Transaction t(db);
+				db.InsertDummy(i, i);
+				if (i > 1)
+					db.DeleteDummy(i - 1);
+				t.Commit();
+			}
+
+			verify_test(db.m_Stats.m_Commits >= 100);
+			verify_test(db.GetDummyLastID() == 100);
+
+			NodeDB::Transaction t(db);
+			db.DeleteDummy(100);
+			t.Commit();
+		}
+
+		{
+			NodeDB db;
+			db.Open(g_sz); // back to the default journal mode
+		}
 	}
 
 	struct MiniWallet
@@ -805,27 +871,36 @@ namespace beam
 			blockChain.push_back(std::move(pBlock));
 		}
 
-		Block::BodyBase::RW rwData;
+		Block::BodyBase::RW rwData, rwData2, rwMerged;
 		rwData.m_sPath = g_sz3;
+		rwData2.m_sPath = std::string(g_sz3) + "2_";
+		rwMerged.m_sPath = std::string(g_sz3) + "3_";
+
+		std::string sPath4 = std::string(g_sz2) + "_3";
 
 		Height hMid = blockChain.size() / 2 + Rules::HeightGenesis;
 
+		struct MyNodeProcessorX
+			:public NodeProcessor
 		{
-			DeleteFile(g_sz2);
-
-			struct MyNodeProcessorX
-				:public NodeProcessor
+			std::vector<std::string> m_vPathMB; // segments
+			virtual bool OpenMacroblock(Block::BodyBase::MultiRW& rw, const NodeDB::StateID&) override
 			{
-				std::string m_sPathMB;
-				virtual bool OpenMacroblock(Block::BodyBase::RW& rw, const NodeDB::StateID&) override
+				for (size_t i = 0; i < m_vPathMB.size(); i++)
 				{
-					rw.m_sPath = m_sPathMB;
-					rw.ROpen();
-					return true;
+					Block::BodyBase::RW& rwSeg = rw.AddSegment();
+					rwSeg.m_sPath = m_vPathMB[i];
+					rwSeg.ROpen();
 				}
-			};
+				return true;
+			}
+		};
+
+		{
+			DeleteFile(g_sz2);
 
 			MyNodeProcessorX np2;
+			np2.m_ImportWindow = 7; // the test chain is much smaller than the default window
 			np2.Initialize(g_sz2);
 			np2.OnTreasury(g_Treasury);
 
@@ -838,26 +913,27 @@ namespace beam
 			verify_test(np2.ImportMacroBlock(rwData));
 			rwData.Close();
 
-			rwData.m_hvContentTag.Inc();
-			rwData.WCreate();
-			np.ExportMacroBlock(rwData, HeightRange(hMid + 1, Rules::HeightGenesis + blockChain.size() - 1)); // second half
-			rwData.Close();
+			rwData2.m_hvContentTag = Zero;
+			rwData2.m_hvContentTag.Inc();
+			rwData2.m_Format = Block::BodyBase::RW::Format::Legacy; // written by the older code, must still be readable, also along with the newer segments
+			rwData2.WCreate();
+			np.ExportMacroBlock(rwData2, HeightRange(hMid + 1, Rules::HeightGenesis + blockChain.size() - 1)); // second half
+			rwData2.Close();
 
-			rwData.ROpen();
-			verify_test(np2.ImportMacroBlock(rwData));
-			rwData.Close();
+			rwData2.ROpen();
+			verify_test(Block::BodyBase::RW::Format::Legacy == rwData2.m_Format);
+			verify_test(np2.ImportMacroBlock(rwData2));
+			rwData2.Close();
 
 			np2.get_DB().MacroblockIns(np2.m_Cursor.m_Sid.m_Row);
-			np2.m_sPathMB = g_sz3;
 
-			// Although NodeProcessor can import macroblocks not from the beginning - currently this mode is not supported, it will consider only the most recent
-			// macroblock during initialization, and kernel retrieval.
-			// try kernel proofs. Must be retrieved from the macroblock. Because of the above this test is only for kernels which are mature enough
+			// both halves are the segments of the same macroblock
+			np2.m_vPathMB.push_back(rwData.m_sPath);
+			np2.m_vPathMB.push_back(rwData2.m_sPath);
+
+			// try kernel proofs. Must be retrieved from the macroblock, whichever segment contains them
 			for (size_t i = 0; i < np.m_Wallet.m_MyKernels.size(); i++)
 			{
-				if (np.m_Wallet.m_MyKernels[i].m_Height <= hMid)
-					continue;
-
 				TxKernel krn;
 				np.m_Wallet.m_MyKernels[i].Export(krn);
 
@@ -872,10 +948,157 @@ namespace beam
 				Merkle::Interpret(id, proof);
 				verify_test(blockChain[h - Rules::HeightGenesis]->m_Hdr.m_Kernels == id);
 			}
-			
 
-			rwData.Delete();
+			// the segmented macroblock must be equivalent to the whole one
+			DeleteFile(sPath4.c_str());
+
+			MyNodeProcessorX np3;
+			np3.m_ImportWindow = 7;
+			np3.Initialize(sPath4.c_str());
+			np3.OnTreasury(g_Treasury);
+
+			Block::BodyBase::MultiRW mrw;
+			for (size_t i = 0; i < np2.m_vPathMB.size(); i++)
+			{
+				Block::BodyBase::RW& rwSeg = mrw.AddSegment();
+				rwSeg.m_sPath = np2.m_vPathMB[i];
+				rwSeg.ROpen();
+			}
+
+			verify_test(np3.ImportMacroBlock(mrw));
+			verify_test(np3.m_Cursor.m_ID == np2.m_Cursor.m_ID);
+
+			// a later import window fails. The windows applied so far must be reverted
+			struct MyMacroReader
+				:public Block::BodyBase::IMacroReader
+			{
+				Block::BodyBase::IMacroReader& m_R;
+				std::vector<Output::Ptr> m_vOut; // modified by the test
+				size_t m_iOut = 0;
+
+				MyMacroReader(Block::BodyBase::IMacroReader& r) :m_R(r)
+				{
+					for (r.Reset(); r.m_pUtxoOut; r.NextUtxoOut())
+					{
+						m_vOut.emplace_back(new Output);
+						*m_vOut.back() = *r.m_pUtxoOut;
+					}
+				}
+
+				void SetOut()
+				{
+					m_pUtxoOut = (m_iOut < m_vOut.size()) ? m_vOut[m_iOut].get() : NULL;
+				}
+
+				virtual void Clone(Ptr&) override { fail_test("not supported"); }
+
+				virtual void Reset() override
+				{
+					m_R.Reset();
+					m_pUtxoIn = m_R.m_pUtxoIn;
+					m_pKernel = m_R.m_pKernel;
+					m_iOut = 0;
+					SetOut();
+				}
+
+				virtual void NextUtxoIn() override { m_R.NextUtxoIn(); m_pUtxoIn = m_R.m_pUtxoIn; }
+				virtual void NextUtxoOut() override { m_iOut++; SetOut(); }
+				virtual void NextKernel() override { m_R.NextKernel(); m_pKernel = m_R.m_pKernel; }
+				virtual void get_Start(Block::BodyBase& body, Block::SystemState::Sequence::Prefix& prf) override { m_R.get_Start(body, prf); }
+				virtual bool get_NextHdr(Block::SystemState::Sequence::Element& elem) override { return m_R.get_NextHdr(elem); }
+			};
+
+			std::string sPath5 = std::string(g_sz2) + "_4";
+			DeleteFile(sPath5.c_str());
+
+			{
+				MyNodeProcessorX np4;
+				np4.Initialize(sPath5.c_str());
+				np4.OnTreasury(g_Treasury);
+
+				Merkle::Hash hvUtxos0, hvUtxos1;
+				np4.get_Utxos().get_Hash(hvUtxos0);
+
+				rwData.ROpen();
+
+				{
+					// wrong order across the windows (each window is a single element)
+					np4.m_ImportWindow = 1;
+
+					MyMacroReader r(rwData);
+					verify_test(r.m_vOut.size() > 20);
+					std::swap(r.m_vOut[10], r.m_vOut[11]);
+
+					verify_test(!np4.ImportMacroBlock(r));
+					verify_test(np4.m_Cursor.m_ID.m_Height < Rules::HeightGenesis);
+
+					np4.get_Utxos().get_Hash(hvUtxos1);
+					verify_test(hvUtxos0 == hvUtxos1);
+				}
+
+				np4.m_ImportWindow = 7;
+
+				{
+					// invalid output beyond the first window
+					MyMacroReader r(rwData);
+					Output& outp = *r.m_vOut[np4.m_ImportWindow * 2];
+					outp.m_Commitment.m_Y = !outp.m_Commitment.m_Y;
+
+					verify_test(!np4.ImportMacroBlock(r));
+					verify_test(np4.m_Cursor.m_ID.m_Height < Rules::HeightGenesis);
+
+					np4.get_Utxos().get_Hash(hvUtxos1);
+					verify_test(hvUtxos0 == hvUtxos1);
+				}
+
+				// and the valid one is still accepted
+				verify_test(np4.ImportMacroBlock(rwData));
+				verify_test(np4.m_Cursor.m_ID.m_Height == hMid);
+
+				rwData.Close();
+			}
+
+			DeleteFile(sPath5.c_str());
+
+			// merged in a single pass, must be the same
+			rwData.ROpen();
+			rwData2.ROpen();
+
+			rwMerged.m_hvContentTag = Zero;
+			rwMerged.WCreate();
+
+			Block::BodyBase::IMacroReader* ppSrc[] = { &rwData, &rwData2 };
+			volatile bool bStop = false;
+			verify_test(rwMerged.CombineMT(ppSrc, _countof(ppSrc), bStop));
+
+			rwMerged.Close();
+			rwData.Close();
+			rwData2.Close();
+
+			rwMerged.ROpen();
+			rwMerged.Reset();
+			mrw.Reset();
+
+			for (; mrw.m_pUtxoIn; mrw.NextUtxoIn(), rwMerged.NextUtxoIn())
+				verify_test(rwMerged.m_pUtxoIn && !mrw.m_pUtxoIn->cmp(*rwMerged.m_pUtxoIn));
+			verify_test(!rwMerged.m_pUtxoIn);
+
+			for (; mrw.m_pUtxoOut; mrw.NextUtxoOut(), rwMerged.NextUtxoOut())
+				verify_test(rwMerged.m_pUtxoOut && !mrw.m_pUtxoOut->cmp(*rwMerged.m_pUtxoOut));
+			verify_test(!rwMerged.m_pUtxoOut);
+
+			for (; mrw.m_pKernel; mrw.NextKernel(), rwMerged.NextKernel())
+				verify_test(rwMerged.m_pKernel && !mrw.m_pKernel->cmp(*rwMerged.m_pKernel));
+			verify_test(!rwMerged.m_pKernel);
+
+			rwMerged.Close();
+			mrw.Close();
 		}
+
+		DeleteFile(sPath4.c_str());
+		rwData.Delete();
+		rwData2.Delete();
+		rwMerged.Delete();
 	}
 
 
@@ -1004,6 +1227,7 @@ namespace beam
 		node2.m_Cfg.m_Treasury = g_Treasury;
 
 		node2.m_Cfg.m_BeaconPort = g_Port;
+		node2.m_Cfg.m_IoThreads = 2; // decode the inbound traffic on the I/O threads
 
 		ECC::SetRandom(node);
 		ECC::SetRandom(node2);
@@ -1103,6 +1327,333 @@ namespace beam
 
 
 
+	struct FastSyncRules
+	{
+		// small macroblocks, to have a stack of segments on a short chain
+		uint32_t m_MaxRollback;
+		uint32_t m_Granularity;
+
+		FastSyncRules()
+		{
+			m_MaxRollback = Rules::get().Macroblock.MaxRollback;
+			m_Granularity = Rules::get().Macroblock.Granularity;
+
+			Rules::get().Macroblock.MaxRollback = 10;
+			Rules::get().Macroblock.Granularity = 5;
+			Rules::get().UpdateChecksum();
+		}
+
+		~FastSyncRules()
+		{
+			Rules::get().Macroblock.MaxRollback = m_MaxRollback;
+			Rules::get().Macroblock.Granularity = m_Granularity;
+			Rules::get().UpdateChecksum();
+		}
+
+		static Height get_Expected(Height h)
+		{
+			// same as Node::Compressor
+			const uint32_t nThreshold = Rules::get().Macroblock.MaxRollback;
+			if (h - Rules::HeightGenesis + 1 < nThreshold)
+				return 0;
+
+			h -= nThreshold;
+			return h - ((h - Rules::HeightGenesis + 1) % Rules::get().Macroblock.Granularity);
+		}
+
+		static Height get_Latest(Node& n)
+		{
+			NodeDB::WalkerState ws(n.get_Processor().get_DB());
+			n.get_Processor().get_DB().EnumMacroblocks(ws);
+			return ws.MoveNext() ? ws.m_Sid.m_Height : 0;
+		}
+
+		static std::string get_Path(const std::string& sPrefix, Height h)
+		{
+			std::stringstream str;
+			str << sPrefix << "mb_" << h;
+			return str.str();
+		}
+
+		static bool IsFull(const std::string& sPrefix, Height h)
+		{
+			Block::BodyBase::RW rw;
+			rw.m_sPath = get_Path(sPrefix, h);
+			rw.ROpen();
+
+			Block::BodyBase body;
+			Block::SystemState::Sequence::Prefix prf;
+			rw.get_Start(body, prf);
+
+			return prf.m_Height <= Rules::HeightGenesis;
+		}
+
+		static bool HasStream(const std::string& sPrefix, Height h, int iData)
+		{
+			Block::BodyBase::RW rw;
+			rw.m_sPath = get_Path(sPrefix, h);
+
+			std::string s;
+			rw.GetPath(s, iData);
+
+			std::FStream fs;
+			return fs.Open(s.c_str(), true);
+		}
+
+		static void DeleteAll(const std::string& sPrefix, Height hMax)
+		{
+			for (Height h = 0; h <= hMax; h++)
+			{
+				Block::BodyBase::RW rw;
+				rw.m_sPath = get_Path(sPrefix, h);
+				rw.Delete();
+			}
+		}
+	};
+
+	void TestNodeFastSync()
+	{
+		// Node0 keeps its history as a stack of segments. Node1 fast-syncs from it, the self-contained macroblock is built on demand.
+		// Then Node2 fast-syncs from both, the portions are downloaded from them in parallel.
+		// The blocks spend the matured coinbases, so that the self-contained macroblock has no inputs, whereas its top segment has.
+
+		io::Reactor::Ptr pReactor(io::Reactor::create());
+		io::Reactor::Scope scope(*pReactor);
+
+		FastSyncRules fsr;
+
+		const Height hTrg = 60;
+		const Height hMb = FastSyncRules::get_Expected(hTrg);
+
+		const std::string pPrefix[] = { std::string(g_sz3) + "n0_", std::string(g_sz3) + "n1_", std::string(g_sz3) + "n2_" };
+		const std::string sPath3 = std::string(g_sz2) + "_fs";
+		DeleteFile(sPath3.c_str());
+
+		Node node;
+		node.m_Cfg.m_sPathLocal = g_sz;
+		node.m_Cfg.m_Listen.port(g_Port);
+		node.m_Cfg.m_Listen.ip(INADDR_ANY);
+		node.m_Cfg.m_Sync.m_SrcPeers = 0;
+		node.m_Cfg.m_Treasury = g_Treasury;
+		node.m_Cfg.m_HistoryCompression.m_sPathOutput = pPrefix[0];
+		node.m_Cfg.m_HistoryCompression.m_sPathTmp = pPrefix[0];
+		node.m_Cfg.m_HistoryCompression.m_SegmentRatio = 1; // don't merge the older history
+		node.m_Cfg.m_HistoryCompression.m_UploadPortion = 1024; // many portions
+
+		ECC::SetRandom(node);
+		node.Initialize();
+
+		MiniWallet wlt;
+		wlt.m_pKdf = node.m_Keys.m_pMiner;
+
+		struct MyClient
+			:public proto::NodeConnection
+		{
+			Height m_hMb = 0;
+			Height m_hMbTrg = 0;
+			bool m_bLegacy = true;
+
+			io::Timer::Ptr m_pTimer;
+
+			void SendLogin(uint8_t nFlags)
+			{
+				proto::Login msg;
+				msg.m_CfgChecksum = Rules::get().Checksum;
+				msg.m_Flags = nFlags;
+				Send(msg);
+			}
+
+			MyClient()
+			{
+				m_pTimer = io::Timer::create(io::Reactor::get_Current());
+			}
+
+			virtual void OnConnectedSecure() override
+			{
+				SendLogin(0); // the older peer, can't read the newer format
+				Send(proto::MacroblockGet());
+			}
+
+			virtual void OnMsg(proto::Macroblock&& msg) override
+			{
+				if (m_bLegacy)
+				{
+					verify_test(!msg.m_ID.m_Height); // not offered
+					m_bLegacy = false;
+
+					SendLogin(proto::LoginFlags::Extension3);
+					Send(proto::MacroblockGet());
+					return;
+				}
+
+				verify_test(msg.m_ID.m_Height);
+				m_hMb = msg.m_ID.m_Height;
+
+				if (m_hMb < m_hMbTrg)
+					// older self-contained one. Query again, till the latest is built
+					m_pTimer->start(50, false, [this]() { Send(proto::MacroblockGet()); });
+			}
+
+			virtual void OnDisconnect(const DisconnectReason&) override {
+				fail_test("OnDisconnect");
+			}
+		};
+
+		MyClient cl;
+		cl.m_hMbTrg = hMb;
+
+		std::unique_ptr<Node> pNode2, pNode3;
+		bool bClientConnected = false;
+
+		auto fnGetOldest = [](Node& n)
+		{
+			NodeDB::WalkerState ws(n.get_Processor().get_DB());
+			n.get_Processor().get_DB().EnumMacroblocks(ws);
+
+			Height hOldest = 0;
+			while (ws.MoveNext())
+				hOldest = ws.m_Sid.m_Height;
+			return hOldest;
+		};
+
+		uint32_t nCycles = 0;
+		io::Timer::Ptr pTimer = io::Timer::create(*pReactor);
+
+		auto fnOnTimer = [&]()
+		{
+			if (++nCycles > 3000)
+			{
+				fail_test("Fast sync didn't complete");
+				io::Reactor::get_Current().stop();
+				return;
+			}
+
+			Height h = node.get_Processor().m_Cursor.m_ID.m_Height;
+
+			if (h < hTrg)
+			{
+				// mine the next block once the history is compressed up to the current one
+				if (FastSyncRules::get_Latest(node) >= FastSyncRules::get_Expected(h))
+				{
+					TxPool::Fluff txPool;
+
+					Transaction::Ptr pTx;
+					if (wlt.MakeTx(pTx, h, 0))
+					{
+						Transaction::Context ctx;
+						ctx.m_Height.m_Min = ctx.m_Height.m_Max = h + 1;
+						verify_test(pTx->IsValid(ctx));
+
+						Transaction::KeyType key;
+						pTx->get_Key(key);
+						txPool.AddValidTx(std::move(pTx), ctx, key);
+					}
+
+					NodeProcessor::BlockContext bc(txPool, 0, *node.m_Keys.m_pMiner, *node.m_Keys.m_pMiner);
+
+					verify_test(node.get_Processor().GenerateNewBlock(bc));
+					node.get_Processor().OnState(bc.m_Hdr, PeerID());
+
+					Block::SystemState::ID id;
+					bc.m_Hdr.get_ID(id);
+					node.get_Processor().OnBlock(id, bc.m_BodyP, bc.m_BodyE, PeerID());
+
+					wlt.AddMyUtxo(Key::IDV(Rules::get_Emission(h + 1), h + 1, Key::Type::Coinbase));
+				}
+				return;
+			}
+
+			if (!cl.m_hMb)
+			{
+				if ((FastSyncRules::get_Latest(node) == hMb) && !bClientConnected)
+				{
+					verify_test(!FastSyncRules::IsFull(pPrefix[0], hMb));
+					verify_test(FastSyncRules::HasStream(pPrefix[0], hMb, Block::BodyBase::RW::Type::ui));
+					bClientConnected = true;
+
+					io::Address addr;
+					addr.resolve("127.0.0.1");
+					addr.port(g_Port);
+					cl.Connect(addr);
+				}
+				return;
+			}
+
+			if (cl.m_hMb < hMb)
+				return;
+
+			if (!pNode2)
+			{
+				verify_test(FastSyncRules::IsFull(pPrefix[0], hMb));
+				verify_test(!FastSyncRules::HasStream(pPrefix[0], hMb, Block::BodyBase::RW::Type::ui)); // all consumed, the previous one must be gone
+
+				pNode2.reset(new Node);
+				Node& node2 = *pNode2;
+
+				node2.m_Cfg.m_sPathLocal = g_sz2;
+				node2.m_Cfg.m_Connect.resize(1);
+				node2.m_Cfg.m_Connect[0].resolve("127.0.0.1");
+				node2.m_Cfg.m_Connect[0].port(g_Port);
+				node2.m_Cfg.m_Listen.port(g_Port + 1);
+				node2.m_Cfg.m_Listen.ip(INADDR_ANY);
+				node2.m_Cfg.m_Sync.m_SrcPeers = 1;
+				node2.m_Cfg.m_Sync.m_Timeout_ms = 0;
+				node2.m_Cfg.m_HistoryCompression.m_sPathOutput = pPrefix[1];
+				node2.m_Cfg.m_HistoryCompression.m_sPathTmp = pPrefix[1];
+				node2.m_Cfg.m_HistoryCompression.m_UploadPortion = 1024;
+
+				ECC::SetRandom(node2);
+				node2.Initialize();
+				return;
+			}
+
+			if (!pNode3)
+			{
+				if (pNode2->get_Processor().m_Cursor.m_ID.m_Height < hTrg)
+					return;
+
+				// the history below the macroblock is imported, not downloaded block by block
+				verify_test(fnGetOldest(*pNode2) == hMb);
+
+				pNode3.reset(new Node);
+				Node& node3 = *pNode3;
+
+				node3.m_Cfg.m_sPathLocal = sPath3;
+				node3.m_Cfg.m_Connect.resize(2);
+				node3.m_Cfg.m_Connect[0].resolve("127.0.0.1");
+				node3.m_Cfg.m_Connect[0].port(g_Port);
+				node3.m_Cfg.m_Connect[1].resolve("127.0.0.1");
+				node3.m_Cfg.m_Connect[1].port(g_Port + 1);
+				node3.m_Cfg.m_Sync.m_SrcPeers = 2; // wait for both
+				node3.m_Cfg.m_Sync.m_MaxPortionsAhead = 4;
+				node3.m_Cfg.m_HistoryCompression.m_sPathOutput = pPrefix[2];
+				node3.m_Cfg.m_HistoryCompression.m_sPathTmp = pPrefix[2];
+
+				ECC::SetRandom(node3);
+				node3.Initialize();
+				return;
+			}
+
+			if (pNode3->get_Processor().m_Cursor.m_ID.m_Height == hTrg)
+			{
+				verify_test(fnGetOldest(*pNode3) == hMb);
+				io::Reactor::get_Current().stop();
+			}
+		};
+
+		pTimer->start(10, true, fnOnTimer);
+
+		pReactor->run();
+
+		pNode3.reset();
+		pNode2.reset();
+
+		FastSyncRules::DeleteAll(pPrefix[0], hTrg);
+		FastSyncRules::DeleteAll(pPrefix[1], hTrg);
+		FastSyncRules::DeleteAll(pPrefix[2], hTrg);
+		DeleteFile(sPath3.c_str());
+	}
+
 	void TestNodeClientProto()
 	{
 		// Testing configuration: Node <-> Client. Node is a miner
@@ -1314,7 +1865,8 @@ namespace beam
 				{
 					proto::GetProofChainWork msgOut2;
 					Send(msgOut2);
-					m_nChainWorkProofsPending++;
+					Send(msgOut2); // the 2nd one is sent from the cache
+					m_nChainWorkProofsPending += 2;
 				}
 
 				proto::NewTransaction msgTx;
@@ -1671,6 +2223,14 @@ namespace beam
 			cwp2.m_LowerBound = cc.m_vStates[cc.m_vStates.size() - nStates].m_Hdr.m_ChainWork;
 			verify_test(cwp2.Crop(cwp));
 
+			Block::ChainWorkProof cwp3;
+			cwp3.m_LowerBound = cwp2.m_LowerBound;
+			verify_test(cwp3.Crop(cwp, true)); // w/o PoW verification, should be the same
+			verify_test(cwp3.m_Heading.m_vElements.size() == cwp2.m_Heading.m_vElements.size());
+			verify_test(cwp3.m_vArbitraryStates.size() == cwp2.m_vArbitraryStates.size());
+			verify_test(cwp3.m_Proof.m_vData.size() == cwp2.m_Proof.m_vData.size());
+			verify_test(cwp3.IsValid());
+
 			cwp.m_LowerBound = cwp2.m_LowerBound;
 			verify_test(cwp.Crop());
 
@@ -1697,6 +2257,138 @@ namespace beam
 		}
 	}
 
+	void TestFlyClientBatch(Block::SystemState::HistoryMap& hist)
+	{
+		// The utxo requests posted together on a live connection must go in a single message
+
+		struct MyNode
+			:public proto::NodeConnection::Server
+		{
+			Block::SystemState::Full m_Tip;
+			std::vector<size_t> m_vBatches;
+
+			struct Conn
+				:public proto::NodeConnection
+			{
+				MyNode& m_This;
+				Conn(MyNode& x) :m_This(x) {}
+
+				virtual void OnConnectedSecure() override
+				{
+					ECC::Scalar::Native sk;
+					ECC::SetRandom(sk);
+					ProveID(sk, proto::IDType::Node);
+
+					proto::Login msg;
+					msg.m_CfgChecksum = Rules::get().Checksum;
+					msg.m_Flags = proto::LoginFlags::Extension1 | proto::LoginFlags::Extension2;
+					Send(msg);
+
+					proto::NewTip msgTip;
+					msgTip.m_Description = m_This.m_Tip;
+					Send(msgTip);
+				}
+
+				virtual void OnMsg(proto::GetProofUtxo&&) override
+				{
+					m_This.m_vBatches.push_back(1);
+					Send(proto::ProofUtxo());
+				}
+
+				virtual void OnMsg(proto::GetProofUtxoMulti&& msg) override
+				{
+					m_This.m_vBatches.push_back(msg.m_Utxos.size());
+
+					std::vector<std::vector<Input::Proof> > vProofs(msg.m_Utxos.size()); // none exists
+
+					proto::ProofUtxoMulti msgOut;
+					proto::PackProofUtxoMulti(msgOut, vProofs);
+					Send(msgOut);
+				}
+
+				virtual void OnDisconnect(const DisconnectReason&) override {
+					fail_test("OnDisconnect");
+				}
+			};
+
+			std::unique_ptr<Conn> m_pConn;
+
+			virtual void OnAccepted(io::TcpStream::Ptr&& newStream, int errorCode) override
+			{
+				if (newStream)
+				{
+					m_pConn.reset(new Conn(*this));
+					m_pConn->Accept(std::move(newStream));
+					m_pConn->SecureConnect();
+				}
+			}
+		};
+
+		MyNode node;
+		verify_test(hist.get_Tip(node.m_Tip));
+
+		io::Address addr;
+		addr.resolve("127.0.0.1");
+		addr.port(g_Port + 1);
+		node.Listen(addr);
+
+		struct MyFlyClient
+			:public proto::FlyClient
+			,public proto::FlyClient::Request::IHandler
+		{
+			Block::SystemState::HistoryMap m_Hist;
+			INetwork* m_pNet = nullptr;
+			uint32_t m_nPending = 0;
+
+			virtual Block::SystemState::IHistory& get_History() override
+			{
+				return m_Hist;
+			}
+
+			virtual void OnTipUnchanged() override
+			{
+				if (m_nPending)
+					return;
+
+				// the connection is live, the requests are posted one by one, as the wallet does
+				for (uint32_t i = 0; i < 20; i++)
+				{
+					RequestUtxo::Ptr pUtxo(new RequestUtxo);
+					pUtxo->m_Msg.m_Utxo.m_X = i;
+					m_pNet->PostRequest(*pUtxo, *this);
+					m_nPending++;
+				}
+			}
+
+			virtual void OnComplete(Request&) override
+			{
+				verify_test(m_nPending);
+				if (!--m_nPending)
+					io::Reactor::get_Current().stop();
+			}
+		};
+
+		MyFlyClient fc;
+		fc.m_Hist = hist;
+
+		proto::FlyClient::NetworkStd net(fc);
+		net.m_Cfg.m_vNodes.push_back(addr);
+		fc.m_pNet = &net;
+
+		net.Connect();
+
+		io::Timer::Ptr pTimer = io::Timer::create(io::Reactor::get_Current());
+		pTimer->start(10 * 1000, false, []() {
+			fail_test("Batch timeout");
+			io::Reactor::get_Current().stop();
+		});
+
+		io::Reactor::get_Current().run();
+
+		verify_test(!fc.m_nPending);
+		verify_test((node.m_vBatches.size() == 1) && (node.m_vBatches[0] == 20));
+	}
+
 	void TestFlyClient()
 	{
 		io::Reactor::Ptr pReactor(io::Reactor::create());
@@ -1726,6 +2418,8 @@ namespace beam
 			BbsChannel m_LastBbsChannel = 0;
 			bool m_bBbsReceived;
 			Block::SystemState::HistoryMap m_Hist;
+			std::vector<ECC::Point> m_vUtxos; // existing ones
+			size_t m_nUtxoProofs;
 
 			MyFlyClient()
 			{
@@ -1771,6 +2465,9 @@ namespace beam
 				verify_test(this == r.m_pTrg);
 				verify_test(m_nProofsExpected);
 				m_nProofsExpected--;
+
+				if (Request::Type::Utxo == r.get_Type())
+					m_nUtxoProofs += Cast::Up<RequestUtxo>(r).m_Res.m_Proofs.size();
 				MaybeStop();
 			}
 
@@ -1786,6 +2483,7 @@ namespace beam
 				m_hRolledTo = MaxHeight;
 				m_nProofsExpected = 0;
 				m_bBbsReceived = false;
+				m_nUtxoProofs = 0;
 				++m_LastBbsChannel;
 
 				NetworkStd net(*this);
@@ -1823,6 +2521,18 @@ namespace beam
 					m_nProofsExpected++;
 				}
 
+				// consecutive utxo requests, should be sent in a batch
+				for (uint32_t i = 0; i < 20; i++)
+				{
+					RequestUtxo::Ptr pUtxo(new RequestUtxo);
+					if (i < m_vUtxos.size())
+						pUtxo->m_Msg.m_Utxo = m_vUtxos[i];
+					else
+						pUtxo->m_Msg.m_Utxo.m_X = i;
+					net.PostRequest(*pUtxo, *this);
+					m_nProofsExpected++;
+				}
+
 				net.BbsSubscribe(m_LastBbsChannel, 0, this);
 
 				SetTimer(90 * 1000);
@@ -1836,10 +2546,30 @@ namespace beam
 
 
 		MyFlyClient fc;
+
+		{
+			struct Traveler :public UtxoTree::ITraveler
+			{
+				std::vector<ECC::Point>* m_pRes;
+
+				virtual bool OnLeaf(const RadixTree::Leaf& x) override {
+					UtxoTree::Key::Data d;
+					d = Cast::Up<UtxoTree::MyLeaf>(x).m_Key;
+					m_pRes->push_back(d.m_Commitment);
+					return m_pRes->size() < 12;
+				}
+			} t;
+
+			t.m_pRes = &fc.m_vUtxos;
+			node.get_Processor().get_Utxos().Traverse(t);
+			verify_test(!fc.m_vUtxos.empty());
+		}
+
 		// simple case
 		fc.SyncSync();
 
 		verify_test(fc.m_bTip);
+		verify_test(fc.m_nUtxoProofs >= fc.m_vUtxos.size());
 		verify_test(fc.m_hRolledTo == MaxHeight);
 		verify_test(!fc.m_Hist.m_Map.empty() && fc.m_Hist.m_Map.rbegin()->second.m_Height == hThrd1);
 
@@ -1877,6 +2607,8 @@ namespace beam
 		verify_test(fc.m_bTip);
 		verify_test(fc.m_hRolledTo <= hBranch); // must rollback beyond the manually appended state
 		verify_test(!fc.m_Hist.m_Map.empty() && fc.m_Hist.m_Map.rbegin()->second.m_Height == hThrd2);
+
+		TestFlyClientBatch(fc.m_Hist);
 	}
 
 	void TestHalving()
@@ -1965,6 +2697,13 @@ int main()
 	beam::DeleteFile(beam::g_sz);
 	beam::DeleteFile(beam::g_sz2);
 
+	printf("Node fast sync test...\n");
+	fflush(stdout);
+
+	beam::TestNodeFastSync();
+	beam::DeleteFile(beam::g_sz);
+	beam::DeleteFile(beam::g_sz2);
+
 	printf("Node <---> Client test (with proofs)...\n");
 	fflush(stdout);
 
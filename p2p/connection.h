@@ -28,10 +28,7 @@ public:
         BaseConnection(d, std::move(stream)),
         _msgReader(protocol, peerId, defaultMsgSize)
     {
-        _stream->enable_read(
-            [this](io::ErrorCode what, void* data, size_t size) -> bool
-            { return _msgReader.new_data_from_stream(what, data, size); }
-        );
+        enable_read();
     }
 
     uint64_t id() const override { return _msgReader.id(); }
@@ -49,8 +46,28 @@ public:
     /// Disables all messages
     void disable_all_msg_types() { _msgReader.disable_all_msg_types(); }
 
+    /// Diverts raw inbound data to the callback (i.e. to be decoded on another thread).
+    /// Takes effect from the next chunk read from the stream, the reader state can be taken via get_reader()
+    void divert_read(io::TcpStream::Callback&& callback) { _divert = std::move(callback); }
+
+    MsgReader& get_reader() { return _msgReader; }
+
+    /// Temporarily stops reading from the stream (backpressure)
+    void pause_read() { _stream->pause_read(); }
+
+    /// Resumes reading after pause_read()
+    void resume_read() { enable_read(); }
+
 private:
+    void enable_read() {
+        _stream->enable_read(
+            [this](io::ErrorCode what, void* data, size_t size) -> bool
+            { return _divert ? _divert(what, data, size) : _msgReader.new_data_from_stream(what, data, size); }
+        );
+    }
+
     MsgReader _msgReader;
+    io::TcpStream::Callback _divert;
 };
 
 } //namespace
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "msg_reader.h"
+#include "utility/io/mempool.h"
 #include <assert.h>
 #include <algorithm>
 
@@ -23,14 +24,17 @@ MsgReader::MsgReader(ProtocolBase& protocol, uint64_t streamId, size_t defaultSi
     _streamId(streamId),
     _defaultSize(defaultSize),
     _bytesLeft(MsgHeader::SIZE),
-    _state(reading_header)
+    _state(reading_header),
+    _msgBuffer(nullptr),
+    _capacity(0),
+    _msgSize(0)
 {
 	_pAlive.reset(new bool);
 	*_pAlive = true;
 
     assert(_defaultSize >= MsgHeader::SIZE);
-    _msgBuffer.resize(_defaultSize);
-    _cursor = _msgBuffer.data();
+    realloc_buffer(_defaultSize, 0);
+    _cursor = _msgBuffer;
 
     // by default, all message types are allowed
     enable_all_msg_types();
@@ -40,12 +44,45 @@ MsgReader::~MsgReader()
 {
 	if (_pAlive)
 		*_pAlive = false;
+
+    io::BufferPool::get().release(_msgBuffer, _capacity);
+}
+
+void MsgReader::realloc_buffer(size_t size, size_t nKeep) {
+    assert(nKeep <= _capacity);
+
+    uint8_t* pOld = _msgBuffer;
+    size_t nOld = _capacity;
+
+    _capacity = size;
+    _msgBuffer = (uint8_t*) io::BufferPool::get().alloc(_capacity);
+
+    if (nKeep) {
+        memcpy(_msgBuffer, pOld, nKeep);
+    }
+    io::BufferPool::get().release(pOld, nOld);
 }
 
 void MsgReader::reset() {
     _bytesLeft = MsgHeader::SIZE;
     _state = reading_header;
-    _cursor = _msgBuffer.data();
+    _cursor = _msgBuffer;
+}
+
+void MsgReader::take_state(MsgReader& other) {
+    size_t nOffset = other._cursor - other._msgBuffer;
+    std::swap(_msgBuffer, other._msgBuffer);
+    std::swap(_capacity, other._capacity);
+    _msgSize = other._msgSize;
+    _cursor = _msgBuffer + nOffset; // other's cursor refers to the buffer we've just taken
+    _bytesLeft = other._bytesLeft;
+    _state = other._state;
+    _expectedMsgTypes = other._expectedMsgTypes;
+
+    if (other._capacity < other._defaultSize) {
+        other.realloc_buffer(other._defaultSize, 0);
+    }
+    other.reset();
 }
 
 void MsgReader::change_id(uint64_t newStreamId) {
@@ -92,7 +129,7 @@ bool MsgReader::new_data_from_stream(io::ErrorCode connectionStatus, const void*
 		sz -= _bytesLeft;
 		p += _bytesLeft;
 
-		MsgHeader header(_msgBuffer.data());
+		MsgHeader header(_msgBuffer);
 
 		if (_state == reading_header)
 		{
@@ -115,8 +152,10 @@ bool MsgReader::new_data_from_stream(io::ErrorCode connectionStatus, const void*
 
 			// header deserialized successfully
 			_bytesLeft = header.size;
-			_msgBuffer.resize(MsgHeader::SIZE + _bytesLeft);
-			_cursor = _msgBuffer.data() + MsgHeader::SIZE;
+			_msgSize = MsgHeader::SIZE + _bytesLeft;
+			if (_msgSize > _capacity)
+				realloc_buffer(_msgSize, MsgHeader::SIZE);
+			_cursor = _msgBuffer + MsgHeader::SIZE;
 
 			_state = reading_message;
 
@@ -124,13 +163,13 @@ bool MsgReader::new_data_from_stream(io::ErrorCode connectionStatus, const void*
 		else
 		{
 			// whole message has been read
-			if (!_protocol.VerifyMsg(_msgBuffer.data(), static_cast<uint32_t>(_msgBuffer.size())))
+			if (!_protocol.VerifyMsg(_msgBuffer, static_cast<uint32_t>(_msgSize)))
 			{
 				_protocol.on_corrupt_msg(_streamId);
 				return false;
 			}
 
-            if (!_protocol.on_new_message(_streamId, header.type, _msgBuffer.data() + MsgHeader::SIZE, header.size - _protocol.get_MacSize())) {
+            if (!_protocol.on_new_message(_streamId, header.type, _msgBuffer + MsgHeader::SIZE, header.size - _protocol.get_MacSize())) {
                 // at this moment, the *this* may be deleted
                 if (bAlive) {
                     reset();
@@ -141,18 +180,15 @@ bool MsgReader::new_data_from_stream(io::ErrorCode connectionStatus, const void*
 			if (!bAlive)
 				return false;
 
-			if (_msgBuffer.size() > 2 * _defaultSize) {
-				{
-					std::vector<uint8_t> newBuffer;
-					_msgBuffer.swap(newBuffer);
-				}
-				// preventing from excessive memory consumption per individual stream
-				_msgBuffer.resize(_defaultSize);
+			if (_capacity > 2 * _defaultSize) {
+				// preventing from excessive memory consumption per individual stream.
+				// The large buffer goes back to the pool, and is reused by the next large message (on any stream)
+				realloc_buffer(_defaultSize, 0);
 			}
 			_bytesLeft = MsgHeader::SIZE;
 			_state = reading_header;
 
-			_cursor = _msgBuffer.data();
+			_cursor = _msgBuffer;
 		}
 	}
 
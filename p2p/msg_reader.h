@@ -25,6 +25,8 @@ public:
     /// Ctor sets initial statr (reading_header)
     MsgReader(ProtocolBase& protocol, uint64_t streamId, size_t defaultSize);
 	~MsgReader();
+    MsgReader(const MsgReader&) = delete;
+    MsgReader& operator=(const MsgReader&) = delete;
 
     uint64_t id() const { return _streamId; }
     void change_id(uint64_t newStreamId);
@@ -48,10 +50,16 @@ public:
     /// Resets to initial state
     void reset();
 
+    /// Takes over the state of another reader (partially received message, msg type filter), resets the other one
+    void take_state(MsgReader& other);
+
 private:
     /// 2 states of the reader
     enum State { reading_header, reading_message };
 
+    /// Allocates the buffer of at least the given size from the pool, keeps first nKeep bytes
+    void realloc_buffer(size_t size, size_t nKeep);
+
     /// Callbacks
     ProtocolBase& _protocol;
 
@@ -67,8 +75,14 @@ private:
     /// Current state
     State _state;
 
-    /// Message buffer, grows if needed
-    std::vector<uint8_t> _msgBuffer;
+    /// Message buffer (from io::BufferPool), grows if needed
+    uint8_t* _msgBuffer;
+
+    /// Allocated size of the buffer
+    size_t _capacity;
+
+    /// Size of the current message (header included)
+    size_t _msgSize;
 
     /// Cursor inside the buffer
     uint8_t* _cursor;
@@ -0,0 +1,126 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mempool.h"
+#include <assert.h>
+
+namespace beam { namespace io {
+
+BufferPool& BufferPool::get() {
+    static BufferPool s_Pool;
+    return s_Pool;
+}
+
+BufferPool::~BufferPool() {
+    for (size_t i=0; i<NUM_CLASSES; ++i) {
+        free_class(i);
+    }
+}
+
+size_t BufferPool::get_class(size_t size) {
+    size_t i = 0;
+    while ((size_t(1) << (MIN_CLASS_BITS + i)) < size) {
+        ++i;
+    }
+    return i;
+}
+
+void BufferPool::free_class(size_t iClass) {
+    std::vector<void*>& v = _classes[iClass].buffers;
+    for (void* p: v) {
+        free(p);
+    }
+
+    _cachedTotal -= v.size() << (MIN_CLASS_BITS + iClass);
+    v.clear();
+    v.shrink_to_fit();
+}
+
+void BufferPool::trim_idle(Clock::time_point now) {
+    // at most once a second, it's called under the lock
+    if (now - _lastTrim < std::chrono::seconds(1)) {
+        return;
+    }
+    _lastTrim = now;
+
+    for (size_t i=0; i<NUM_CLASSES; ++i) {
+        if (!_classes[i].buffers.empty() && (now - _classes[i].lastUsed > std::chrono::milliseconds(IDLE_TIMEOUT_MS))) {
+            free_class(i);
+        }
+    }
+}
+
+void* BufferPool::alloc(size_t& size) {
+    size_t iClass = get_class(size);
+    if (iClass >= NUM_CLASSES) {
+        return malloc(size);
+    }
+
+    size = size_t(1) << (MIN_CLASS_BITS + iClass);
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Class& c = _classes[iClass];
+        c.lastUsed = Clock::now();
+
+        if (!c.buffers.empty()) {
+            void* p = c.buffers.back();
+            c.buffers.pop_back();
+            _cachedTotal -= size;
+            return p;
+        }
+    }
+
+    return malloc(size);
+}
+
+void BufferPool::release(void* p, size_t size) {
+    if (!p) return;
+
+    size_t iClass = get_class(size);
+    if (iClass < NUM_CLASSES) {
+        assert(size == (size_t(1) << (MIN_CLASS_BITS + iClass)));
+
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        Clock::time_point now = Clock::now();
+        trim_idle(now);
+
+        Class& c = _classes[iClass];
+        c.lastUsed = now;
+
+        if ((c.buffers.empty() || ((c.buffers.size() + 1) * size <= MAX_CACHED_PER_CLASS)) &&
+            (_cachedTotal + size <= MAX_CACHED_TOTAL)) {
+            c.buffers.push_back(p);
+            _cachedTotal += size;
+            return;
+        }
+    }
+
+    free(p);
+}
+
+void BufferPool::trim() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t i=0; i<NUM_CLASSES; ++i) {
+        free_class(i);
+    }
+}
+
+size_t BufferPool::get_cached_size() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _cachedTotal;
+}
+
+}} //namespaces
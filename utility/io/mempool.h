@@ -14,6 +14,8 @@
 
 #pragma once
 #include <vector>
+#include <mutex>
+#include <chrono>
 #include <stdlib.h>
 #include <string.h>
 
@@ -60,5 +62,54 @@ private:
     size_t _maxSize;
 };
 
+/// Size-classed pool of raw buffers (power-of-2 classes), shared by all the streams. Thread-safe.
+/// Avoids re-allocating multi-MB buffers for each large message received, and page faults on them.
+/// The cached memory is bounded (MAX_CACHED_TOTAL), and the classes that weren't used for a while are released.
+class BufferPool {
+public:
+    static const size_t MIN_CLASS_BITS = 12; // 4K
+    static const size_t MAX_CLASS_BITS = 24; // 16M, larger buffers aren't pooled
+    static const size_t MAX_CACHED_PER_CLASS = 4*1024*1024; // bytes kept in each class free list (at least 1 buffer)
+    static const size_t MAX_CACHED_TOTAL = 32*1024*1024; // bytes kept in all the free lists
+    static const uint32_t IDLE_TIMEOUT_MS = 10000; // the free list of a class is released if the class wasn't used for that long
+
+    /// Process-wide instance
+    static BufferPool& get();
+
+    ~BufferPool();
+
+    /// Returns buffer of at least the requested size, which is updated to the actual capacity
+    void* alloc(size_t& size);
+
+    /// Returns the buffer to the pool. size must be the capacity returned by alloc()
+    void release(void* p, size_t size);
+
+    /// Frees all the cached buffers
+    void trim();
+
+    /// Total size of the cached (free) buffers
+    size_t get_cached_size();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static size_t get_class(size_t size);
+
+    void free_class(size_t iClass);
+    void trim_idle(Clock::time_point now);
+
+    static const size_t NUM_CLASSES = MAX_CLASS_BITS - MIN_CLASS_BITS + 1;
+
+    struct Class {
+        std::vector<void*> buffers;
+        Clock::time_point lastUsed;
+    };
+
+    std::mutex _mutex;
+    Class _classes[NUM_CLASSES];
+    size_t _cachedTotal=0;
+    Clock::time_point _lastTrim;
+};
+
 }} //namespaces
 
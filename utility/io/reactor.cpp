@@ -19,6 +19,7 @@
 #include "utility/helpers.h"
 #include <assert.h>
 #include <stdlib.h>
+#include <algorithm>
 
 #ifndef WIN32
 #include <signal.h>
@@ -338,6 +339,8 @@ Reactor::Reactor() :
 {
     memset(&_loop,0,sizeof(uv_loop_t));
     memset(&_stopEvent, 0, sizeof(uv_async_t));
+    memset(&_flushPrepare, 0, sizeof(uv_prepare_t));
+    memset(&_flushCheck, 0, sizeof(uv_check_t));
 
     _creatingInternalObjects=true;
 
@@ -357,6 +360,11 @@ Reactor::Reactor() :
     }
     _stopEvent.data = this;
 
+    uv_prepare_init(&_loop, &_flushPrepare);
+    _flushPrepare.data = this;
+    uv_check_init(&_loop, &_flushCheck);
+    _flushCheck.data = this;
+
     _pendingWrites = std::make_unique<PendingWrites>(*this);
     _tcpConnectors = std::make_unique<TcpConnectors>(*this);
     _tcpShutdowns = std::make_unique<TcpShutdowns>(*this);
@@ -381,6 +389,10 @@ Reactor::~Reactor() {
 
     if (_stopEvent.data)
         uv_close((uv_handle_t*)&_stopEvent, 0);
+    if (_flushPrepare.data)
+        uv_close((uv_handle_t*)&_flushPrepare, 0);
+    if (_flushCheck.data)
+        uv_close((uv_handle_t*)&_flushCheck, 0);
 
     // run one cycle to release all closing handles
     uv_run(&_loop, UV_RUN_NOWAIT);
@@ -557,6 +569,33 @@ ErrorCode Reactor::async_write(Reactor::Object* o, BufferChain& unsent, const Re
     return _pendingWrites->async_write(o, unsent, cb);
 }
 
+void Reactor::schedule_flush(TcpStream* stream) {
+    if (_streamsToFlush.empty()) {
+        uv_prepare_start(&_flushPrepare, [](uv_prepare_t* handle) { reinterpret_cast<Reactor*>(handle->data)->flush_corked(); });
+        uv_check_start(&_flushCheck, [](uv_check_t* handle) { reinterpret_cast<Reactor*>(handle->data)->flush_corked(); });
+    }
+    _streamsToFlush.push_back(stream);
+}
+
+void Reactor::cancel_flush(TcpStream* stream) {
+    auto it = std::find(_streamsToFlush.begin(), _streamsToFlush.end(), stream);
+    if (it != _streamsToFlush.end()) {
+        _streamsToFlush.erase(it);
+    }
+}
+
+void Reactor::flush_corked() {
+    // the list is consumed in-place: on error a stream calls back, and other streams may be destroyed (and cancelled) meanwhile
+    while (!_streamsToFlush.empty()) {
+        TcpStream* s = _streamsToFlush.back();
+        _streamsToFlush.pop_back();
+        s->flush_corked();
+    }
+
+    uv_prepare_stop(&_flushPrepare);
+    uv_check_stop(&_flushCheck);
+}
+
 Result Reactor::tcp_connect(
     Address address,
     uint64_t tag,
@@ -152,6 +152,11 @@ private:
     using OnDataWritten = std::function<void(ErrorCode, size_t)>;
     ErrorCode async_write(Reactor::Object* o, BufferChain& unsent, const OnDataWritten& cb);
 
+    /// Corked streams are flushed at the end of the current loop iteration (both before and after polling for I/O)
+    void schedule_flush(TcpStream* stream);
+    void cancel_flush(TcpStream* stream);
+    void flush_corked();
+
     ErrorCode init_object(ErrorCode errorCode, Object* o, uv_handle_t* h);
     void async_close(uv_handle_t*& handle);
 
@@ -163,6 +168,9 @@ private:
 
     uv_loop_t _loop;
     uv_async_t _stopEvent;
+    uv_prepare_t _flushPrepare;
+    uv_check_t _flushCheck;
+    std::vector<TcpStream*> _streamsToFlush;
     MemPool<uv_handle_t, sizeof(Handles)> _handlePool;
     bool _creatingInternalObjects=false;
 
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "tcpstream.h"
+#include "mempool.h"
 #include "utility/config.h"
 #include "utility/helpers.h"
 #include <assert.h>
@@ -27,6 +28,7 @@ TcpStream::TcpStream() :
 {}
 
 TcpStream::~TcpStream() {
+    if (_flushScheduled && _reactor) _reactor->cancel_flush(this);
     disable_read();
     if (_handle) _handle->data = 0;
 }
@@ -36,12 +38,14 @@ void TcpStream::alloc_read_buffer() {
         if (_readBuffer.len == 0) {
             _readBuffer.len = config().get_int("io.stream_read_buffer_size", 256*1024, 2048, 1024*1024*16);
         }
-        _readBuffer.base = (char*)malloc(_readBuffer.len);
+        size_t len = _readBuffer.len;
+        _readBuffer.base = (char*)BufferPool::get().alloc(len);
+        _readBuffer.len = (decltype(_readBuffer.len)) len;
     }
 }
 
 void TcpStream::free_read_buffer() {
-    if (_readBuffer.base) free(_readBuffer.base);
+    if (_readBuffer.base) BufferPool::get().release(_readBuffer.base, _readBuffer.len);
     _readBuffer.base = 0;
     _readBuffer.len = 0;
 }
@@ -88,6 +92,15 @@ void TcpStream::disable_read() {
     free_read_buffer();
 }
 
+void TcpStream::pause_read() {
+    if (is_connected()) {
+        int errorCode = uv_read_stop((uv_stream_t*)_handle);
+        if (errorCode) {
+            LOG_DEBUG() << "uv_read_stop failed,code=" << errorCode;
+        }
+    }
+}
+
 Result TcpStream::write(const SharedBuffer& buf, bool flush) {
     if (!is_connected()) return make_unexpected(EC_ENOTCONN);
     _writeBuffer.append(buf);
@@ -114,7 +127,7 @@ Result TcpStream::write(const BufferChain& fragments, bool flush) {
 void TcpStream::shutdown() {
     if (is_connected()) {
         disable_read();
-        do_write(true);
+        do_write(true, true);
         _reactor->shutdown_tcpstream(this);
         assert(!_callback);
         assert(!is_connected());
@@ -127,8 +140,45 @@ void TcpStream::enable_keepalive(unsigned initialDelaySecs) {
     }
 }
 
-Result TcpStream::do_write(bool flush) {
+void TcpStream::set_cork(size_t maxBytes) {
+    _corkSize = maxBytes;
+    if (!_corkSize && _flushScheduled) {
+        do_write(true, true);
+    }
+}
+
+void TcpStream::enable_cork() {
+    set_cork(config().get_int("io.stream_cork_size", 64*1024, 0, 1024*1024*16));
+}
+
+void TcpStream::flush_corked() {
+    assert(_flushScheduled);
+    _flushScheduled = false;
+    if (is_connected()) {
+        Result res = do_write(true, true);
+        if (!res && _callback) {
+            // the caller of write() has already got Ok, report it the same way as a failed write request
+            _callback(res.error(), 0, 0);
+        }
+    }
+}
+
+Result TcpStream::do_write(bool flush, bool force) {
     size_t nBytes = _writeBuffer.size();
+
+    if (flush && nBytes > 0 && !force && (nBytes < _corkSize)) {
+        if (!_flushScheduled) {
+            _flushScheduled = true;
+            _reactor->schedule_flush(this);
+        }
+        return Ok();
+    }
+
+    if (_flushScheduled && (flush || force)) {
+        _flushScheduled = false;
+        _reactor->cancel_flush(this);
+    }
+
     if (flush && nBytes > 0) {
         ErrorCode ec = _reactor->async_write(this, _writeBuffer, _onDataWritten);
         if (ec != EC_OK) {
@@ -46,6 +46,9 @@ public:
     /// Disables listening to data and events
     void disable_read();
 
+    /// Stops reading from the socket, keeps the callback. enable_read() resumes
+    void pause_read();
+
     /// Writes raw data, returns status code
     Result write(const void* data, size_t size, bool flush=true) {
         return write(SharedBuffer(data, size), flush);
@@ -78,6 +81,13 @@ public:
     /// Enables tcp keep-alive
     void enable_keepalive(unsigned initialDelaySecs);
 
+    /// Corking: flushing writes are accumulated and sent with a single write request (all the fragments at once)
+    /// at the end of the current reactor loop iteration, or as soon as maxBytes are pending. 0 disables
+    void set_cork(size_t maxBytes);
+
+    /// Sets the cork limit from config ("io.stream_cork_size")
+    void enable_cork();
+
 protected:
     TcpStream();
 
@@ -95,8 +105,11 @@ private:
     void alloc_read_buffer();
     void free_read_buffer();
 
-    // sends async write request if flush == true
-    Result do_write(bool flush);
+    // sends async write request if flush == true (deferred to the end of the loop iteration if corked)
+    Result do_write(bool flush, bool force=false);
+
+    // called by reactor
+    void flush_corked();
 
     // callback from write request
     void on_data_written(ErrorCode errorCode, size_t n);
@@ -106,6 +119,8 @@ private:
     Callback _callback;
     State _state;
     Reactor::OnDataWritten _onDataWritten;
+    size_t _corkSize=0;
+    bool _flushScheduled=false;
 };
 
 }} //namespaces
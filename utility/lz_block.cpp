@@ -0,0 +1,188 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lz_block.h"
+#include <string.h>
+#include <vector>
+
+namespace beam
+{
+	namespace
+	{
+		const size_t s_MinMatch = 4;
+		const size_t s_LastLiterals = 5; // the block always ends with literals
+		const size_t s_MatchLimit = 12; // no match starts that close to the end
+		const size_t s_MaxOffset = 0xffff;
+		const uint32_t s_HashBits = 12;
+
+		uint32_t Read32(const uint8_t* p)
+		{
+			uint32_t x;
+			memcpy(&x, p, sizeof(x));
+			return x;
+		}
+
+		uint32_t Hash(uint32_t x)
+		{
+			return (x * 2654435761U) >> (32 - s_HashBits);
+		}
+
+		void WriteLen(uint8_t*& p, size_t n)
+		{
+			for (; n >= 0xff; n -= 0xff)
+				*p++ = 0xff;
+			*p++ = static_cast<uint8_t>(n);
+		}
+
+		bool ReadLen(size_t& n, const uint8_t*& p, const uint8_t* pEnd)
+		{
+			if (n != 0xf)
+				return true;
+
+			for (uint8_t x = 0xff; 0xff == x; n += x)
+			{
+				if (p == pEnd)
+					return false;
+				x = *p++;
+			}
+
+			return true;
+		}
+
+		uint8_t* WriteSequence(uint8_t* p, const uint8_t* pLit, size_t nLit, size_t nOffset, size_t nMatch)
+		{
+			uint8_t& nToken = *p++;
+
+			if (nLit >= 0xf)
+			{
+				nToken = 0xf0;
+				WriteLen(p, nLit - 0xf);
+			}
+			else
+				nToken = static_cast<uint8_t>(nLit << 4);
+
+			memcpy(p, pLit, nLit);
+			p += nLit;
+
+			if (!nMatch)
+				return p; // last literals
+
+			*p++ = static_cast<uint8_t>(nOffset);
+			*p++ = static_cast<uint8_t>(nOffset >> 8);
+
+			nMatch -= s_MinMatch;
+			if (nMatch >= 0xf)
+			{
+				nToken |= 0xf;
+				WriteLen(p, nMatch - 0xf);
+			}
+			else
+				nToken |= static_cast<uint8_t>(nMatch);
+
+			return p;
+		}
+	}
+
+	size_t LzBlock::get_MaxPacked(size_t nSrc)
+	{
+		return nSrc + nSrc / 0xff + 16;
+	}
+
+	size_t LzBlock::Pack(uint8_t* pDst, const uint8_t* pSrc, size_t nSrc)
+	{
+		uint8_t* p = pDst;
+		size_t iAnchor = 0;
+
+		if (nSrc > s_MatchLimit)
+		{
+			std::vector<uint32_t> vHash(size_t(1) << s_HashBits, 0);
+			size_t iMatchEnd = nSrc - s_LastLiterals;
+
+			for (size_t i = 1; i + s_MatchLimit <= nSrc; )
+			{
+				uint32_t x = Read32(pSrc + i);
+				uint32_t& iSlot = vHash[Hash(x)];
+				size_t iRef = iSlot;
+				iSlot = static_cast<uint32_t>(i);
+
+				if ((i - iRef > s_MaxOffset) || (Read32(pSrc + iRef) != x))
+				{
+					i++;
+					continue;
+				}
+
+				size_t nMatch = s_MinMatch;
+				while ((i + nMatch < iMatchEnd) && (pSrc[iRef + nMatch] == pSrc[i + nMatch]))
+					nMatch++;
+
+				p = WriteSequence(p, pSrc + iAnchor, i - iAnchor, i - iRef, nMatch);
+
+				i += nMatch;
+				iAnchor = i;
+			}
+		}
+
+		p = WriteSequence(p, pSrc + iAnchor, nSrc - iAnchor, 0, 0);
+		return p - pDst;
+	}
+
+	bool LzBlock::Unpack(uint8_t* pDst, size_t nDst, const uint8_t* pSrc, size_t nSrc)
+	{
+		const uint8_t* pEnd = pSrc + nSrc;
+		size_t iDst = 0;
+
+		while (true)
+		{
+			if (pSrc == pEnd)
+				return false;
+
+			uint8_t nToken = *pSrc++;
+
+			size_t nLit = nToken >> 4;
+			if (!ReadLen(nLit, pSrc, pEnd))
+				return false;
+
+			if ((static_cast<size_t>(pEnd - pSrc) < nLit) || (nDst - iDst < nLit))
+				return false;
+
+			memcpy(pDst + iDst, pSrc, nLit);
+			pSrc += nLit;
+			iDst += nLit;
+
+			if (pSrc == pEnd)
+				return (iDst == nDst); // last literals
+
+			if (pEnd - pSrc < 2)
+				return false;
+
+			size_t nOffset = pSrc[0] | (size_t(pSrc[1]) << 8);
+			pSrc += 2;
+
+			if (!nOffset || (nOffset > iDst))
+				return false;
+
+			size_t nMatch = nToken & 0xf;
+			if (!ReadLen(nMatch, pSrc, pEnd))
+				return false;
+			nMatch += s_MinMatch;
+
+			if (nDst - iDst < nMatch)
+				return false;
+
+			// may overlap, copy byte-by-byte
+			for (const uint8_t* pRef = pDst + iDst - nOffset; nMatch--; )
+				pDst[iDst++] = *pRef++;
+		}
+	}
+}
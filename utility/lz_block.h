@@ -0,0 +1,33 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+namespace beam
+{
+	// LZ77 compression of a single block, in the LZ4 block format (sequences of literals followed by a match).
+	// There's no framing, the caller should keep the original size.
+	struct LzBlock
+	{
+		static size_t get_MaxPacked(size_t nSrc);
+
+		// pDst must be at least get_MaxPacked(nSrc). Returns the packed size
+		static size_t Pack(uint8_t* pDst, const uint8_t* pSrc, size_t nSrc);
+
+		// Fails if the data is malformed, or doesn't unpack to exactly nDst bytes
+		static bool Unpack(uint8_t* pDst, size_t nDst, const uint8_t* pSrc, size_t nSrc);
+	};
+}
@@ -16,62 +16,155 @@
 #include "io/asyncevent.h"
 #include <mutex>
 #include <deque>
+#include <atomic>
+#include <memory>
 #include <assert.h>
 
 namespace beam {
 
 /// Inter-thread message queue, backend for RX and TX sides (see below)
-/// Current impl (may be changed if performance bottleneck detected):
-/// 1) unlimited size - should be controlled by channel sides explicitly;
-/// 2) std::deque and std::mutex inside
+/// Multiple producers, single consumer (the RX reactor thread).
+/// 1) Lock-free bounded ring buffer (Vyukov-style sequenced cells) on the fast path;
+/// 2) When the ring is full send() spills into a mutex-guarded overflow deque, so that it never fails unless the RX is closed.
+///    try_send() fails instead, which is the backpressure signal for the producers that can wait.
+///    Once spilled, all the sends go into the overflow until the consumer drains it, so that the order of each producer is kept;
+/// 3) The consumer is only woken (via AsyncEvent) when it's not already signaled.
 /// Message type (class T) requirement: default constructible + callable *or* movable (see send() functions)
 template <class T> class MessageQueue {
 public:
+    static const size_t DEFAULT_CAPACITY = 1024;
+
+    /// Capacity is rounded up to the power of 2
+    explicit MessageQueue(size_t capacity=DEFAULT_CAPACITY) {
+        size_t n = 2;
+        while (n < capacity) n <<= 1;
+
+        _mask = n - 1;
+        _cells.reset(new Cell[n]);
+        for (size_t i=0; i<n; ++i) {
+            _cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
     /// Called from sender thread via TX object
     bool send(const T& message) {
-        std::lock_guard<std::mutex> lock(_mutex);
-        if (_rxClosed) return false;
-        _queue.push_back(message);
-        return true;
+        T copy(message);
+        return send(std::move(copy));
     }
 
     /// Called from sender thread via TX object
     bool send(T&& message) {
+        if (_rxClosed.load(std::memory_order_acquire)) return false;
+        if (!_overflowSize.load(std::memory_order_acquire) && push_ring(message)) return true;
+
         std::lock_guard<std::mutex> lock(_mutex);
-        if (_rxClosed) return false;
-        _queue.push_back(std::move(message));
+        _overflow.push_back(std::move(message));
+        _overflowSize.store(_overflow.size(), std::memory_order_release);
         return true;
     }
 
-    /// May be called by both TX and RX
+    /// Called from sender thread via TX object. Fails if the ring is full (or the RX is closed)
+    bool try_send(T&& message) {
+        if (_rxClosed.load(std::memory_order_acquire)) return false;
+        return !_overflowSize.load(std::memory_order_acquire) && push_ring(message);
+    }
+
+    /// May be called by both TX and RX. Approximate if there're concurrent sends
     size_t current_size() {
-        std::lock_guard<std::mutex> lock(_mutex);
-        return _queue.size();
+        size_t head = _head.load(std::memory_order_relaxed);
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        return (head > tail ? head - tail : 0) + _overflowSize.load(std::memory_order_relaxed);
     }
 
+    size_t capacity() const { return _mask + 1; }
+
     /// Called from receiver thread via RX object
     bool receive(T& message) {
+        if (pop_ring(message)) return true;
+        if (!_overflowSize.load(std::memory_order_acquire)) return false;
+
         std::lock_guard<std::mutex> lock(_mutex);
-        if (_queue.empty()) return false;
-        message = std::move(_queue.front());
-        _queue.pop_front();
+
+        // the ring could be refilled by a sender that saw the overflow empty before we took the lock
+        if (pop_ring(message)) return true;
+
+        // a sender is still writing into the ring. The messages behind it may precede the overflow, wait for it (it'll signal)
+        if (_head.load(std::memory_order_acquire) != _tail.load(std::memory_order_relaxed)) return false;
+
+        if (_overflow.empty()) return false;
+
+        message = std::move(_overflow.front());
+        _overflow.pop_front();
+        _overflowSize.store(_overflow.size(), std::memory_order_release);
         return true;
     }
 
+    /// Called by TX after send(). Returns true if the receiver should be woken up
+    bool set_signaled() {
+        return !_signaled.exchange(true, std::memory_order_acq_rel);
+    }
+
+    /// Called by RX before it drains the queue
+    void reset_signaled() {
+        _signaled.store(false, std::memory_order_release);
+    }
+
     /// Called by RX to indicate that the channel is being closed
     void close_rx() {
-        std::lock_guard<std::mutex> lock(_mutex);
-        _rxClosed = true;
+        _rxClosed.store(true, std::memory_order_release);
     }
 
 private:
-    std::mutex _mutex;
-    // TODO consider spinlock
+    struct Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    bool push_ring(T& message) {
+        size_t pos = _head.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = _cells[pos & _mask];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            if (seq == pos) {
+                if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data = std::move(message);
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (seq < pos) {
+                return false; // full
+            } else {
+                pos = _head.load(std::memory_order_relaxed);
+            }
+        }
+    }
 
-    std::deque<T> _queue;
+    bool pop_ring(T& message) {
+        // single consumer, no CAS needed
+        size_t pos = _tail.load(std::memory_order_relaxed);
+        Cell& cell = _cells[pos & _mask];
+        if (cell.seq.load(std::memory_order_acquire) != pos + 1) return false; // empty, or the producer isn't done yet
 
-    bool _rxClosed=false;
-    // TODO consider atomic flag
+        message = std::move(cell.data);
+        cell.data = T(); // don't keep the moved-from object alive in the ring
+        cell.seq.store(pos + _mask + 1, std::memory_order_release);
+        _tail.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    std::unique_ptr<Cell[]> _cells;
+    size_t _mask=0;
+
+    // separate cache lines for the producers and the consumer
+    alignas(64) std::atomic<size_t> _head{0};
+    alignas(64) std::atomic<size_t> _tail{0};
+
+    alignas(64) std::atomic<size_t> _overflowSize{0};
+    std::atomic<bool> _signaled{false};
+    std::atomic<bool> _rxClosed{false};
+
+    std::mutex _mutex;
+    std::deque<T> _overflow;
 };
 
 /// Transmitter side of inter-thread channel
@@ -79,15 +172,25 @@ template <class T> class TX {
 public:
 
     bool send(const T& message) {
-        return _queue->send(message) && _asyncEvent();
+        return _queue->send(message) && notify();
     }
 
     bool send(T&& message) {
-        return _queue->send(std::move(message)) && _asyncEvent();
+        return _queue->send(std::move(message)) && notify();
+    }
+
+    /// Doesn't spill over the queue capacity. False means either the receiver is lagging (retry later) or the channel is closed
+    bool try_send(T&& message) {
+        return _queue->try_send(std::move(message)) && notify();
     }
 
     size_t queue_size() {
-        return _queue.current_size();
+        return _queue->current_size();
+    }
+
+    /// Backpressure hint: the ring is full, further send()-s go to the (slower) overflow
+    bool is_congested() {
+        return _queue->current_size() >= _queue->capacity();
     }
 
 private:
@@ -98,6 +201,12 @@ private:
         _queue(queue), _asyncEvent(asyncEvent)
     {}
 
+    bool notify() {
+        // the receiver is already signaled and didn't start draining yet
+        if (!_queue->set_signaled()) return true;
+        return bool(_asyncEvent());
+    }
+
     /// Queue
     std::shared_ptr<MessageQueue<T>> _queue;
 
@@ -111,14 +220,19 @@ public:
     /// Message callback, called from reactor thread
     using Callback = std::function<void(T&& message)>;
 
+    /// Max number of messages handled per wake-up, the rest are deferred to the next reactor iteration
+    static const size_t DEFAULT_BATCH = 256;
+
     /// Ctor called by receiver side
-    explicit RX(io::Reactor& reactor, Callback&& callback) :
-        _queue(std::make_shared<MessageQueue<T>>()),
+    explicit RX(io::Reactor& reactor, Callback&& callback, size_t capacity=MessageQueue<T>::DEFAULT_CAPACITY, size_t maxBatch=DEFAULT_BATCH) :
+        _queue(std::make_shared<MessageQueue<T>>(capacity)),
         _asyncEvent(io::AsyncEvent::create(reactor, [this]() { on_receive(); } )),
-        _callback(std::move(callback))
+        _callback(std::move(callback)),
+        _maxBatch(maxBatch)
     {
         assert(_asyncEvent); //TODO this is runtime error, throw..
         assert(_callback);
+        assert(_maxBatch);
     }
 
     /// Dtor closes channel
@@ -132,7 +246,7 @@ public:
     }
 
     size_t queue_size() {
-        return _queue.current_size();
+        return _queue->current_size();
     }
 
     void close() {
@@ -141,18 +255,27 @@ public:
 
 private:
     void on_receive() {
-        while (_queue->receive(_msg)) {
+        // must be reset before draining, otherwise a message sent meanwhile could be left without a wake-up
+        _queue->reset_signaled();
+
+        for (size_t i=0; i<_maxBatch; ++i) {
+            if (!_queue->receive(_msg)) return;
             _callback(std::move(_msg));
         }
+
+        // more pending, let the reactor handle other events first
+        if (_queue->set_signaled()) {
+            _asyncEvent->post();
+        }
     }
 
     std::shared_ptr<MessageQueue<T>> _queue;
     io::AsyncEvent::Ptr _asyncEvent;
     Callback _callback;
+    size_t _maxBatch;
 
     /// Message must be default-constructible
     T _msg;
 };
 
 } //namespace
-
@@ -41,6 +41,14 @@ namespace beam
         const char* IMPORT = "import";
         const char* MINING_THREADS = "mining_threads";
         const char* VERIFICATION_THREADS = "verification_threads";
+        const char* IO_THREADS = "io_threads";
+        const char* DB_WAL = "db_wal";
+        const char* DB_CHECKPOINT_THREAD = "db_checkpoint_thread";
+        const char* DB_SYNCHRONOUS = "db_synchronous";
+        const char* DB_CACHE_MB = "db_cache_mb";
+        const char* DB_MMAP_MB = "db_mmap_mb";
+        const char* DB_PAGE_SIZE = "db_page_size";
+        const char* DB_COMMIT_MB = "db_commit_mb";
         const char* NODE_PEER = "peer";
         const char* PASS = "pass";
         const char* AMOUNT = "amount";
@@ -74,6 +82,7 @@ namespace beam
 		const char* PAYMENT_PROOF_VERIFY = "payment_proof_verify";
 		const char* PAYMENT_PROOF_DATA = "payment_proof";
 		const char* PAYMENT_PROOF_REQUIRED = "payment_proof_required";
+        const char* COINS_CONSOLIDATE = "coins_consolidate";
         const char* TX_ID = "tx_id";
         const char* SEED_PHRASE = "seed_phrase";
         const char* GENERATE_PHRASE = "generate_phrase";
@@ -150,6 +159,14 @@ namespace beam
             (cli::MINER_TYPE, po::value<string>()->default_value("cpu"), "miner type [cpu|gpu]")
 #endif
             (cli::VERIFICATION_THREADS, po::value<int>()->default_value(-1), "number of threads for cryptographic verifications (0 = single thread, -1 = auto)")
+            (cli::IO_THREADS, po::value<uint32_t>()->default_value(0), "number of threads for decrypting and deserializing the peers traffic (0 = on the main thread)")
+            (cli::DB_WAL, po::value<bool>()->default_value(false), "use the write-ahead log for the node storage")
+            (cli::DB_CHECKPOINT_THREAD, po::value<bool>()->default_value(false), "with the write-ahead log: checkpoint the node storage on a background thread")
+            (cli::DB_SYNCHRONOUS, po::value<int>()->default_value(-1), "node storage synchronous level (0 = off, 1 = normal, 2 = full, 3 = extra, -1 = default)")
+            (cli::DB_CACHE_MB, po::value<uint32_t>()->default_value(0), "node storage page cache size in MB (0 = default)")
+            (cli::DB_MMAP_MB, po::value<uint32_t>()->default_value(0), "node storage memory-mapped I/O size in MB (0 = off)")
+            (cli::DB_PAGE_SIZE, po::value<uint32_t>()->default_value(0), "node storage page size, applied when it's created (0 = default)")
+            (cli::DB_COMMIT_MB, po::value<uint32_t>()->default_value(32), "commit the node storage once that much data is written (0 = on idle only)")
             (cli::NODE_PEER, po::value<vector<string>>()->multitoken(), "nodes to connect to")
             (cli::STRATUM_PORT, po::value<uint16_t>()->default_value(0), "port to start stratum server on")
             (cli::STRATUM_SECRETS_PATH, po::value<string>()->default_value("."), "path to stratum server api keys file, and tls certificate and private key")
@@ -188,6 +205,7 @@ namespace beam
             (cli::WALLET_ADDR, po::value<string>()->default_value("*"), "wallet address")
 			(cli::PAYMENT_PROOF_DATA, po::value<string>(), "payment proof data to verify")
 			(cli::PAYMENT_PROOF_REQUIRED, po::value<bool>(), "Set to disallow outgoing payments if the receiver doesn't supports the payment proof (older wallets)")
+            (cli::COINS_CONSOLIDATE, po::value<uint32_t>(), "Set the max number of small coins merged into each outgoing payment (0 to disable)")
             (cli::COMMAND, po::value<string>(), "command to execute [new_addr|send|receive|listen|init|restore|info|export_miner_key|export_owner_key|generate_phrase|change_address_expiration|address_list|refresh]");
 
         po::options_description wallet_treasury_options("Wallet treasury options");
@@ -38,6 +38,14 @@ namespace beam
         extern const char* IMPORT;
         extern const char* MINING_THREADS;
         extern const char* VERIFICATION_THREADS;
+        extern const char* IO_THREADS;
+        extern const char* DB_WAL;
+        extern const char* DB_CHECKPOINT_THREAD;
+        extern const char* DB_SYNCHRONOUS;
+        extern const char* DB_CACHE_MB;
+        extern const char* DB_MMAP_MB;
+        extern const char* DB_PAGE_SIZE;
+        extern const char* DB_COMMIT_MB;
         extern const char* NODE_PEER;
         extern const char* PASS;
         extern const char* AMOUNT;
@@ -68,6 +76,7 @@ namespace beam
 		extern const char* PAYMENT_PROOF_VERIFY;
 		extern const char* PAYMENT_PROOF_DATA;
 		extern const char* PAYMENT_PROOF_REQUIRED;
+        extern const char* COINS_CONSOLIDATE;
         extern const char* SEND;
         extern const char* INFO;
         extern const char* NEW_ADDRESS_COMMENT;
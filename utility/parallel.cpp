@@ -0,0 +1,174 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "parallel.h"
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace beam
+{
+	namespace
+	{
+		struct Pool
+		{
+			struct Job
+			{
+				const std::function<bool(size_t)>* m_pFn;
+				size_t m_Count;
+				std::atomic<size_t> m_iNext;
+				std::atomic<bool> m_bStop;
+				uint32_t m_nHelpersFree; // how many more workers may join
+				uint32_t m_nHelpersActive;
+
+				void Run()
+				{
+					while (!m_bStop)
+					{
+						size_t i = m_iNext++;
+						if (i >= m_Count)
+							break;
+
+						if (!(*m_pFn)(i))
+							m_bStop = true;
+					}
+				}
+			};
+
+			std::mutex m_Mutex;
+			std::condition_variable m_NewJob;
+			std::condition_variable m_HelperDone;
+			std::list<Job*> m_lstJobs; // jobs that can be joined
+			std::vector<std::thread> m_vThreads;
+			bool m_bShutdown = false;
+
+			Pool()
+			{
+				uint32_t nThreads = std::thread::hardware_concurrency();
+				if (nThreads > 1)
+				{
+					m_vThreads.resize(nThreads - 1); // the caller is the one more
+					for (size_t i = 0; i < m_vThreads.size(); i++)
+						m_vThreads[i] = std::thread(&Pool::Thread, this);
+				}
+			}
+
+			~Pool()
+			{
+				{
+					std::unique_lock<std::mutex> scope(m_Mutex);
+					m_bShutdown = true;
+				}
+				m_NewJob.notify_all();
+
+				for (size_t i = 0; i < m_vThreads.size(); i++)
+					m_vThreads[i].join();
+			}
+
+			void Thread()
+			{
+				std::unique_lock<std::mutex> scope(m_Mutex);
+
+				while (true)
+				{
+					while (m_lstJobs.empty() && !m_bShutdown)
+						m_NewJob.wait(scope);
+
+					if (m_bShutdown)
+						break;
+
+					Job& job = *m_lstJobs.front();
+					if (!--job.m_nHelpersFree)
+						m_lstJobs.pop_front();
+					job.m_nHelpersActive++;
+
+					scope.unlock();
+					job.Run();
+					scope.lock();
+
+					if (!--job.m_nHelpersActive)
+						m_HelperDone.notify_all();
+				}
+			}
+
+			void Run(Job& job)
+			{
+				std::list<Job*>::iterator it;
+				{
+					std::unique_lock<std::mutex> scope(m_Mutex);
+					it = m_lstJobs.insert(m_lstJobs.end(), &job);
+				}
+
+				if (job.m_nHelpersFree > 1)
+					m_NewJob.notify_all();
+				else
+					m_NewJob.notify_one();
+
+				job.Run();
+
+				std::unique_lock<std::mutex> scope(m_Mutex);
+
+				if (job.m_nHelpersFree)
+					m_lstJobs.erase(it); // nothing left to join
+
+				while (job.m_nHelpersActive)
+					m_HelperDone.wait(scope);
+			}
+		};
+
+		Pool& get_Pool()
+		{
+			static Pool s_Pool; // created on the first use
+			return s_Pool;
+		}
+	}
+
+	bool RunParallel(size_t nCount, const std::function<bool(size_t)>& fn, size_t nMinPerThread, uint32_t nMaxThreads)
+	{
+		size_t nThreads = nMinPerThread ? (nCount / nMinPerThread) : nCount;
+		if (nMaxThreads && (nThreads > nMaxThreads))
+			nThreads = nMaxThreads;
+
+		if (nThreads <= 1)
+		{
+			for (size_t i = 0; i < nCount; i++)
+				if (!fn(i))
+					return false;
+			return true;
+		}
+
+		Pool& pool = get_Pool();
+		if (nThreads > pool.m_vThreads.size() + 1)
+			nThreads = pool.m_vThreads.size() + 1;
+
+		Pool::Job job;
+		job.m_pFn = &fn;
+		job.m_Count = nCount;
+		job.m_iNext = 0;
+		job.m_bStop = false;
+		job.m_nHelpersFree = static_cast<uint32_t>(nThreads - 1);
+		job.m_nHelpersActive = 0;
+
+		if (job.m_nHelpersFree)
+			pool.Run(job);
+		else
+			job.Run();
+
+		return !job.m_bStop;
+	}
+}
@@ -0,0 +1,28 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+namespace beam
+{
+	// Runs fn(i) for every i in [0, nCount), on the calling thread helped by a shared set of persistent worker threads.
+	// The items are taken dynamically, in no particular order. fn returns false to stop the whole run, then RunParallel returns false.
+	//	nMinPerThread - no extra thread is involved for fewer items than that
+	//	nMaxThreads - including the caller, 0 = no limit (the hardware concurrency)
+	bool RunParallel(size_t nCount, const std::function<bool(size_t)>& fn, size_t nMinPerThread, uint32_t nMaxThreads = 0);
+}
@@ -0,0 +1,109 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "utility/lz_block.h"
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cstring>
+
+#undef NDEBUG
+#include <assert.h>
+
+using namespace std;
+using namespace beam;
+
+namespace {
+
+size_t roundtrip(const vector<uint8_t>& v) {
+    vector<uint8_t> vPacked(LzBlock::get_MaxPacked(v.size()));
+    size_t nPacked = LzBlock::Pack(vPacked.data(), v.data(), v.size());
+    assert(nPacked <= vPacked.size());
+
+    vector<uint8_t> vOut(v.size());
+    assert(LzBlock::Unpack(vOut.data(), vOut.size(), vPacked.data(), nPacked));
+    assert(vOut == v);
+
+    // wrong size, truncated data
+    vOut.resize(v.size() + 1);
+    assert(!LzBlock::Unpack(vOut.data(), vOut.size(), vPacked.data(), nPacked));
+    if (!v.empty()) {
+        assert(!LzBlock::Unpack(vOut.data(), v.size() - 1, vPacked.data(), nPacked));
+    }
+    assert(!LzBlock::Unpack(vOut.data(), v.size(), vPacked.data(), nPacked - 1));
+
+    return nPacked;
+}
+
+void roundtrip_test() {
+    mt19937 rnd(1);
+
+    // small sizes, around the limits
+    for (size_t n = 0; n < 40; ++n) {
+        vector<uint8_t> v(n, 'a');
+        roundtrip(v);
+
+        for (auto& x : v) x = (uint8_t) rnd();
+        roundtrip(v);
+    }
+
+    // random data, expands only by the framing
+    vector<uint8_t> v(100000);
+    for (auto& x : v) x = (uint8_t) rnd();
+    size_t n = roundtrip(v);
+    assert(n <= LzBlock::get_MaxPacked(v.size()));
+    cout << "random: " << v.size() << " -> " << n << endl;
+
+    // long runs and overlapping matches
+    fill(v.begin(), v.end(), 0);
+    n = roundtrip(v);
+    assert(n < 1000);
+    cout << "zeroes: " << v.size() << " -> " << n << endl;
+
+    // mostly small numbers, with random chunks in between (like the macroblock columns)
+    for (size_t i = 0; i < v.size(); ++i) {
+        v[i] = (i % 300 < 32) ? (uint8_t) rnd() : (uint8_t) (rnd() % 3);
+    }
+    n = roundtrip(v);
+    assert(n < v.size());
+    cout << "mixed: " << v.size() << " -> " << n << endl;
+}
+
+void malformed_test() {
+    uint8_t pOut[64];
+
+    // match before the beginning
+    const uint8_t p1[] = { 0x10, 'a', 0x02, 0x00, 0x00 };
+    assert(!LzBlock::Unpack(pOut, sizeof(pOut), p1, sizeof(p1)));
+
+    // zero offset
+    const uint8_t p2[] = { 0x10, 'a', 0x00, 0x00, 0x00 };
+    assert(!LzBlock::Unpack(pOut, sizeof(pOut), p2, sizeof(p2)));
+
+    // unterminated length
+    const uint8_t p3[] = { 0xf0, 0xff, 0xff };
+    assert(!LzBlock::Unpack(pOut, sizeof(pOut), p3, sizeof(p3)));
+
+    // valid: 1 literal, match of 5 at offset 1, then 1 literal
+    const uint8_t p4[] = { 0x11, 'a', 0x01, 0x00, 0x10, 'b' };
+    assert(LzBlock::Unpack(pOut, 7, p4, sizeof(p4)));
+    assert(!memcmp(pOut, "aaaaaab", 7));
+}
+
+} // namespace
+
+int main() {
+    roundtrip_test();
+    malformed_test();
+}
@@ -0,0 +1,89 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "utility/io/mempool.h"
+#include <vector>
+
+#undef NDEBUG
+#include <assert.h>
+
+using namespace std;
+using namespace beam::io;
+
+namespace {
+
+void buffer_pool_test() {
+    BufferPool pool;
+    assert(pool.get_cached_size() == 0);
+
+    // rounded up to the class size, and reused
+    size_t size = 5000;
+    void* p = pool.alloc(size);
+    assert(size == 8192);
+    pool.release(p, size);
+    assert(pool.get_cached_size() == 8192);
+
+    size_t size2 = 8000;
+    void* p2 = pool.alloc(size2);
+    assert(size2 == 8192);
+    assert(p2 == p);
+    assert(pool.get_cached_size() == 0);
+    pool.release(p2, size2);
+
+    // per-class limit
+    const size_t nClass = BufferPool::MAX_CACHED_PER_CLASS / 4;
+    vector<void*> v;
+    for (size_t i = 0; i < 8; i++) {
+        size_t n = nClass;
+        v.push_back(pool.alloc(n));
+        assert(n == nClass);
+    }
+    for (void* x : v) {
+        pool.release(x, nClass);
+    }
+    assert(pool.get_cached_size() == 8192 + BufferPool::MAX_CACHED_PER_CLASS);
+    v.clear();
+
+    // a single buffer is kept even if it's above the per-class limit, but the total is bounded
+    const size_t nMax = size_t(1) << BufferPool::MAX_CLASS_BITS;
+    static_assert(nMax > BufferPool::MAX_CACHED_PER_CLASS, "");
+
+    for (size_t i = 0; i < 4; i++) {
+        size_t n = nMax >> i;
+        v.push_back(pool.alloc(n));
+        assert(n == (nMax >> i));
+    }
+    for (size_t i = 0; i < v.size(); i++) {
+        pool.release(v[i], nMax >> i);
+    }
+    assert(pool.get_cached_size() <= BufferPool::MAX_CACHED_TOTAL);
+    v.clear();
+
+    // larger buffers aren't pooled
+    size = nMax + 1;
+    p = pool.alloc(size);
+    assert(size == nMax + 1);
+    size_t nCached = pool.get_cached_size();
+    pool.release(p, size);
+    assert(pool.get_cached_size() == nCached);
+
+    pool.trim();
+    assert(pool.get_cached_size() == 0);
+}
+
+} // namespace
+
+int main() {
+    buffer_pool_test();
+}
@@ -0,0 +1,188 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Throughput of MessageQueue vs the previous mutex+deque queue. Not a unit test, run manually:
+//   message_queue_bench [messages per producer]
+
+#include "utility/message_queue.h"
+#include <future>
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+
+using namespace std;
+using namespace beam;
+
+namespace {
+
+struct Message {
+    uint32_t producer=0;
+    uint32_t n=0;
+};
+
+/// The previous implementation, as the baseline. Same interface as MessageQueue
+template <class T> class MutexQueue {
+public:
+    bool send(T&& message) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push_back(std::move(message));
+        return true;
+    }
+
+    bool try_send(T&& message) {
+        return send(std::move(message));
+    }
+
+    bool receive(T& message) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_queue.empty()) return false;
+        message = std::move(_queue.front());
+        _queue.pop_front();
+        return true;
+    }
+
+    bool set_signaled() {
+        return !_signaled.exchange(true, std::memory_order_acq_rel);
+    }
+
+    void reset_signaled() {
+        _signaled.store(false, std::memory_order_release);
+    }
+
+private:
+    std::mutex _mutex;
+    std::deque<T> _queue;
+    std::atomic<bool> _signaled{false};
+};
+
+template <class Queue, class T> void send_to(Queue& queue, T&& msg) {
+    // respect the backpressure, otherwise it'd mostly measure the overflow
+    while (!queue.try_send(std::move(msg))) {
+        this_thread::yield();
+    }
+}
+
+const Message& get_msg(const Message& msg) { return msg; }
+const Message& get_msg(const std::unique_ptr<Message>& p) { return *p; }
+
+Message make_msg(Message*, uint32_t p, uint32_t i) { return Message { p, i }; }
+std::unique_ptr<Message> make_msg(std::unique_ptr<Message>*, uint32_t p, uint32_t i) { return std::unique_ptr<Message>(new Message { p, i }); }
+
+template <class Queue, class T> vector<future<void>> start_producers(Queue& queue, uint32_t numProducers, uint32_t numMessages) {
+    vector<future<void>> producers;
+    for (uint32_t p=0; p<numProducers; ++p) {
+        producers.push_back(std::async(
+            std::launch::async,
+            [&queue, p, numMessages]() {
+                for (uint32_t i=1; i<=numMessages; ++i) {
+                    send_to(queue, make_msg((T*) nullptr, p, i));
+                }
+            }
+        ));
+    }
+    return producers;
+}
+
+/// Consumer spins on receive(). Returns msgs/sec
+template <class Queue, class T> double run_spin(uint32_t numProducers, uint32_t numMessages) {
+    Queue queue;
+    auto start = chrono::steady_clock::now();
+    auto producers = start_producers<Queue, T>(queue, numProducers, numMessages);
+
+    uint64_t total = 0;
+    T msg;
+    while (total < uint64_t(numProducers) * numMessages) {
+        if (!queue.receive(msg)) {
+            this_thread::yield();
+            continue;
+        }
+        if (get_msg(msg).producer >= numProducers) abort();
+        ++total;
+    }
+
+    for (auto& f : producers) f.get();
+    return total / chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/// The node's case (IoPool): the consumer is a reactor woken via AsyncEvent, and drains in batches (like RX::on_receive)
+template <class Queue, class T> double run_reactor(uint32_t numProducers, uint32_t numMessages) {
+    Queue queue;
+    io::Reactor::Ptr reactor = io::Reactor::create();
+    uint64_t total = 0;
+    const uint64_t expected = uint64_t(numProducers) * numMessages;
+
+    io::AsyncEvent::Ptr evt;
+    evt = io::AsyncEvent::create(*reactor, [&]() {
+        queue.reset_signaled();
+
+        T msg;
+        for (size_t i=0; i<RX<T>::DEFAULT_BATCH; ++i) {
+            if (!queue.receive(msg)) return;
+            if (++total == expected) {
+                reactor->stop();
+                return;
+            }
+        }
+
+        if (queue.set_signaled()) evt->post();
+    });
+
+    struct Notifier {
+        Queue& queue;
+        io::AsyncEvent::Trigger trigger;
+
+        // the node uses TX::send(), which spills into the overflow instead of the backpressure
+        bool try_send(T&& msg) {
+            queue.send(std::move(msg));
+            if (queue.set_signaled()) trigger();
+            return true;
+        }
+    } notifier { queue, io::AsyncEvent::Trigger(evt) };
+
+    auto start = chrono::steady_clock::now();
+    auto producers = start_producers<Notifier, T>(notifier, numProducers, numMessages);
+
+    reactor->run();
+
+    for (auto& f : producers) f.get();
+    return total / chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+template <class T> void compare(const char* name, uint32_t numProducers, uint32_t numMessages) {
+    double v0 = run_spin<MutexQueue<T>, T>(numProducers, numMessages);
+    double v1 = run_spin<MessageQueue<T>, T>(numProducers, numMessages);
+    double v2 = run_reactor<MutexQueue<T>, T>(numProducers, numMessages);
+    double v3 = run_reactor<MessageQueue<T>, T>(numProducers, numMessages);
+
+    cout << name << ", " << numProducers << " producer(s), msgs/sec" << endl;
+    cout << "    spin:    mutex+deque " << uint64_t(v0) << ", ring " << uint64_t(v1) << endl;
+    cout << "    reactor: mutex+deque " << uint64_t(v2) << ", ring " << uint64_t(v3) << endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    uint32_t numMessages = (argc > 1) ? uint32_t(atoi(argv[1])) : 1000000;
+
+    cout << "hardware threads: " << thread::hardware_concurrency() << endl;
+
+    compare<Message>("POD", 1, numMessages);
+    compare<Message>("POD", 4, numMessages / 4);
+
+    // as the IoPool items, allocated by the producer and freed by the consumer
+    compare<std::unique_ptr<Message>>("unique_ptr", 1, numMessages);
+    compare<std::unique_ptr<Message>>("unique_ptr", 4, numMessages / 4);
+}
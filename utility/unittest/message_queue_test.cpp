@@ -0,0 +1,145 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "utility/message_queue.h"
+#include <future>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#undef NDEBUG
+#include <assert.h>
+
+using namespace std;
+using namespace beam;
+
+namespace {
+
+struct Message {
+    uint32_t producer=0;
+    uint32_t n=0;
+};
+
+void send_to(MessageQueue<Message>& queue, Message&& msg) {
+    // respect the backpressure
+    while (!queue.try_send(std::move(msg))) {
+        this_thread::yield();
+    }
+}
+
+/// Several producers, the consumer verifies the order of each one.
+/// The throughput comparison with the previous queue is in message_queue_bench
+void mpsc_order_test() {
+    const uint32_t NUM_PRODUCERS = 4;
+    const uint32_t NUM_MESSAGES = 10000; // per producer
+
+    MessageQueue<Message> queue(64); // small, so that the ring wraps and the producers hit the backpressure
+
+    vector<future<void>> producers;
+    for (uint32_t p=0; p<NUM_PRODUCERS; ++p) {
+        producers.push_back(std::async(
+            std::launch::async,
+            [&queue, p]() {
+                for (uint32_t i=1; i<=NUM_MESSAGES; ++i) {
+                    if (i & 1) {
+                        send_to(queue, Message { p, i });
+                    } else {
+                        assert(queue.send(Message { p, i })); // may spill into the overflow
+                    }
+                }
+            }
+        ));
+    }
+
+    vector<uint32_t> last(NUM_PRODUCERS, 0);
+    uint64_t total = 0;
+    Message msg;
+    while (total < uint64_t(NUM_PRODUCERS) * NUM_MESSAGES) {
+        if (!queue.receive(msg)) {
+            this_thread::yield();
+            continue;
+        }
+        assert(msg.producer < NUM_PRODUCERS);
+        assert(msg.n == last[msg.producer] + 1);
+        last[msg.producer] = msg.n;
+        ++total;
+    }
+
+    for (auto& f : producers) f.get();
+    assert(!queue.receive(msg));
+}
+
+void ring_overflow_test() {
+    MessageQueue<Message> q(8);
+    assert(q.capacity() == 8);
+
+    for (uint32_t i=1; i<=8; ++i) {
+        assert(q.try_send(Message { 0, i }));
+    }
+    assert(!q.try_send(Message { 0, 9 })); // backpressure
+
+    // spills, keeps the order
+    for (uint32_t i=9; i<=20; ++i) {
+        assert(q.send(Message { 0, i }));
+    }
+    assert(q.current_size() == 20);
+
+    Message msg;
+    for (uint32_t i=1; i<=20; ++i) {
+        assert(q.receive(msg));
+        assert(msg.n == i);
+    }
+    assert(!q.receive(msg));
+
+    q.close_rx();
+    assert(!q.send(Message { 0, 1 }));
+    assert(!q.try_send(Message { 0, 1 }));
+}
+
+void batch_receive_test() {
+    io::Reactor::Ptr reactor = io::Reactor::create();
+    uint32_t received = 0;
+
+    RX<Message> rx(
+        *reactor,
+        [&](Message&& msg) {
+            assert(msg.n == ++received);
+            if (msg.n == 10000) reactor->stop();
+        },
+        64,
+        16
+    );
+
+    TX<Message> tx = rx.get_tx();
+    auto f = std::async(
+        std::launch::async,
+        [&tx]() {
+            for (uint32_t i=1; i<=10000; ++i) {
+                assert(tx.send(Message { 0, i }));
+            }
+        }
+    );
+
+    reactor->run();
+    f.get();
+    assert(received == 10000);
+}
+
+} // namespace
+
+int main() {
+    ring_overflow_test();
+    batch_receive_test();
+    mpsc_order_test();
+}
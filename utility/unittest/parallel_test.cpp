@@ -0,0 +1,77 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "utility/parallel.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#undef NDEBUG
+#include <assert.h>
+
+using namespace std;
+using namespace beam;
+
+namespace {
+
+void run_all_test() {
+    // every item exactly once, also with several callers at once
+    const size_t nCount = 10000;
+    vector<atomic<uint32_t>> v(nCount);
+
+    auto fnRun = [&v]() {
+        for (int n = 0; n < 20; n++) {
+            assert(RunParallel(v.size(), [&v](size_t i) { v[i]++; return true; }, 16));
+        }
+    };
+
+    vector<thread> vCallers;
+    for (int i = 0; i < 3; i++) {
+        vCallers.emplace_back(fnRun);
+    }
+    fnRun();
+
+    for (auto& t : vCallers) {
+        t.join();
+    }
+
+    for (size_t i = 0; i < nCount; i++) {
+        assert(v[i] == 80);
+    }
+}
+
+void stop_test() {
+    atomic<size_t> nDone(0);
+    assert(!RunParallel(100000, [&nDone](size_t i) { nDone++; return i != 50; }, 16));
+    assert(nDone < 100000);
+
+    assert(!RunParallel(10, [](size_t i) { return i != 9; }, 16)); // on the caller only
+}
+
+void limit_test() {
+    // a single thread: the items are run in order, on the caller
+    thread::id id = this_thread::get_id();
+    size_t iNext = 0;
+    assert(RunParallel(1000, [&](size_t i) { assert(this_thread::get_id() == id); assert(i == iNext++); return true; }, 1, 1));
+    assert(iNext == 1000);
+}
+
+} // namespace
+
+int main() {
+    run_all_test();
+    stop_test();
+    limit_test();
+}
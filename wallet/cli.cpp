@@ -882,6 +882,18 @@ int main_impl(int argc, char* argv[])
                         }
                     }
 
+                    {
+                        const auto& var = vm[cli::COINS_CONSOLIDATE];
+                        if (!var.empty())
+                        {
+                            uint32_t n = var.as<uint32_t>();
+                            wallet::setVar(*walletDB, wallet::g_szCoinsConsolidate, n);
+
+                            cout << "Parameter set: Coins consolidate: " << n << std::endl;
+                            return 0;
+                        }
+                    }
+
                     if (command == cli::NEW_ADDRESS)
                     {
                         auto comment = vm[cli::NEW_ADDRESS_COMMENT].as<string>();
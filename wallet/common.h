@@ -320,6 +320,9 @@ namespace beam
             virtual void confirm_kernel(const TxID&, const TxKernel&) = 0;
             virtual bool get_tip(Block::SystemState::Full& state) const = 0;
             virtual void send_tx_params(const WalletID& peerID, SetTxParameter&&) = 0;
+            // the tx is updated on its events only, those subscribe for the height-driven updates
+            virtual void update_on_next_tip(const TxID&) = 0;
+            virtual void update_on_height(const TxID&, Height) = 0;
         };
 
         enum class ErrorType : uint8_t
@@ -963,6 +963,54 @@ void TestTxParameters()
     WALLET_CHECK(wallet::setTxParameter(*db, txID, TxParameterID::PeerPublicNonce, pt, false));
     WALLET_CHECK(wallet::getTxParameter(*db, txID, TxParameterID::PeerPublicNonce, pt2));
     WALLET_CHECK(p == pt2);
+
+    // the parameters of an active tx are cached, make sure they're stored as well
+    db->cacheTxParameters(txID, true);
+    WALLET_CHECK(wallet::getTxParameter(*db, txID, TxParameterID::Amount, amount));
+    WALLET_CHECK(amount == 8765);
+    WALLET_CHECK(!wallet::setTxParameter(*db, txID, TxParameterID::Amount, 786, false));
+    WALLET_CHECK(wallet::setTxParameter(*db, txID, TxParameterID::KernelProofHeight, Height(5), false));
+    Height h = 0;
+    WALLET_CHECK(wallet::getTxParameter(*db, txID, TxParameterID::KernelProofHeight, h));
+    WALLET_CHECK(h == 5);
+
+    auto db2 = WalletDB::open("wallet.db", string("pass123"));
+    WALLET_CHECK(wallet::getTxParameter(*db2, txID, TxParameterID::Amount, amount));
+    WALLET_CHECK(amount == 8765);
+    WALLET_CHECK(wallet::getTxParameter(*db2, txID, TxParameterID::KernelProofHeight, h));
+    WALLET_CHECK(h == 5);
+    WALLET_CHECK(wallet::getTxParameter(*db2, txID, TxParameterID::Status, b2));
+    WALLET_CHECK(equal(b.begin(), b.end(), b2.begin(), b2.end()));
+    WALLET_CHECK(!wallet::getTxParameter(*db2, txID, TxParameterID::KernelID, b2));
+
+    // evicted, the changes made elsewhere are visible
+    db->cacheTxParameters(txID, false);
+    WALLET_CHECK(wallet::setTxParameter(*db2, txID, TxParameterID::KernelProofHeight, Height(7), false));
+    WALLET_CHECK(wallet::getTxParameter(*db, txID, TxParameterID::KernelProofHeight, h));
+    WALLET_CHECK(h == 7);
+
+    // the history reads aren't cached
+    TxDescription tx;
+    tx.m_txId = { {2, 4, 6} };
+    tx.m_amount = 34;
+    tx.m_createTime = 123456;
+    tx.m_minHeight = 134;
+    tx.m_sender = true;
+    tx.m_status = TxStatus::InProgress;
+    db->saveTx(tx);
+    WALLET_CHECK(!db->getTxHistory().empty());
+    WALLET_CHECK(wallet::setTxParameter(*db2, tx.m_txId, TxParameterID::Status, TxStatus::Failed, false));
+    auto tx2 = db->getTx(tx.m_txId);
+    WALLET_CHECK(tx2.is_initialized() && tx2->m_status == TxStatus::Failed);
+
+    // the cache is updated by saveTx after the commit
+    db->cacheTxParameters(tx.m_txId, true);
+    tx.m_status = TxStatus::Completed;
+    db->saveTx(tx);
+    WALLET_CHECK(wallet::getTxParameter(*db, tx.m_txId, TxParameterID::Status, status));
+    WALLET_CHECK(status == TxStatus::Completed);
+    WALLET_CHECK(wallet::getTxParameter(*db2, tx.m_txId, TxParameterID::Status, status));
+    WALLET_CHECK(status == TxStatus::Completed);
 }
 
 void TestSelect3()
@@ -1179,6 +1227,153 @@ void TestTransferredByTx()
     WALLET_CHECK(historySumSent == sumSent);
 }
 
+void TestSelect7()
+{
+    cout << "\nWallet database coin selection 7 test\n";
+    auto db = createSqliteWalletDB();
+
+    vector<Coin> coins;
+    for (uint32_t i = 0; i < 100000; ++i)
+    {
+        coins.push_back(Coin(3, Coin::Available, 10, Key::Type::Regular));
+    }
+    coins.push_back(Coin(1000, Coin::Available, 10, Key::Type::Regular));
+    coins.push_back(Coin(700, Coin::Available, 10, Key::Type::Regular));
+    coins.push_back(Coin(500, Coin::Available, 10, Key::Type::Regular));
+    db->store(coins);
+
+    // exact match, no change
+    coins = SelectCoins(db, 1200, false);
+    WALLET_CHECK(coins.size() == 2);
+    WALLET_CHECK(coins[0].m_ID.m_Value == 700);
+    WALLET_CHECK(coins[1].m_ID.m_Value == 500);
+
+    coins = SelectCoins(db, 1000, false);
+    WALLET_CHECK(coins.size() == 1);
+    WALLET_CHECK(coins[0].m_ID.m_Value == 1000);
+
+    // a lot of dust, the amount isn't reachable
+    coins = db->selectCoins(1000000, false);
+    WALLET_CHECK(coins.empty());
+
+    coins = SelectCoins(db, 20000, false);
+    WALLET_CHECK(coins.size() <= WalletDB::s_MaxCandidates);
+
+    wallet::setVar(*db, wallet::g_szCoinsConsolidate, uint32_t(5));
+    coins = SelectCoins(db, 1000, false);
+    WALLET_CHECK(coins.size() == 6);
+    WALLET_CHECK(coins[0].m_ID.m_Value == 1000);
+    WALLET_CHECK(coins[5].m_ID.m_Value == 3);
+}
+
+void TestCoinTotals()
+{
+    cout << "\nWallet database coin totals test\n";
+    auto db = createSqliteWalletDB(); // height 134
+
+    auto checkTotals = [](IWalletDB::Ptr db, Amount avail, Amount availCoinbase, Amount maturing, Amount outgoing)
+    {
+        WALLET_CHECK(db->getAvailable() == avail);
+        WALLET_CHECK(db->getAvailableByType(Key::Type::Coinbase) == availCoinbase);
+        WALLET_CHECK(db->getTotal(Coin::Maturing) == maturing);
+        WALLET_CHECK(db->getTotal(Coin::Outgoing) == outgoing);
+        WALLET_CHECK(db->getTotalByType(Coin::Available, Key::Type::Regular) + db->getTotalByType(Coin::Available, Key::Type::Coinbase) == db->getTotal(Coin::Available));
+    };
+
+    checkTotals(db, 0, 0, 0, 0);
+
+    Coin c1(5, Coin::Available, 10);
+    Coin c2(7, Coin::Available, 10, Key::Type::Coinbase);
+    Coin c3(11, Coin::Maturing, 140, Key::Type::Coinbase);
+    Coin c4(13, Coin::Available, 200); // not matured yet, excluded from the available
+    db->store(c1);
+    db->store(c2);
+    db->store(c3);
+    db->store(c4);
+    checkTotals(db, 12, 7, 11, 0);
+
+    c1.m_status = Coin::Outgoing;
+    db->save(c1);
+    checkTotals(db, 7, 7, 11, 5);
+
+    Coin c;
+    c.m_ID = c1.m_ID;
+    WALLET_CHECK(db->find(c) && (c.m_status == Coin::Outgoing));
+
+    db->remove(c1.m_ID);
+    WALLET_CHECK(!db->find(c));
+    checkTotals(db, 7, 7, 11, 0);
+
+    beam::Block::SystemState::ID id = { };
+    id.m_Height = 150;
+    db->setSystemStateID(id); // c3 becomes available
+    checkTotals(db, 18, 18, 0, 0);
+
+    // reopen, the totals are recalculated from the table
+    db.reset();
+    db = WalletDB::open("wallet.db", string("pass123"));
+    checkTotals(db, 18, 18, 0, 0);
+
+    id.m_Height = 200;
+    db->setSystemStateID(id);
+    checkTotals(db, 31, 18, 0, 0);
+
+    auto coins = db->selectCoins(31, true);
+    WALLET_CHECK(coins.size() == 3);
+    checkTotals(db, 0, 0, 0, 31);
+}
+
+void TestStatementCache()
+{
+    cout << "\nWallet database statement cache test\n";
+    auto db = createSqliteWalletDB();
+
+    vector<Coin> coins;
+    coins.push_back(Coin(3, Coin::Available, 10));
+    coins.push_back(Coin(5, Coin::Available, 10));
+    coins.push_back(Coin(7, Coin::Available, 10));
+    db->store(coins);
+
+    auto sumCoins = [&db]()
+    {
+        Amount sum = 0;
+        db->visit([&sum](const Coin& c)
+        {
+            sum += c.m_ID.m_Value;
+            return true;
+        });
+        return sum;
+    };
+
+    // the same query nested in itself gets its own instance of the statement
+    size_t count = 0;
+    db->visit([&](const Coin&)
+    {
+        ++count;
+        WALLET_CHECK(sumCoins() == 15);
+        return true;
+    });
+    WALLET_CHECK(count == 3);
+
+    // the released statement is reset, the next use starts from the beginning
+    db->visit([](const Coin&) { return false; });
+    WALLET_CHECK(sumCoins() == 15);
+
+    // rekey while the statements are cached
+    db->changePassword(string("pass456"));
+    WALLET_CHECK(sumCoins() == 15);
+
+    Coin c(11, Coin::Available, 10);
+    db->store(c);
+    WALLET_CHECK(sumCoins() == 26);
+
+    // the statements are finalized before the close, the db reopens with the new key
+    db.reset();
+    db = WalletDB::open("wallet.db", string("pass456"));
+    WALLET_CHECK(db);
+    WALLET_CHECK(sumCoins() == 26);
+}
+
 int main() 
 {
     int logLevel = LOG_LEVEL_DEBUG;
@@ -1200,6 +1395,9 @@ int main()
     TestSelect4();
     TestSelect5();
     TestSelect6();
+    TestSelect7();
+    TestCoinTotals();
+    TestStatementCache();
     TestAddresses();
 
     TestTxParameters();
@@ -282,6 +282,14 @@ namespace
             return true;
         }
 
+        void update_on_next_tip(const TxID&) override
+        {
+        }
+
+        void update_on_height(const TxID&, Height) override
+        {
+        }
+
     };
 
 }
@@ -377,7 +385,8 @@ struct TestWalletNetwork
     {
         for (WalletMap::iterator it = m_Map.begin(); m_Map.end() != it; it++)
             for (Entry& v = it->second; !v.m_Msgs.empty(); v.m_Msgs.pop_front())
-                v.m_pSink->OnWalletMessage(v.m_Msgs.front().first, std::move(v.m_Msgs.front().second));
+                if (v.m_pSink) // otherwise the peer is offline
+                    v.m_pSink->OnWalletMessage(v.m_Msgs.front().first, std::move(v.m_Msgs.front().second));
     }
 };
 
@@ -751,6 +760,82 @@ void TestWalletNegotiation(IWalletDB::Ptr senderWalletDB, IWalletDB::Ptr receive
     WALLET_CHECK(count == 2);
 }
 
+void TestTxUpdateOnTip()
+{
+    cout << "\nTesting the transaction updates on new tips...\n";
+
+    io::Reactor::Ptr mainReactor{ io::Reactor::create() };
+    io::Reactor::Scope scope(*mainReactor);
+
+    IWalletDB::Ptr senderWalletDB = createSenderWalletDB();
+    IWalletDB::Ptr receiverWalletDB = createReceiverWalletDB();
+
+    WalletAddress wa = wallet::createAddress(*receiverWalletDB);
+    receiverWalletDB->saveAddress(wa);
+    WalletID receiver_id = wa.m_walletID;
+
+    wa = wallet::createAddress(*senderWalletDB);
+    senderWalletDB->saveAddress(wa);
+    WalletID sender_id = wa.m_walletID;
+
+    Wallet sender(senderWalletDB);
+
+    TestWalletNetwork twn;
+    TestNodeNetwork::Shared tnns;
+    TestNodeNetwork netNodeS(tnns, sender);
+
+    sender.set_Network(netNodeS, twn);
+
+    twn.m_Map[sender_id].m_pSink = &sender;
+    twn.m_Map[receiver_id].m_pSink = nullptr; // never responds, the transactions aren't registered
+
+    auto proceed = [&mainReactor]()
+    {
+        io::Timer::Ptr pTimer = io::Timer::create(*mainReactor);
+        pTimer->start(100, false, [&mainReactor]() { mainReactor->stop(); });
+        mainReactor->run();
+    };
+
+    auto getStatus = [&senderWalletDB](const TxID& txID)
+    {
+        return senderWalletDB->getTx(txID)->m_status;
+    };
+
+    tnns.AddBlock();
+    proceed();
+
+    const Height h0 = senderWalletDB->getCurrentHeight();
+    const Height lifetime = 3;
+
+    auto txExpiring = sender.transfer_money(sender_id, receiver_id, 4, 1, true, lifetime, {});
+    auto txIdle = sender.transfer_money(sender_id, receiver_id, 6, 1, true, 200, {});
+    proceed();
+
+    WALLET_CHECK(txExpiring && txIdle);
+    WALLET_CHECK(getStatus(*txExpiring) == TxStatus::InProgress);
+    WALLET_CHECK(getStatus(*txIdle) == TxStatus::InProgress);
+
+    // an external failure is noticed on the next update only. The idle tx must not get one on the new tips
+    wallet::setTxParameter(*senderWalletDB, *txIdle, wallet::TxParameterID::FailureReason, wallet::TxFailureReason::Unknown, false);
+
+    for (Height h = h0 + 1; h <= h0 + lifetime; h++)
+    {
+        tnns.AddBlock();
+        proceed();
+
+        WALLET_CHECK(senderWalletDB->getCurrentHeight() == h);
+        WALLET_CHECK(getStatus(*txExpiring) == TxStatus::InProgress);
+        WALLET_CHECK(getStatus(*txIdle) == TxStatus::InProgress);
+    }
+
+    // the max height has passed, the expiring tx is woken
+    tnns.AddBlock();
+    proceed();
+
+    WALLET_CHECK(getStatus(*txExpiring) == TxStatus::Failed);
+    WALLET_CHECK(getStatus(*txIdle) == TxStatus::InProgress);
+}
+
 class TestNode
 {
 public:
@@ -1044,6 +1129,15 @@ void TestP2PWalletNegotiationST()
     sw.stop();
     cout << "First transfer elapsed time: " << sw.milliseconds() << " ms\n";
 
+    {
+        // both sides mined their outgoing BBS messages
+        WalletNetworkViaBbs::MinerStats stats = sender.m_WalletNetworkViaBbs.get_MinerStats();
+        WALLET_CHECK(stats.m_Messages > 0);
+        WALLET_CHECK(stats.m_Hashes >= stats.m_Messages);
+        cout << "Sender BBS mining: " << stats.m_Messages << " messages, " << stats.get_MessagesPerSec() << " msg/s, " << stats.get_HashesPerSec() << " hash/s\n";
+        WALLET_CHECK(receiver.m_WalletNetworkViaBbs.get_MinerStats().m_Messages > 0);
+    }
+
     // check coins
     vector<Coin> newSenderCoins = sender.GetCoins();
     vector<Coin> newReceiverCoins = receiver.GetCoins();
@@ -1592,6 +1686,8 @@ int main()
     //TestWalletNegotiation(CreateWalletDB<TestWalletDB>(), CreateWalletDB<TestWalletDB2>());
     TestWalletNegotiation(createSenderWalletDB(), createReceiverWalletDB());
 
+    TestTxUpdateOnTip();
+
     TestSplitTransaction();
 
     ////TestSwapTransaction();
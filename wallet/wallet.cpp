@@ -19,6 +19,7 @@
 #include "core/block_crypt.h"
 #include "utility/logger.h"
 #include "utility/helpers.h"
+#include "utility/parallel.h"
 #include "swap_transaction.h"
 #include <algorithm>
 #include <random>
@@ -226,6 +227,9 @@ namespace beam
 
         REQUEST_TYPES_All(THE_MACRO)
 #undef THE_MACRO
+
+        for (const auto& p : m_Transactions)
+            m_WalletDB->cacheTxParameters(p.first, false);
     }
 
     boost::optional<TxID> Wallet::transfer_money(const WalletID& from, const WalletID& to, Amount amount, Amount fee, bool sender, Height lifetime, ByteBuffer&& message)
@@ -268,7 +272,7 @@ namespace beam
         txDescription.m_status = TxStatus::Pending;
         m_WalletDB->saveTx(txDescription);
 
-        m_Transactions.emplace(*txID, tx);
+        AddActiveTransaction(tx);
 
         updateTransaction(*txID);
 
@@ -299,7 +303,7 @@ namespace beam
         tx->SetParameter(TxParameterID::AtomicSwapCoin, swapCoin, false);
         tx->SetParameter(TxParameterID::AtomicSwapAmount, swapAmount, false);
 
-        m_Transactions.emplace(txID, tx);
+        AddActiveTransaction(tx);
 
         updateTransaction(txID);
 
@@ -309,6 +313,7 @@ namespace beam
     void Wallet::Refresh()
     {
         m_WalletDB->clear();
+        m_Commitments.clear();
         Block::SystemState::ID id;
         ZeroObject(id);
         m_WalletDB->setSystemStateID(id);
@@ -329,7 +334,7 @@ namespace beam
                 if (t->SetParameter(TxParameterID::KernelProofHeight, Height(0), false)
                     && t->SetParameter(TxParameterID::KernelUnconfirmedHeight, Height(0), false))
                 {
-                    m_Transactions.emplace(tx.m_txId, t);
+                    AddActiveTransaction(t);
                 }
             }
         }
@@ -347,7 +352,8 @@ namespace beam
         {
             auto t = constructTransaction(tx.m_txId, TxType::Simple);
 
-            m_Transactions.emplace(tx.m_txId, t);
+            AddActiveTransaction(t);
+            m_NextTipTransactionsToUpdate.insert(t);
         }
     }
 
@@ -372,6 +378,7 @@ namespace beam
         {
 			pGuard.swap(it->second);
             m_Transactions.erase(it);
+            m_WalletDB->cacheTxParameters(txID, false);
         }
  
         if (m_TxCompletedAction)
@@ -382,8 +389,13 @@ namespace beam
 
     void Wallet::confirm_outputs(const vector<Coin>& coins)
     {
+        vector<Coin::ID> vIDs;
+        vIDs.reserve(coins.size());
+
         for (auto& coin : coins)
-            getUtxoProof(coin.m_ID);
+            vIDs.push_back(coin.m_ID);
+
+        getUtxoProofs(vIDs);
     }
 
     bool Wallet::MyRequestUtxo::operator < (const MyRequestUtxo& x) const
@@ -445,6 +457,18 @@ namespace beam
         }
     }
 
+    void Wallet::update_on_next_tip(const TxID& txID)
+    {
+        auto it = m_Transactions.find(txID);
+        if (it != m_Transactions.end())
+            m_NextTipTransactionsToUpdate.insert(it->second);
+    }
+
+    void Wallet::update_on_height(const TxID& txID, Height h)
+    {
+        m_HeightTransactionsToUpdate.emplace(h, txID);
+    }
+
     bool Wallet::get_tip(Block::SystemState::Full& state) const
     {
         return m_WalletDB->get_History().get_Tip(state);
@@ -551,10 +575,13 @@ namespace beam
         proto::UtxoEvent evt;
         evt.m_Added = 1;
         evt.m_Kidv = r.m_CoinID;
+        evt.m_Commitment = r.m_Msg.m_Utxo;
         evt.m_Maturity = proof.m_State.m_Maturity;
         evt.m_Height = sTip.m_Height;
 
-        ProcessUtxoEvent(evt, sTip.m_Height); // uniform processing for all confirmed utxos
+        UtxoBatch batch;
+        ProcessUtxoEvent(batch, evt, sTip.m_Height); // uniform processing for all confirmed utxos
+        SaveUtxoBatch(batch);
     }
 
     void Wallet::OnRequestComplete(MyRequestKernel& r)
@@ -624,19 +651,27 @@ namespace beam
         m_WalletDB->get_History().get_Tip(sTip);
 
         const std::vector<proto::UtxoEvent>& v = r.m_Res.m_Events;
+        UtxoBatch batch;
+
+        vector<Coin::ID> vIDs;
+        vIDs.reserve(v.size());
+        for (size_t i = 0; i < v.size(); i++)
+            vIDs.push_back(v[i].m_Kidv);
+
+        vector<Point> vComm;
+        get_Commitments(vIDs, vComm);
+
 		for (size_t i = 0; i < v.size(); i++)
 		{
 			const proto::UtxoEvent& evt = v[i];
 
 			// filter-out false positives
-			Scalar::Native sk;
-			Point comm;
-			m_WalletDB->calcCommitment(sk, comm, evt.m_Kidv);
-
-			if (comm == evt.m_Commitment)
-				ProcessUtxoEvent(evt, sTip.m_Height);
+			if (vComm[i] == evt.m_Commitment)
+				ProcessUtxoEvent(batch, evt, sTip.m_Height);
 		}
 
+        SaveUtxoBatch(batch); // single transaction and notification for the whole response
+
         if (r.m_Res.m_Events.size() < proto::UtxoEvent::s_Max)
             SetUtxoEventsHeight(sTip.m_Height);
         else
@@ -664,12 +699,23 @@ namespace beam
         return h;
     }
 
-    void Wallet::ProcessUtxoEvent(const proto::UtxoEvent& evt, Height hTip)
+    void Wallet::ProcessUtxoEvent(UtxoBatch& batch, const proto::UtxoEvent& evt, Height hTip)
     {
         Coin c;
-        c.m_ID = evt.m_Kidv;
+        bool bExists;
 
-        bool bExists = m_WalletDB->find(c);
+        // the same coin may be added and spent within the batch
+        auto it = batch.find(evt.m_Kidv);
+        if (batch.end() != it)
+        {
+            c = it->second;
+            bExists = true;
+        }
+        else
+        {
+            c.m_ID = evt.m_Kidv;
+            bExists = m_WalletDB->find(c);
+        }
 
         //const TxID* pTxID = NULL;
 
@@ -688,6 +734,8 @@ namespace beam
 
             if (!bExists)
                 c.m_createHeight = evt.m_Height;
+
+            m_Commitments[c.m_ID] = evt.m_Commitment;
         }
         else
         {
@@ -696,10 +744,12 @@ namespace beam
 
             c.m_maturity = evt.m_Maturity;
             c.m_status = Coin::Status::Spent;
+
+            m_Commitments.erase(c.m_ID);
             //pTxID = c.m_spentTxId.get_ptr();
         }
 
-        m_WalletDB->save(c);
+        batch[c.m_ID] = c;
 
 /*        if (!pTxID)
             return;
@@ -720,6 +770,20 @@ namespace beam
         }*/
     }
 
+    void Wallet::SaveUtxoBatch(const UtxoBatch& batch)
+    {
+        if (batch.empty())
+            return;
+
+        std::vector<Coin> v;
+        v.reserve(batch.size());
+
+        for (const auto& x : batch)
+            v.push_back(x.second);
+
+        m_WalletDB->save(v);
+    }
+
     void Wallet::OnRolledBack()
     {
         Block::SystemState::Full sTip;
@@ -768,30 +832,47 @@ namespace beam
 
         RequestUtxoEvents();
 
-        auto t = m_Transactions;
-        for (auto& p : t)
+        // only the transactions that wait for the tip
+        std::unordered_set<wallet::BaseTransaction::Ptr> txSet;
+        txSet.swap(m_NextTipTransactionsToUpdate);
+
+        while (!m_HeightTransactionsToUpdate.empty())
         {
-            auto tx = p.second;
-            tx->Update();
+            auto itH = m_HeightTransactionsToUpdate.begin();
+            if (itH->first > sTip.m_Height)
+                break;
+
+            auto it = m_Transactions.find(itH->second);
+            if (it != m_Transactions.end())
+                txSet.insert(it->second);
+
+            m_HeightTransactionsToUpdate.erase(itH);
+        }
+
+        for (auto it = txSet.begin(); txSet.end() != it; it++)
+        {
+            wallet::BaseTransaction::Ptr pTx = *it;
+            if (m_Transactions.find(pTx->GetTxID()) != m_Transactions.end())
+                pTx->Update();
         }
 
         // try to restore utxo state after reset, rollback and etc..
-        uint32_t nUnconfirmed = 0;
-        m_WalletDB->visit([&nUnconfirmed, this](const Coin& c)->bool
+        vector<Coin::ID> vUnconfirmed;
+        m_WalletDB->visit([&vUnconfirmed, this](const Coin& c)->bool
         {
             if (c.m_status == Coin::Unavailable
                 && ((c.m_createTxId.is_initialized()
                 && (m_Transactions.find(*c.m_createTxId) == m_Transactions.end())) || c.isReward()))
             {
-                getUtxoProof(c.m_ID);
-                nUnconfirmed++;
+                vUnconfirmed.push_back(c.m_ID);
             }
             return true;
         });
 
-        if (nUnconfirmed)
+        if (!vUnconfirmed.empty())
         {
-            LOG_INFO() << "Found " << nUnconfirmed << " unconfirmed utxo to proof";
+            LOG_INFO() << "Found " << vUnconfirmed.size() << " unconfirmed utxo to proof";
+            getUtxoProofs(vUnconfirmed);
         }
 
         CheckSyncDone();
@@ -805,15 +886,49 @@ namespace beam
 
     void Wallet::getUtxoProof(const Coin::ID& cid)
     {
-        MyRequestUtxo::Ptr pReq(new MyRequestUtxo);
-        pReq->m_CoinID = cid;
+        getUtxoProofs(vector<Coin::ID>(1, cid));
+    }
+
+    void Wallet::getUtxoProofs(const vector<Coin::ID>& vIDs)
+    {
+        vector<Point> vComm;
+        get_Commitments(vIDs, vComm);
 
-		Scalar::Native sk;
-		m_WalletDB->calcCommitment(sk, pReq->m_Msg.m_Utxo, cid);
+        // posted back-to-back, the network sends them in batches
+        for (size_t i = 0; i < vIDs.size(); i++)
+        {
+            MyRequestUtxo::Ptr pReq(new MyRequestUtxo);
+            pReq->m_CoinID = vIDs[i];
+            pReq->m_Msg.m_Utxo = vComm[i];
 
-        LOG_DEBUG() << "Get utxo proof: " << pReq->m_Msg.m_Utxo;
+            LOG_DEBUG() << "Get utxo proof: " << pReq->m_Msg.m_Utxo;
 
-        PostReqUnique(*pReq);
+            PostReqUnique(*pReq);
+        }
+    }
+
+    void Wallet::get_Commitments(const vector<Coin::ID>& vIDs, vector<Point>& vRes)
+    {
+        vRes.resize(vIDs.size());
+
+        // the cache is filled by the confirmed coins only (ProcessUtxoEvent), not by the queries, which may be false positives
+        vector<size_t> vMissing;
+        for (size_t i = 0; i < vIDs.size(); i++)
+        {
+            auto it = m_Commitments.find(vIDs[i]);
+            if (m_Commitments.end() == it)
+                vMissing.push_back(i);
+            else
+                vRes[i] = it->second;
+        }
+
+        // key derivation and several multiplications per coin, the coins are independent
+        RunParallel(vMissing.size(), [this, &vIDs, &vMissing, &vRes](size_t i)
+        {
+            Scalar::Native sk;
+            m_WalletDB->calcCommitment(sk, vRes[vMissing[i]], vIDs[vMissing[i]]);
+            return true;
+        }, 16);
     }
 
     uint32_t Wallet::SyncRemains() const
@@ -964,7 +1079,7 @@ namespace beam
             t->SetParameter(TxParameterID::Message, message);
         }
 
-        m_Transactions.emplace(msg.m_TxID, t);
+        AddActiveTransaction(t);
         return t;
     }
 
@@ -979,4 +1094,10 @@ namespace beam
         }
         return wallet::BaseTransaction::Ptr();
     }
+
+    void Wallet::AddActiveTransaction(const wallet::BaseTransaction::Ptr& pTx)
+    {
+        m_Transactions.emplace(pTx->GetTxID(), pTx);
+        m_WalletDB->cacheTxParameters(pTx->GetTxID(), true); // until it's completed
+    }
 }
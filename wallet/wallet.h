@@ -85,6 +85,8 @@ namespace beam
         bool get_tip(Block::SystemState::Full& state) const override;
         void send_tx_params(const WalletID& peerID, wallet::SetTxParameter&&) override;
         void register_tx(const TxID& txId, Transaction::Ptr) override;
+        void update_on_next_tip(const TxID&) override;
+        void update_on_height(const TxID&, Height) override;
 
         void OnWalletMessage(const WalletID& peerID, wallet::SetTxParameter&&) override;
 
@@ -106,18 +108,23 @@ namespace beam
         uint32_t SyncRemains() const;
         void CheckSyncDone();
         void getUtxoProof(const Coin::ID&);
+        void getUtxoProofs(const std::vector<Coin::ID>&);
+        void get_Commitments(const std::vector<Coin::ID>&, std::vector<ECC::Point>&);
         void report_sync_progress();
         void notifySyncProgress();
         void updateTransaction(const TxID& txID);
         void saveKnownState();
         void RequestUtxoEvents();
         void AbortUtxoEvents();
-        void ProcessUtxoEvent(const proto::UtxoEvent&, Height hTip);
+        typedef std::map<Coin::ID, Coin> UtxoBatch; // coins modified by the events, saved at once
+        void ProcessUtxoEvent(UtxoBatch&, const proto::UtxoEvent&, Height hTip);
+        void SaveUtxoBatch(const UtxoBatch&);
         void SetUtxoEventsHeight(Height);
         Height GetUtxoEventsHeightNext();
 
         wallet::BaseTransaction::Ptr getTransaction(const WalletID& myID, const wallet::SetTxParameter& msg);
         wallet::BaseTransaction::Ptr constructTransaction(const TxID& id, wallet::TxType type);
+        void AddActiveTransaction(const wallet::BaseTransaction::Ptr&);
 
     private:
 
@@ -192,7 +199,10 @@ namespace beam
         proto::FlyClient::INetwork* m_pNodeNetwork;
         IWalletNetwork* m_pWalletNetwork;
         std::map<TxID, wallet::BaseTransaction::Ptr> m_Transactions;
+        std::map<Coin::ID, ECC::Point> m_Commitments; // of the confirmed unspent coins only. The derivation is expensive, and the same coins are queried repeatedly
         std::unordered_set<wallet::BaseTransaction::Ptr> m_TransactionsToUpdate;
+        std::unordered_set<wallet::BaseTransaction::Ptr> m_NextTipTransactionsToUpdate;
+        std::set<std::pair<Height, TxID> > m_HeightTransactionsToUpdate;
         TxCompletedAction m_TxCompletedAction;
         uint32_t m_LastSyncTotal;
         uint32_t m_OwnedNodesOnline;
@@ -325,6 +325,69 @@ namespace beam
 
         };
 
+        // Depth-first search for the inputs that match the amount exactly, so that no change is needed.
+        // Goes over the coins from the largest, skips the equal values on backtracking, and gives up after s_MaxTries steps.
+        struct CoinSelectorBnB
+        {
+            typedef std::vector<Coin> Coins;
+            typedef std::vector<size_t> Indexes;
+
+            const Coins& m_Coins; // input coins must be in ascending order
+
+            CoinSelectorBnB(const Coins& coins)
+                :m_Coins(coins)
+            {
+            }
+
+            static const uint32_t s_MaxTries = 100000;
+
+            bool Select(Amount amount, Indexes& res)
+            {
+                // sum of the coins below each position, to cut the branches that can't reach the amount
+                std::vector<Amount> vLower(m_Coins.size() + 1);
+                vLower[0] = 0;
+                for (size_t i = 0; i < m_Coins.size(); i++)
+                    vLower[i + 1] = vLower[i] + m_Coins[i].m_ID.m_Value;
+
+                res.clear();
+                Amount sum = 0;
+                size_t iNext = m_Coins.size(); // the next candidate is iNext-1
+
+                for (uint32_t nTries = 0; nTries < s_MaxTries; nTries++)
+                {
+                    if (sum == amount)
+                        return true;
+
+                    if (iNext && (sum + vLower[iNext] >= amount))
+                    {
+                        Amount v = m_Coins[--iNext].m_ID.m_Value;
+                        if (sum + v <= amount)
+                        {
+                            res.push_back(iNext);
+                            sum += v;
+                        }
+                        continue;
+                    }
+
+                    // backtrack, exclude the last selected coin and all the equal ones
+                    if (res.empty())
+                        break;
+
+                    size_t i = res.back();
+                    res.pop_back();
+
+                    Amount v = m_Coins[i].m_ID.m_Value;
+                    sum -= v;
+
+                    for (iNext = i; iNext && (m_Coins[iNext - 1].m_ID.m_Value == v); )
+                        iNext--;
+                }
+
+                res.clear();
+                return false;
+            }
+        };
+
         struct CoinSelector2
         {
             struct CoinEx
@@ -558,7 +621,7 @@ namespace beam
         };
 
         template<typename T>
-        void deserialize(T& value, ByteBuffer& blob)
+        void deserialize(T& value, const ByteBuffer& blob)
         {
             if (!blob.empty())
             {
@@ -572,7 +635,7 @@ namespace beam
             }
         }
 
-        void deserialize(ByteBuffer& value, ByteBuffer& blob)
+        void deserialize(ByteBuffer& value, const ByteBuffer& blob)
         {
             value = blob;
         }
@@ -580,14 +643,74 @@ namespace beam
 
     namespace sqlite
     {
-        struct Statement
+        // Compiled statements, kept for the lifetime of the WalletDB, so that the frequent queries
+        // aren't parsed and planned again on each call. Keyed by the SQL text, at most 1 idle instance per query.
+        // A statement that is already in use (nested queries) is prepared once more, and the extra copy is finalized on release.
+        struct StatementCache
         {
-            Statement(sqlite3* db, const char* sql)
+            StatementCache(sqlite3* db)
                 : _db(db)
-                , _stm(nullptr)
             {
-                int ret = sqlite3_prepare_v2(_db, sql, -1, &_stm, nullptr);
+            }
+
+            ~StatementCache()
+            {
+                clear();
+            }
+
+            sqlite3_stmt* acquire(const char* sql)
+            {
+                auto it = _idle.find(sql);
+                if ((_idle.end() != it) && it->second)
+                {
+                    sqlite3_stmt* stm = it->second;
+                    it->second = nullptr;
+                    return stm;
+                }
+
+                sqlite3_stmt* stm = nullptr;
+                int ret = sqlite3_prepare_v2(_db, sql, -1, &stm, nullptr);
                 throwIfError(ret, _db);
+                return stm;
+            }
+
+            void release(const char* sql, sqlite3_stmt* stm)
+            {
+                sqlite3_reset(stm);
+                sqlite3_clear_bindings(stm);
+
+                sqlite3_stmt*& slot = _idle[sql];
+                if (slot)
+                    sqlite3_finalize(stm);
+                else
+                    slot = stm;
+            }
+
+            void clear()
+            {
+                for (auto& x : _idle)
+                    sqlite3_finalize(x.second);
+                _idle.clear();
+            }
+
+            sqlite3* get_Db() const
+            {
+                return _db;
+            }
+
+        private:
+            sqlite3* _db;
+            unordered_map<string, sqlite3_stmt*> _idle;
+        };
+
+        struct Statement
+        {
+            Statement(StatementCache& cache, const char* sql)
+                : _cache(cache)
+                , _sql(sql)
+                , _db(cache.get_Db())
+                , _stm(cache.acquire(sql))
+            {
             }
 
             void Reset()
@@ -822,10 +945,12 @@ namespace beam
 
             ~Statement()
             {
-                sqlite3_finalize(_stm);
+                _cache.release(_sql, _stm);
             }
         private:
 
+            StatementCache& _cache;
+            const char* _sql;
             sqlite3 * _db;
             sqlite3_stmt* _stm;
         };
@@ -943,6 +1068,7 @@ namespace beam
                 throwIfError(ret, walletDB->_db);
             }
 
+            walletDB->m_Statements.reset(new sqlite::StatementCache(walletDB->_db));
             enterKey(walletDB->_db, password);
 
             {
@@ -1006,6 +1132,7 @@ namespace beam
                     throwIfError(ret, walletDB->_db);
                 }
 
+                walletDB->m_Statements.reset(new sqlite::StatementCache(walletDB->_db));
                 enterKey(walletDB->_db, password);
                 {
                     int ret = sqlite3_busy_timeout(walletDB->_db, BusyTimeoutMs);
@@ -1023,7 +1150,7 @@ namespace beam
 
 							// get rid of former Coin::Change status
 							const char* req = "UPDATE " STORAGE_NAME " SET status=?1 WHERE status=?2;";
-							sqlite::Statement stm(walletDB->_db, req);
+							sqlite::Statement stm(*walletDB->m_Statements, req);
 
 							stm.bind(1, Coin::Incoming);
 							stm.bind(2, Coin::ChangeV0);
@@ -1105,6 +1232,145 @@ namespace beam
         return Ptr();
     }
 
+    // In-memory mirror of the coins table with the running totals, so that the balance queries, the coin selection
+    // and the lookups don't scan the table. Loaded on the first use, updated along with the single-coin modifications,
+    // and dropped (reloaded on demand) after the bulk updates, such as rollbacks.
+    struct WalletDB::CoinIndex
+    {
+        struct Totals
+        {
+            Amount m_Value = 0;
+            std::map<Height, Amount> m_Maturity; // value by maturity, to exclude the coins that aren't matured yet
+        };
+
+        std::map<Key::ID, Coin> m_Coins;
+        std::map<std::pair<Coin::Status, uint32_t>, Totals> m_Totals; // by status and key type
+        std::set<std::pair<Amount, Key::ID>> m_Available; // by amount, for the coin selection
+        std::set<std::pair<Height, Key::ID>> m_Maturing; // by maturity
+
+        const Coin* Find(const Key::ID& kid) const
+        {
+            auto it = m_Coins.find(kid);
+            return (m_Coins.end() == it) ? nullptr : &it->second;
+        }
+
+        void Set(const Coin& c)
+        {
+            auto it = m_Coins.find(c.m_ID);
+            if (m_Coins.end() == it)
+                it = m_Coins.emplace(c.m_ID, c).first;
+            else
+            {
+                Link(it->second, false);
+                it->second = c;
+            }
+
+            Link(it->second, true);
+        }
+
+        void Remove(const Key::ID& kid)
+        {
+            auto it = m_Coins.find(kid);
+            if (m_Coins.end() != it)
+            {
+                Link(it->second, false);
+                m_Coins.erase(it);
+            }
+        }
+
+        // pType and hMaturity are optional filters
+        Amount get_Total(Coin::Status status, const Key::Type* pType, const Height* pMaturity) const
+        {
+            Amount ret = 0;
+
+            for (auto it = m_Totals.lower_bound(std::make_pair(status, pType ? uint32_t(*pType) : 0U)); m_Totals.end() != it; it++)
+            {
+                if ((it->first.first != status) || (pType && (it->first.second != *pType)))
+                    break;
+
+                const Totals& t = it->second;
+                ret += t.m_Value;
+
+                if (pMaturity)
+                    for (auto it2 = t.m_Maturity.upper_bound(*pMaturity); t.m_Maturity.end() != it2; it2++)
+                        ret -= it2->second;
+            }
+
+            return ret;
+        }
+
+    private:
+
+        void Link(const Coin& c, bool bAdd)
+        {
+            Amount val = c.m_ID.m_Value;
+            Totals& t = m_Totals[std::make_pair(c.m_status, uint32_t(c.m_ID.m_Type))];
+
+            if (bAdd)
+            {
+                t.m_Value += val;
+                t.m_Maturity[c.m_maturity] += val;
+            }
+            else
+            {
+                t.m_Value -= val;
+
+                auto it = t.m_Maturity.find(c.m_maturity);
+                if (t.m_Maturity.end() != it)
+                {
+                    it->second -= val;
+                    if (!it->second)
+                        t.m_Maturity.erase(it);
+                }
+            }
+
+            std::set<std::pair<Amount, Key::ID>>* pSet = nullptr;
+            Amount key = 0;
+
+            switch (c.m_status)
+            {
+            case Coin::Available:
+                pSet = &m_Available;
+                key = val;
+                break;
+
+            case Coin::Maturing:
+                pSet = &m_Maturing;
+                key = c.m_maturity;
+                break;
+
+            default:
+                return;
+            }
+
+            if (bAdd)
+                pSet->emplace(key, c.m_ID);
+            else
+                pSet->erase(std::make_pair(key, Key::ID(c.m_ID)));
+        }
+    };
+
+    WalletDB::CoinIndex& WalletDB::get_CoinIndex() const
+    {
+        if (!m_pCoinIndex)
+        {
+            std::unique_ptr<CoinIndex> pIdx(new CoinIndex);
+
+            sqlite::Statement stm(*m_Statements, "SELECT " STORAGE_FIELDS " FROM " STORAGE_NAME ";");
+            while (stm.step())
+            {
+                Coin coin;
+                int colIdx = 0;
+                ENUM_ALL_STORAGE_FIELDS(STM_GET_LIST, NOSEP, coin);
+                pIdx->Set(coin);
+            }
+
+            m_pCoinIndex = std::move(pIdx);
+        }
+
+        return *m_pCoinIndex;
+    }
+
     WalletDB::WalletDB()
         : _db(nullptr)
     {
@@ -1118,6 +1384,8 @@ namespace beam
 
     WalletDB::~WalletDB()
     {
+        m_Statements.reset(); // must be finalized before the close
+
         if (_db)
         {
             sqlite3_close_v2(_db);
@@ -1152,31 +1420,77 @@ namespace beam
         Block::SystemState::ID stateID = {};
         getSystemStateID(stateID);
 
+        CoinIndex& idx = get_CoinIndex();
+
+        // The candidates: the smallest coin that covers the amount alone, and the coins below it, from the largest down.
+        // Of equal coins no more are taken than enough to cover the amount, and the smallest are dropped once there are
+        // s_MaxCandidates coins that cover it. So the work doesn't depend on the total number of coins.
+        auto itBig = idx.m_Available.lower_bound(std::make_pair(amount, Key::ID(Zero)));
+        Amount sum = 0;
+
+        for (auto itEnd = itBig; (idx.m_Available.begin() != itEnd) && ((coins.size() < s_MaxCandidates) || (sum < amount)); )
         {
-            sqlite::Statement stm(_db, "SELECT " STORAGE_FIELDS " FROM " STORAGE_NAME " WHERE status=?1 AND maturity<=?2 ORDER BY amount ASC");
-            stm.bind(1, Coin::Available);
-            stm.bind(2, stateID.m_Height);
+            Amount v = std::prev(itEnd)->first;
+            if (!v)
+                break;
 
-            while (stm.step())
+            auto it = idx.m_Available.lower_bound(std::make_pair(v, Key::ID(Zero)));
+            itEnd = it;
+
+            for (Amount nMax = (amount + v - 1) / v; nMax && (idx.m_Available.end() != it) && (it->first == v); it++)
             {
-                auto& coin = coins.emplace_back();
-                int colIdx = 0;
-                ENUM_ALL_STORAGE_FIELDS(STM_GET_LIST, NOSEP, coin);
+                const Coin& coin = *idx.Find(it->second);
+                if (coin.m_maturity <= stateID.m_Height)
+                {
+                    coins.push_back(coin);
+                    sum += v;
+                    nMax--;
+                }
+            }
+        }
 
-                if (coin.m_ID.m_Value >= amount)
-                    break;
+        std::reverse(coins.begin(), coins.end());
+
+        for (; idx.m_Available.end() != itBig; itBig++)
+        {
+            const Coin& coin = *idx.Find(itBig->second);
+            if (coin.m_maturity <= stateID.m_Height)
+            {
+                coins.push_back(coin);
+                break;
             }
         }
 
-        CoinSelector3 csel(coins);
-        CoinSelector3::Result res = csel.Select(amount);
+        CoinSelector3::Result res;
+        if (CoinSelectorBnB(coins).Select(amount, res.second))
+            res.first = amount;
+        else
+            res = CoinSelector3(coins).Select(amount);
 
         if (res.first >= amount)
         {
             coinsSel.reserve(res.second.size());
 
+            Amount nMinSel = amount;
             for (size_t j = 0; j < res.second.size(); j++)
+            {
+                nMinSel = std::min(nMinSel, coins[res.second[j]].m_ID.m_Value);
                 coinsSel.push_back(std::move(coins[res.second[j]]));
+            }
+
+            // merge the dust, smaller than any of the selected coins, if configured
+            uint32_t nConsolidate = 0;
+            wallet::getVar(*this, wallet::g_szCoinsConsolidate, nConsolidate);
+
+            for (auto it = idx.m_Available.begin(); nConsolidate && (idx.m_Available.end() != it) && (it->first < nMinSel); it++)
+            {
+                const Coin& coin = *idx.Find(it->second);
+                if (it->first && (coin.m_maturity <= stateID.m_Height))
+                {
+                    coinsSel.push_back(coin);
+                    nConsolidate--;
+                }
+            }
 
             if (lock)
             {
@@ -1186,7 +1500,7 @@ namespace beam
                 {
                     coin.m_status = Coin::Outgoing;
                     const char* req = "UPDATE " STORAGE_NAME " SET status=?, lockedHeight=?" STORAGE_WHERE_ID;
-                    sqlite::Statement stm(_db, req);
+                    sqlite::Statement stm(*m_Statements, req);
 
                     int colIdx = 0;
                     stm.bind(++colIdx, coin.m_status);
@@ -1198,6 +1512,13 @@ namespace beam
 
                 trans.commit();
 
+                for (const auto& coin : coinsSel)
+                {
+                    Coin c = coin;
+                    c.m_lockedHeight = stateID.m_Height;
+                    idx.Set(c);
+                }
+
                 notifyCoinsChanged();
             }
         }
@@ -1209,7 +1530,7 @@ namespace beam
     std::vector<Coin> WalletDB::getCoinsCreatedByTx(const TxID& txId)
     {
         // select all coins for TxID
-        sqlite::Statement stm(_db, "SELECT " STORAGE_FIELDS " FROM " STORAGE_NAME " WHERE createTxID=?1 ORDER BY amount DESC;");
+        sqlite::Statement stm(*m_Statements, "SELECT " STORAGE_FIELDS " FROM " STORAGE_NAME " WHERE createTxID=?1 ORDER BY amount DESC;");
         stm.bind(1, txId);
 
         vector<Coin> coins;
@@ -1228,8 +1549,8 @@ namespace beam
     {
         struct InsertCoinStatement : public sqlite::Statement
         {
-            InsertCoinStatement(sqlite3* db)
-                : sqlite::Statement(db, "INSERT OR REPLACE INTO " STORAGE_NAME " (" ENUM_ALL_STORAGE_FIELDS(LIST, COMMA, ) ") VALUES(" ENUM_ALL_STORAGE_FIELDS(BIND_LIST, COMMA, ) ");")
+            InsertCoinStatement(sqlite::StatementCache& cache)
+                : sqlite::Statement(cache, "INSERT OR REPLACE INTO " STORAGE_NAME " (" ENUM_ALL_STORAGE_FIELDS(LIST, COMMA, ) ") VALUES(" ENUM_ALL_STORAGE_FIELDS(BIND_LIST, COMMA, ) ");")
             {
             }
 
@@ -1250,10 +1571,14 @@ namespace beam
         sqlite::Transaction trans(_db);
 
         coin.m_ID.m_Idx = AllocateKidRange(1);
-        InsertCoinStatement stm(_db);
+        InsertCoinStatement stm(*m_Statements);
         stm.apply(coin);
 
         trans.commit();
+
+        if (m_pCoinIndex)
+            m_pCoinIndex->Set(coin);
+
         notifyCoinsChanged();
     }
 
@@ -1265,7 +1590,7 @@ namespace beam
         sqlite::Transaction trans(_db);
 
         uint64_t nKeyIndex = AllocateKidRange(coins.size());
-        InsertCoinStatement stm(_db);
+        InsertCoinStatement stm(*m_Statements);
         for (auto& coin : coins)
         {
             coin.m_ID.m_Idx = nKeyIndex++;
@@ -1273,13 +1598,22 @@ namespace beam
         }
 
         trans.commit();
+
+        if (m_pCoinIndex)
+            for (const auto& coin : coins)
+                m_pCoinIndex->Set(coin);
+
         notifyCoinsChanged();
     }
 
     void WalletDB::save(const Coin& coin)
     {
-        InsertCoinStatement stm(_db);
+        InsertCoinStatement stm(*m_Statements);
         stm.apply(coin);
+
+        if (m_pCoinIndex)
+            m_pCoinIndex->Set(coin);
+
         notifyCoinsChanged();
     }
 
@@ -1289,13 +1623,18 @@ namespace beam
             return;
 
         sqlite::Transaction trans(_db);
-        InsertCoinStatement stm(_db);
+        InsertCoinStatement stm(*m_Statements);
         for (auto& coin : coins)
         {
             stm.apply(coin);
         }
 
         trans.commit();
+
+        if (m_pCoinIndex)
+            for (const auto& coin : coins)
+                m_pCoinIndex->Set(coin);
+
         notifyCoinsChanged();
     }
 
@@ -1340,7 +1679,7 @@ namespace beam
     void WalletDB::removeImpl(const Coin::ID& cid)
     {
         const char* req = "DELETE FROM " STORAGE_NAME STORAGE_WHERE_ID;
-        sqlite::Statement stm(_db, req);
+        sqlite::Statement stm(*m_Statements, req);
 
         struct DummyWrapper {
             Coin::ID m_ID;
@@ -1353,6 +1692,9 @@ namespace beam
         STORAGE_BIND_ID(wrp)
 
         stm.step();
+
+        if (m_pCoinIndex)
+            m_pCoinIndex->Remove(cid);
     }
 
     void WalletDB::remove(const Coin::ID& cid)
@@ -1364,52 +1706,66 @@ namespace beam
     void WalletDB::clear()
     {
         {
-            sqlite::Statement stm(_db, "DELETE FROM " STORAGE_NAME ";");
+            sqlite::Statement stm(*m_Statements, "DELETE FROM " STORAGE_NAME ";");
             stm.step();
+            m_pCoinIndex.reset();
             notifyCoinsChanged();
         }
     }
 
     bool WalletDB::find(Coin& coin)
     {
-        const char* req = "SELECT " ENUM_STORAGE_FIELDS(LIST, COMMA, ) " FROM " STORAGE_NAME STORAGE_WHERE_ID;
-        sqlite::Statement stm(_db, req);
-
-        int colIdx = 0;
-        STORAGE_BIND_ID(coin)
-
-        if (!stm.step())
+        const Coin* pCoin = get_CoinIndex().Find(coin.m_ID);
+        if (!pCoin)
             return false;
 
-        colIdx = 0;
-        ENUM_STORAGE_FIELDS(STM_GET_LIST, NOSEP, coin);
-
+        coin = *pCoin;
         return true;
     }
 
     void WalletDB::updateCoinMaturityStatus()
     {
+        CoinIndex& idx = get_CoinIndex();
+        Height h = getCurrentHeight();
+
+        std::vector<Coin> vMatured;
+        for (auto it = idx.m_Maturing.begin(); (idx.m_Maturing.end() != it) && (it->first <= h); it++)
+            vMatured.push_back(*idx.Find(it->second));
+
+        if (vMatured.empty())
+        {
+            notifyCoinsChanged();
+            return;
+        }
+
         sqlite::Transaction trans(_db);
 
         {
             const char* req = "UPDATE " STORAGE_NAME " SET status=?3 WHERE status=?1 AND maturity <= ?2;";
-            sqlite::Statement stm(_db, req);
+            sqlite::Statement stm(*m_Statements, req);
 
             stm.bind(1, Coin::Maturing);
-            stm.bind(2, getCurrentHeight());
+            stm.bind(2, h);
             stm.bind(3, Coin::Available);
 
             stm.step();
         }
 
         trans.commit();
+
+        for (auto& coin : vMatured)
+        {
+            coin.m_status = Coin::Available;
+            idx.Set(coin);
+        }
+
         notifyCoinsChanged();
     }
 
     void WalletDB::visit(function<bool(const Coin& coin)> func)
     {
         const char* req = "SELECT " STORAGE_FIELDS " FROM " STORAGE_NAME " ORDER BY " ENUM_STORAGE_ID(LIST, COMMA, ) ";";
-        sqlite::Statement stm(_db, req);
+        sqlite::Statement stm(*m_Statements, req);
 
         while (stm.step())
         {
@@ -1427,7 +1783,7 @@ namespace beam
     {
         const char* req = "INSERT or REPLACE INTO " VARIABLES_NAME " (" VARIABLES_FIELDS ") VALUES(?1, ?2);";
 
-        sqlite::Statement stm(_db, req);
+        sqlite::Statement stm(*m_Statements, req);
 
         stm.bind(1, name);
         stm.bind(2, data, size);
@@ -1439,7 +1795,7 @@ namespace beam
     {
         const char* req = "SELECT value FROM " VARIABLES_NAME " WHERE name=?1;";
 
-        sqlite::Statement stm(_db, req);
+        sqlite::Statement stm(*m_Statements, req);
         stm.bind(1, name);
 
         return
@@ -1451,7 +1807,7 @@ namespace beam
     {
         const char* req = "SELECT value FROM " VARIABLES_NAME " WHERE name=?1;";
 
-        sqlite::Statement stm(_db, req);
+        sqlite::Statement stm(*m_Statements, req);
         stm.bind(1, name);
         if (stm.step())
         {
@@ -1505,7 +1861,7 @@ namespace beam
             vector<TxID> rollbackedTransaction;
             {
                 const char* req = "SELECT * FROM " TX_PARAMS_NAME " WHERE paramID = ?1 ;";
-                sqlite::Statement stm(_db, req);
+                sqlite::Statement stm(*m_Statements, req);
                 stm.bind(1, wallet::TxParameterID::KernelProofHeight);
                 while (stm.step())
                 {
@@ -1526,7 +1882,7 @@ namespace beam
 
                 {
                     const char* req = "UPDATE " STORAGE_NAME " SET status=?1 WHERE spentTxId = ?2 ;";
-                    sqlite::Statement stm(_db, req);
+                    sqlite::Statement stm(*m_Statements, req);
                     stm.bind(1, Coin::Outgoing);
                     stm.bind(2, tx);
                     stm.step();
@@ -1534,7 +1890,7 @@ namespace beam
 
                 {
                     const char* req = "UPDATE " STORAGE_NAME " SET status=?1, confirmHeight=?2 WHERE createTxId = ?3 ;";
-                    sqlite::Statement stm(_db, req);
+                    sqlite::Statement stm(*m_Statements, req);
                     stm.bind(1, Coin::Incoming);
                     stm.bind(2, MaxHeight);
                     stm.bind(3, tx);
@@ -1546,7 +1902,7 @@ namespace beam
         // rollback restored utxos or coinbase
         {
             const char* req = "UPDATE " STORAGE_NAME " SET status=?1, confirmHeight=?2, lockedHeight=?2 WHERE confirmHeight > ?3 AND createTxId IS NULL ;";
-            sqlite::Statement stm(_db, req);
+            sqlite::Statement stm(*m_Statements, req);
             stm.bind(1, Coin::Unavailable);
             stm.bind(2, MaxHeight);
             stm.bind(3, minHeight);
@@ -1555,7 +1911,7 @@ namespace beam
 
         {
             const char* req = "UPDATE " STORAGE_NAME " SET status=?1, lockedHeight=?2 WHERE lockedHeight > ?3 AND confirmHeight <= ?3 AND spentTxId IS NULL ;";
-            sqlite::Statement stm(_db, req);
+            sqlite::Statement stm(*m_Statements, req);
             stm.bind(1, Coin::Available);
             stm.bind(2, MaxHeight);
             stm.bind(3, minHeight);
@@ -1563,6 +1919,7 @@ namespace beam
         }
 
         trans.commit();
+        m_pCoinIndex.reset();
         notifyCoinsChanged();
     }
 
@@ -1571,7 +1928,7 @@ namespace beam
         // TODO this is temporary solution
         int txCount = 0;
         {
-            sqlite::Statement stm(_db, "SELECT COUNT(DISTINCT txID) FROM " TX_PARAMS_NAME " ;");
+            sqlite::Statement stm(*m_Statements, "SELECT COUNT(DISTINCT txID) FROM " TX_PARAMS_NAME " ;");
             stm.step();
             stm.get(0, txCount);
         }
@@ -1582,7 +1939,7 @@ namespace beam
             res.reserve(static_cast<size_t>(min(txCount, count)));
             const char* req = "SELECT DISTINCT txID FROM " TX_PARAMS_NAME " LIMIT ?1 OFFSET ?2 ;";
 
-            sqlite::Statement stm(_db, req);
+            sqlite::Statement stm(*m_Statements, req);
             stm.bind(1, count);
             stm.bind(2, start);
 
@@ -1604,9 +1961,14 @@ namespace beam
 
     boost::optional<TxDescription> WalletDB::getTx(const TxID& txId)
     {
-        const char* req = "SELECT * FROM " TX_PARAMS_NAME " WHERE txID=?1;";
-        sqlite::Statement stm(_db, req);
-        stm.bind(1, txId);
+        // the history reads aren't cached, only the active transactions are
+        TxParameters paramsLoaded;
+        const TxParameters* pParams = find_TxParameters(txId);
+        if (!pParams)
+        {
+            load_TxParameters(txId, paramsLoaded);
+            pParams = &paramsLoaded;
+        }
 
         TxDescription txDescription;
         txDescription.m_txId = txId;
@@ -1617,51 +1979,47 @@ namespace beam
             wallet::TxParameterID::IsSender };
         std::set<wallet::TxParameterID> gottenParams;
 
-        while (stm.step())
+        for (const auto& p : *pParams)
         {
-            TxParameter parameter = {};
-            int colIdx = 0;
-            ENUM_TX_PARAMS_FIELDS(STM_GET_LIST, NOSEP, parameter);
-
-            gottenParams.emplace(static_cast<wallet::TxParameterID>(parameter.m_paramID));
+            gottenParams.emplace(p.first);
 
-            switch (static_cast<wallet::TxParameterID>(parameter.m_paramID))
+            switch (p.first)
             {
             case wallet::TxParameterID::Amount:
-                deserialize(txDescription.m_amount, parameter.m_value);
+                deserialize(txDescription.m_amount, p.second);
                 break;
             case wallet::TxParameterID::Fee:
-                deserialize(txDescription.m_fee, parameter.m_value);
+                deserialize(txDescription.m_fee, p.second);
                 break;
             case wallet::TxParameterID::MinHeight:
-                deserialize(txDescription.m_minHeight, parameter.m_value);
+                deserialize(txDescription.m_minHeight, p.second);
                 break;
             case wallet::TxParameterID::PeerID:
-                deserialize(txDescription.m_peerId, parameter.m_value);
+                deserialize(txDescription.m_peerId, p.second);
                 break;
             case wallet::TxParameterID::MyID:
-                deserialize(txDescription.m_myId, parameter.m_value);
+                deserialize(txDescription.m_myId, p.second);
                 break;
             case wallet::TxParameterID::CreateTime:
-                deserialize(txDescription.m_createTime, parameter.m_value);
+                deserialize(txDescription.m_createTime, p.second);
                 break;
             case wallet::TxParameterID::IsSender:
-                deserialize(txDescription.m_sender, parameter.m_value);
+                deserialize(txDescription.m_sender, p.second);
                 break;
             case wallet::TxParameterID::Message:
-                deserialize(txDescription.m_message, parameter.m_value);
+                deserialize(txDescription.m_message, p.second);
                 break;
             case wallet::TxParameterID::Change:
-                deserialize(txDescription.m_change, parameter.m_value);
+                deserialize(txDescription.m_change, p.second);
                 break;
             case wallet::TxParameterID::ModifyTime:
-                deserialize(txDescription.m_modifyTime, parameter.m_value);
+                deserialize(txDescription.m_modifyTime, p.second);
                 break;
             case wallet::TxParameterID::Status:
-                deserialize(txDescription.m_status, parameter.m_value);
+                deserialize(txDescription.m_status, p.second);
                 break;
             case wallet::TxParameterID::KernelID:
-                deserialize(txDescription.m_kernelID, parameter.m_value);
+                deserialize(txDescription.m_kernelID, p.second);
                 break;
 			default:
 				break; // suppress warning
@@ -1679,6 +2037,15 @@ namespace beam
     void WalletDB::saveTx(const TxDescription& p)
     {
         ChangeAction action = ChangeAction::Added;
+
+        // the parameters are written to the db only, the cache is reloaded once the whole tx is committed
+        struct Guard
+        {
+            bool& m_b;
+            Guard(bool& b) :m_b(b) { m_b = true; }
+            ~Guard() { m_b = false; }
+        } guard(m_bSavingTx);
+
         sqlite::Transaction trans(_db);
 
         wallet::setTxParameter(*this, p.m_txId, wallet::TxParameterID::Amount, p.m_amount, false);
@@ -1693,7 +2060,9 @@ namespace beam
         wallet::setTxParameter(*this, p.m_txId, wallet::TxParameterID::IsSender, p.m_sender, false);
         wallet::setTxParameter(*this, p.m_txId, wallet::TxParameterID::Status, p.m_status, false);
 
-        trans.commit();
+        if (trans.commit() && find_TxParameters(p.m_txId))
+            cacheTxParameters(p.m_txId, true);
+
         // notify only when full TX saved
         notifyTransactionChanged(action, {p});
     }
@@ -1704,11 +2073,12 @@ namespace beam
         if (tx.is_initialized())
         {
             const char* req = "DELETE FROM " TX_PARAMS_NAME " WHERE txID=?1;";
-            sqlite::Statement stm(_db, req);
+            sqlite::Statement stm(*m_Statements, req);
 
             stm.bind(1, txId);
 
             stm.step();
+            m_TxParameters.erase(txId);
             notifyTransactionChanged(ChangeAction::Removed, { *tx });
         }
     }
@@ -1719,7 +2089,7 @@ namespace beam
 
         {
             const char* req = "UPDATE " STORAGE_NAME " SET status=?3, spentTxId=NULL WHERE spentTxId=?1 AND status=?2;";
-            sqlite::Statement stm(_db, req);
+            sqlite::Statement stm(*m_Statements, req);
             stm.bind(1, txId);
             stm.bind(2, Coin::Outgoing);
             stm.bind(3, Coin::Available);
@@ -1727,12 +2097,13 @@ namespace beam
         }
         {
             const char* req = "DELETE FROM " STORAGE_NAME " WHERE createTxId=?1 AND status=?2;";
-            sqlite::Statement stm(_db, req);
+            sqlite::Statement stm(*m_Statements, req);
             stm.bind(1, txId);
 			stm.bind(2, Coin::Incoming);
 			stm.step();
         }
         trans.commit();
+        m_pCoinIndex.reset();
         notifyCoinsChanged();
     }
 
@@ -1741,7 +2112,7 @@ namespace beam
         vector<WalletAddress> res;
         const char* req = "SELECT * FROM " ADDRESSES_NAME " ORDER BY createTime DESC;";
 
-        sqlite::Statement stm(_db, req);
+        sqlite::Statement stm(*m_Statements, req);
 
         while (stm.step())
         {
@@ -1761,13 +2132,13 @@ namespace beam
 
         {
             const char* selectReq = "SELECT * FROM " ADDRESSES_NAME " WHERE walletID=?1;";
-            sqlite::Statement stm2(_db, selectReq);
+            sqlite::Statement stm2(*m_Statements, selectReq);
             stm2.bind(1, address.m_walletID);
 
             if (stm2.step())
             {
                 const char* updateReq = "UPDATE " ADDRESSES_NAME " SET label=?2, category=?3, duration=?4, createTime=?5 WHERE walletID=?1;";
-                sqlite::Statement stm(_db, updateReq);
+                sqlite::Statement stm(*m_Statements, updateReq);
 
                 stm.bind(1, address.m_walletID);
                 stm.bind(2, address.m_label);
@@ -1779,7 +2150,7 @@ namespace beam
             else
             {
                 const char* insertReq = "INSERT INTO " ADDRESSES_NAME " (" ENUM_ADDRESS_FIELDS(LIST, COMMA, ) ") VALUES(" ENUM_ADDRESS_FIELDS(BIND_LIST, COMMA, ) ");";
-                sqlite::Statement stm(_db, insertReq);
+                sqlite::Statement stm(*m_Statements, insertReq);
                 int colIdx = 0;
                 ENUM_ADDRESS_FIELDS(STM_BIND_LIST, NOSEP, address);
                 stm.step();
@@ -1797,7 +2168,7 @@ namespace beam
 
         {
             const char* updateReq = "UPDATE " ADDRESSES_NAME " SET duration = ?1 WHERE OwnID != 0;";
-            sqlite::Statement stm(_db, updateReq);
+            sqlite::Statement stm(*m_Statements, updateReq);
 
             stm.bind(1, 0);
 
@@ -1813,7 +2184,7 @@ namespace beam
     boost::optional<WalletAddress> WalletDB::getAddress(const WalletID& id)
     {
         const char* req = "SELECT * FROM " ADDRESSES_NAME " WHERE walletID=?1;";
-        sqlite::Statement stm(_db, req);
+        sqlite::Statement stm(*m_Statements, req);
 
         stm.bind(1, id);
 
@@ -1830,7 +2201,7 @@ namespace beam
     void WalletDB::deleteAddress(const WalletID& id)
     {
         const char* req = "DELETE FROM " ADDRESSES_NAME " WHERE walletID=?1;";
-        sqlite::Statement stm(_db, req);
+        sqlite::Statement stm(*m_Statements, req);
 
         stm.bind(1, id);
 
@@ -1858,6 +2229,8 @@ namespace beam
 
     void WalletDB::changePassword(const SecString& password)
     {
+        m_Statements->clear();
+
         int ret = sqlite3_rekey(_db, password.data(), static_cast<int>(password.size()));
         throwIfError(ret, _db);
     }
@@ -1865,12 +2238,21 @@ namespace beam
     bool WalletDB::setTxParameter(const TxID& txID, wallet::TxParameterID paramID, const ByteBuffer& blob, bool shouldNotifyAboutChanges)
     {
         bool hasTx = getTx(txID).is_initialized();
+        TxParameters* pParams = m_bSavingTx ? nullptr : find_TxParameters(txID);
         {
-            sqlite::Statement stm(_db, "SELECT * FROM " TX_PARAMS_NAME " WHERE txID=?1 AND paramID=?2;");
+            bool bExists = false;
+            if (pParams)
+                bExists = (pParams->end() != pParams->find(paramID));
+            else
+            {
+                sqlite::Statement stm(*m_Statements, "SELECT * FROM " TX_PARAMS_NAME " WHERE txID=?1 AND paramID=?2;");
+
+                stm.bind(1, txID);
+                stm.bind(2, paramID);
+                bExists = stm.step();
+            }
 
-            stm.bind(1, txID);
-            stm.bind(2, paramID);
-            if (stm.step())
+            if (bExists)
             {
                 // already set
                 if (paramID < wallet::TxParameterID::PrivateFirstParam)
@@ -1878,11 +2260,13 @@ namespace beam
                     return false;
                 }
 
-                sqlite::Statement stm2(_db, "UPDATE " TX_PARAMS_NAME  " SET value = ?3 WHERE txID = ?1 AND paramID = ?2;");
+                sqlite::Statement stm2(*m_Statements, "UPDATE " TX_PARAMS_NAME  " SET value = ?3 WHERE txID = ?1 AND paramID = ?2;");
                 stm2.bind(1, txID);
                 stm2.bind(2, paramID);
                 stm2.bind(3, blob);
                 stm2.step();
+                if (pParams)
+                    (*pParams)[paramID] = blob;
                 if (shouldNotifyAboutChanges)
                 {
                     auto tx = getTx(txID);
@@ -1895,7 +2279,7 @@ namespace beam
             }
         }
         
-        sqlite::Statement stm(_db, "INSERT INTO " TX_PARAMS_NAME " (" ENUM_TX_PARAMS_FIELDS(LIST, COMMA, ) ") VALUES(" ENUM_TX_PARAMS_FIELDS(BIND_LIST, COMMA, ) ");");
+        sqlite::Statement stm(*m_Statements, "INSERT INTO " TX_PARAMS_NAME " (" ENUM_TX_PARAMS_FIELDS(LIST, COMMA, ) ") VALUES(" ENUM_TX_PARAMS_FIELDS(BIND_LIST, COMMA, ) ");");
         TxParameter parameter;
         parameter.m_txID = txID;
         parameter.m_paramID = static_cast<int>(paramID);
@@ -1903,6 +2287,8 @@ namespace beam
         int colIdx = 0;
         ENUM_TX_PARAMS_FIELDS(STM_BIND_LIST, NOSEP, parameter);
         stm.step();
+        if (pParams)
+            (*pParams)[paramID] = blob;
         if (shouldNotifyAboutChanges)
         {
             auto tx = getTx(txID);
@@ -1916,7 +2302,18 @@ namespace beam
 
     bool WalletDB::getTxParameter(const TxID& txID, wallet::TxParameterID paramID, ByteBuffer& blob) const
     {
-        sqlite::Statement stm(_db, "SELECT * FROM " TX_PARAMS_NAME " WHERE txID=?1 AND paramID=?2;");
+        auto it = m_TxParameters.find(txID);
+        if (m_TxParameters.end() != it)
+        {
+            TxParameters::const_iterator itParam = it->second.find(paramID);
+            if (it->second.end() == itParam)
+                return false;
+
+            blob = itParam->second;
+            return true;
+        }
+
+        sqlite::Statement stm(*m_Statements, "SELECT * FROM " TX_PARAMS_NAME " WHERE txID=?1 AND paramID=?2;");
 
         stm.bind(1, txID);
         stm.bind(2, paramID);
@@ -1932,6 +2329,39 @@ namespace beam
         return false;
     }
 
+    void WalletDB::cacheTxParameters(const TxID& txID, bool enable)
+    {
+        if (enable)
+        {
+            // all the parameters of the tx in a single query, the tx is going to read most of them
+            TxParameters params;
+            load_TxParameters(txID, params);
+            m_TxParameters[txID].swap(params);
+        }
+        else
+            m_TxParameters.erase(txID);
+    }
+
+    WalletDB::TxParameters* WalletDB::find_TxParameters(const TxID& txID)
+    {
+        auto it = m_TxParameters.find(txID);
+        return (m_TxParameters.end() == it) ? nullptr : &it->second;
+    }
+
+    void WalletDB::load_TxParameters(const TxID& txID, TxParameters& params) const
+    {
+        sqlite::Statement stm(*m_Statements, "SELECT * FROM " TX_PARAMS_NAME " WHERE txID=?1;");
+        stm.bind(1, txID);
+
+        while (stm.step())
+        {
+            TxParameter parameter = {};
+            int colIdx = 0;
+            ENUM_TX_PARAMS_FIELDS(STM_GET_LIST, NOSEP, parameter);
+            params[static_cast<wallet::TxParameterID>(parameter.m_paramID)] = move(parameter.m_value);
+        }
+    }
+
     void WalletDB::notifyCoinsChanged()
     {
         for (auto sub : m_subscribers) sub->onCoinsChanged();
@@ -1970,7 +2400,7 @@ namespace beam
             if (s.m_Height > hMaxBacklog)
             {
                 const char* req = "DELETE FROM " TblStates " WHERE " TblStates_Height "<=?";
-                sqlite::Statement stm(_db, req);
+                sqlite::Statement stm(*m_Statements, req);
                 stm.bind(1, s.m_Height - hMaxBacklog);
                 stm.step();
 
@@ -1980,75 +2410,31 @@ namespace beam
 
     Amount WalletDB::getAvailable() const
     {
-        auto currentHeight = getCurrentHeight();
-        const char* req = "SELECT SUM(amount) FROM " STORAGE_NAME " WHERE status = ?1 AND maturity <= ?2;";
-        sqlite::Statement stm(_db, req);
-        stm.bind(1, Coin::Available);
-        stm.bind(2, currentHeight);
-
-        Amount result = 0;
-
-        if (stm.step())
-        {
-            stm.get(0, result);
-        }
-        return result;
+        Height h = getCurrentHeight();
+        return get_CoinIndex().get_Total(Coin::Available, nullptr, &h);
     }
 
     Amount WalletDB::getAvailableByType(Key::Type keyType) const
     {
-        auto currentHeight = getCurrentHeight();
-        const char* req = "SELECT SUM(amount) FROM " STORAGE_NAME " WHERE status = ?1 AND type = ?2 AND maturity <= ?3;";
-        sqlite::Statement stm(_db, req);
-        stm.bind(1, Coin::Available);
-        stm.bind(2, keyType);
-        stm.bind(3, currentHeight);
-
-        Amount result = 0;
-
-        if (stm.step())
-        {
-            stm.get(0, result);
-        }
-        return result;
+        Height h = getCurrentHeight();
+        return get_CoinIndex().get_Total(Coin::Available, &keyType, &h);
     }
 
     Amount WalletDB::getTotal(Coin::Status status) const
     {
-        const char* req = "SELECT SUM(amount) FROM " STORAGE_NAME " WHERE status = ?1;";
-        sqlite::Statement stm(_db, req);
-        stm.bind(1, status);
-
-        Amount result = 0;
-
-        if (stm.step())
-        {
-            stm.get(0, result);
-        }
-        return result;
+        return get_CoinIndex().get_Total(status, nullptr, nullptr);
     }
     
     Amount WalletDB::getTotalByType(Coin::Status status, Key::Type keyType) const
     {
-        const char* req = "SELECT SUM(amount) FROM " STORAGE_NAME " WHERE status = ?1 AND type = ?2;";
-        sqlite::Statement stm(_db, req);
-        stm.bind(1, status);
-        stm.bind(2, keyType);
-
-        Amount result = 0;
-
-        if (stm.step())
-        {
-            stm.get(0, result);
-        }
-        return result;
+        return get_CoinIndex().get_Total(status, &keyType, nullptr);
     }
 
     Amount WalletDB::getTransferredByTx(TxStatus status, bool isSender) const
     {
         const char* req = "SELECT value FROM " TX_PARAMS_NAME " WHERE paramID = ?5 AND txID IN (SELECT txID FROM " TX_PARAMS_NAME " WHERE paramID= ?1 AND value = ?2 AND txID IN (SELECT txID FROM " TX_PARAMS_NAME " WHERE paramID= ?3 AND value = ?4 ));";
 
-        sqlite::Statement stm(_db, req);
+        sqlite::Statement stm(*m_Statements, req);
         ByteBuffer blobStatus = wallet::toByteBuffer(status);
         ByteBuffer blobIsSender = wallet::toByteBuffer(isSender);
 
@@ -2078,7 +2464,7 @@ namespace beam
             "SELECT " TblStates_Hdr " FROM " TblStates " WHERE " TblStates_Height "<? ORDER BY " TblStates_Height " DESC" :
             "SELECT " TblStates_Hdr " FROM " TblStates " ORDER BY " TblStates_Height " DESC";
 
-        sqlite::Statement stm(get_ParentObj()._db, req);
+        sqlite::Statement stm(*get_ParentObj().m_Statements, req);
 
         if (pBelow)
             stm.bind(1, *pBelow);
@@ -2099,7 +2485,7 @@ namespace beam
     {
         const char* req = "SELECT " TblStates_Hdr " FROM " TblStates " WHERE " TblStates_Height "=?";
 
-        sqlite::Statement stm(get_ParentObj()._db, req);
+        sqlite::Statement stm(*get_ParentObj().m_Statements, req);
         stm.bind(1, h);
 
         if (!stm.step())
@@ -2114,7 +2500,7 @@ namespace beam
         sqlite::Transaction trans(get_ParentObj()._db);
 
         const char* req = "INSERT OR REPLACE INTO " TblStates " (" TblStates_Height "," TblStates_Hdr ") VALUES(?,?)";
-        sqlite::Statement stm(get_ParentObj()._db, req);
+        sqlite::Statement stm(*get_ParentObj().m_Statements, req);
 
         for (size_t i = 0; i < nCount; i++)
         {
@@ -2133,7 +2519,7 @@ namespace beam
     void WalletDB::History::DeleteFrom(Height h)
     {
         const char* req = "DELETE FROM " TblStates " WHERE " TblStates_Height ">=?";
-        sqlite::Statement stm(get_ParentObj()._db, req);
+        sqlite::Statement stm(*get_ParentObj().m_Statements, req);
         stm.bind(1, h);
         stm.step();
     }
@@ -2141,6 +2527,7 @@ namespace beam
     namespace wallet
     {
 		const char g_szPaymentProofRequired[] = "payment_proof_required";
+        const char g_szCoinsConsolidate[] = "coins_consolidate";
 
         bool getTxParameter(const IWalletDB& db, const TxID& txID, TxParameterID paramID, ECC::Point::Native& value)
         {
@@ -35,6 +35,11 @@ struct sqlite3;
 
 namespace beam
 {
+    namespace sqlite
+    {
+        struct StatementCache;
+    }
+
     const uint32_t EmptyCoinSession = 0;
 
     struct Coin
@@ -187,6 +192,9 @@ namespace beam
             const ByteBuffer& blob, bool shouldNotifyAboutChanges) = 0;
         virtual bool getTxParameter(const TxID& txID, wallet::TxParameterID paramID, ByteBuffer& blob) const = 0;
 
+        // Keeps the parameters of an active transaction in memory, until it's disabled
+        virtual void cacheTxParameters(const TxID& txID, bool enable) {}
+
         virtual Block::SystemState::IHistory& get_History() = 0;
         virtual void ShrinkHistory() = 0;
 
@@ -205,6 +213,8 @@ namespace beam
         static Ptr init(const std::string& path, const SecString& password, const ECC::NoLeak<ECC::uintBig>& secretKey);
         static Ptr open(const std::string& path, const SecString& password);
 
+        static const size_t s_MaxCandidates = 10000; // for the coin selection
+
         WalletDB(const ECC::NoLeak<ECC::uintBig>& secretKey);
         ~WalletDB();
 
@@ -253,6 +263,7 @@ namespace beam
         bool setTxParameter(const TxID& txID, wallet::TxParameterID paramID,
             const ByteBuffer& blob, bool shouldNotifyAboutChanges) override;
         bool getTxParameter(const TxID& txID, wallet::TxParameterID paramID, ByteBuffer& blob) const override;
+        void cacheTxParameters(const TxID& txID, bool enable) override;
 
         Block::SystemState::IHistory& get_History() override;
         void ShrinkHistory() override;
@@ -270,9 +281,20 @@ namespace beam
         void notifySystemStateChanged();
         void notifyAddressChanged();
         void updateCoinMaturityStatus();
+
+        struct CoinIndex;
+        CoinIndex& get_CoinIndex() const;
+
+        typedef std::map<wallet::TxParameterID, ByteBuffer> TxParameters;
+        TxParameters* find_TxParameters(const TxID&);
+        void load_TxParameters(const TxID&, TxParameters&) const;
     private:
 
         sqlite3* _db;
+        std::unique_ptr<sqlite::StatementCache> m_Statements;
+        mutable std::unique_ptr<CoinIndex> m_pCoinIndex; // loaded on demand
+        std::map<TxID, TxParameters> m_TxParameters; // of the active transactions only
+        bool m_bSavingTx = false; // the cache is updated after the commit
         Key::IKdf::Ptr m_pKdf;
 
         std::vector<IWalletDbObserver*> m_subscribers;
@@ -290,6 +312,7 @@ namespace beam
     namespace wallet
     {
 		extern const char g_szPaymentProofRequired[];
+        extern const char g_szCoinsConsolidate[]; // max number of the dust coins added to each selection, 0 by default
 
         template <typename Var>
         void setVar(IWalletDB& db, const char* name, const Var& var)
@@ -219,6 +219,9 @@ namespace beam {
 		Addr::Channel key;
 		key.m_Value = msg.m_Channel;
 
+		std::vector<const Addr*> vAddrs;
+		std::vector<proto::Bbs::Recipient> vRecipients;
+
 		for (ChannelSet::iterator it = m_Channels.lower_bound(key); ; it++)
 		{
 			if (m_Channels.end() == it)
@@ -226,13 +229,28 @@ namespace beam {
 			if (it->m_Value != msg.m_Channel)
 				break; // as well
 
+			const Addr& addr = it->get_ParentObj();
+			vAddrs.push_back(&addr);
+
+			vRecipients.emplace_back();
+			vRecipients.back().m_pSk = &addr.m_sk;
+			vRecipients.back().m_pPk = &addr.m_Pk;
+		}
+
+		for (uint32_t i0 = 0; i0 < vRecipients.size(); )
+		{
 			ByteBuffer buf = msg.m_Message; // duplicate
 
 			uint8_t* pMsg = &buf.front();
 			uint32_t nSize = static_cast<uint32_t>(buf.size());
 
-			if (!proto::Bbs::Decrypt(pMsg, nSize, it->get_ParentObj().m_sk))
-				continue;
+			uint32_t nCount = static_cast<uint32_t>(vRecipients.size()) - i0;
+			uint32_t i = proto::Bbs::DecryptMulti(pMsg, nSize, &vRecipients[i0], nCount);
+			if (i == nCount)
+				break;
+
+			const Addr& addr = *vAddrs[i0 + i];
+			i0 += i + 1; // in case it's not valid, try the remaining ones
 
 			wallet::SetTxParameter msgWallet;
 			bool bValid = false;
@@ -249,8 +267,8 @@ namespace beam {
 			if (bValid)
 			{
 				WalletID wid;
-				wid.m_Pk = it->get_ParentObj().m_Pk;
-				wid.m_Channel = it->m_Value;
+				wid.m_Pk = addr.m_Pk;
+				wid.m_Channel = addr.m_Channel.m_Value;
 				m_Wallet.OnWalletMessage(wid, std::move(msgWallet));
 				break;
 			}
@@ -279,6 +297,7 @@ namespace beam {
 			if (m_MineOutgoing)
 			{
 				proto::Bbs::get_HashPartial(pTask->m_hpPartial, pTask->m_Msg);
+				pTask->m_Start_ms = GetTime_ms();
 
 				if (!m_Miner.m_pEvt)
 				{
@@ -332,6 +351,12 @@ namespace beam {
 		}
 	}
 
+	WalletNetworkViaBbs::MinerStats WalletNetworkViaBbs::get_MinerStats()
+	{
+		std::unique_lock<std::mutex> scope(m_Miner.m_Mutex);
+		return m_Miner.m_Stats;
+	}
+
 	void WalletNetworkViaBbs::OnMined(proto::BbsMsg&& msg)
 	{
 		MyRequestBbsMsg::Ptr pReq(new MyRequestBbsMsg);
@@ -401,22 +426,31 @@ namespace beam {
 			}
 
 			Timestamp ts = 0;
+			ECC::Hash::Processor hpTs; // partial hash including the timestamp, reused for all the nonces
 			proto::Bbs::NonceType nonce = iThread;
 			bool bSuccess = false;
+			uint32_t i = 0;
 
-			for (uint32_t i = 0; ; i++)
+			for ( ; ; i++)
 			{
 				if (pTask->m_Done || m_Shutdown)
 					break;
 
 				if (!(i & 0xff))
-					ts = getTimestamp();
+				{
+					Timestamp tsNew = getTimestamp();
+					if (!i || (tsNew != ts))
+					{
+						ts = tsNew;
+						hpTs = pTask->m_hpPartial;
+						hpTs << ts;
+					}
+				}
 
 				// attempt to mine it
 				ECC::Hash::Value hv;
-				ECC::Hash::Processor hp = pTask->m_hpPartial;
+				ECC::Hash::Processor hp = hpTs;
 				hp
-					<< ts
 					<< nonce
 					>> hv;
 
@@ -429,16 +463,21 @@ namespace beam {
 				nonce += nStep;
 			}
 
-			if (bSuccess)
 			{
 				std::unique_lock<std::mutex> scope(m_Mutex);
 
-				if (pTask->m_Done)
-					bSuccess = false;
-				else
+				m_Stats.m_Hashes += bSuccess ? (i + 1) : i;
+
+				if (bSuccess && pTask->m_Done)
+					bSuccess = false; // mined by another thread
+
+				if (bSuccess)
 				{
 					assert(m_Pending.front() == pTask);
 
+					m_Stats.m_Messages++;
+					m_Stats.m_Time_ms += GetTime_ms() - pTask->m_Start_ms;
+
 					pTask->m_Msg.m_TimePosted = ts;
 					pTask->m_Msg.m_Nonce = nonce;
 
@@ -99,6 +99,18 @@ namespace beam
         void OnTimerBbsTmSave();
         void SaveBbsTimestamps();
 
+    public:
+		struct MinerStats
+		{
+			uint32_t m_Messages = 0;
+			uint64_t m_Hashes = 0; // all attempts, including those of the messages mined by other threads
+			uint32_t m_Time_ms = 0; // total time from Send to the successful nonce
+
+			double get_MessagesPerSec() const { return m_Time_ms ? (1000. * m_Messages / m_Time_ms) : 0.; }
+			double get_HashesPerSec() const { return m_Time_ms ? (1000. * m_Hashes / m_Time_ms) : 0.; }
+		};
+
+    private:
 		struct Miner
 		{
 			// message mining
@@ -114,6 +126,7 @@ namespace beam
 				proto::BbsMsg m_Msg;
 				ECC::Hash::Processor m_hpPartial;
 				volatile bool m_Done;
+				uint32_t m_Start_ms;
 
 				typedef std::shared_ptr<Task> Ptr;
 			};
@@ -123,6 +136,8 @@ namespace beam
 			TaskQueue m_Pending;
 			TaskQueue m_Done;
 
+			MinerStats m_Stats; // protected by m_Mutex
+
 			Miner() :m_Shutdown(false) {}
 			~Miner() { Stop(); }
 
@@ -141,6 +156,8 @@ namespace beam
 
 		bool m_MineOutgoing = true; // can be turned-off for testing
 
+		MinerStats get_MinerStats();
+
         void AddOwnAddress(const WalletAddress& address);
         void DeleteOwnAddress(uint64_t ownID);
     private:
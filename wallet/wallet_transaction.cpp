@@ -175,6 +175,9 @@ namespace beam { namespace wallet
                 OnFailed(TxFailureReason::TransactionExpired);
                 return true;
             }
+
+            if (maxHeight != MaxHeight)
+                m_Gateway.update_on_height(GetTxID(), maxHeight + 1);
         }
         else
         {
@@ -211,6 +214,7 @@ namespace beam { namespace wallet
     {
         UpdateTxDescription(TxStatus::Registering);
         m_Gateway.confirm_kernel(GetTxID(), kernel);
+        m_Gateway.update_on_next_tip(GetTxID()); // poll for the proof, and check the expiration
     }
 
     void BaseTransaction::CompleteTx()